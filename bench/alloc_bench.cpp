@@ -0,0 +1,79 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <min/bthread_pool.h>
+#include <new>
+#include <stdexcept>
+
+// Count heap allocations, this binary is separate so gl_bench keeps the default allocator
+static std::atomic<size_t> alloc_count(0);
+
+void *operator new(std::size_t size)
+{
+    alloc_count++;
+    void *out = std::malloc(size > 0 ? size : 1);
+    if (!out)
+    {
+        throw std::bad_alloc();
+    }
+
+    return out;
+}
+
+// GCC flags free() on inlined new expressions even though new calls malloc()
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+int main()
+{
+    try
+    {
+        // Running allocation test
+        std::cout << "thread_pool: Starting allocation benchmark" << std::endl;
+
+        // Create a threadpool for doing work in parallel
+        min::thread_pool pool;
+
+        // Task submission must be allocation free
+        const double tp = bench_thread_pool_alloc(pool, alloc_count);
+
+        // Print out diagnostics
+        std::cout << "Thread pool allocation took " << tp << " ms" << std::endl;
+        return 0;
+    }
+    catch (std::exception &ex)
+    {
+        // print the exception
+        std::cout << ex.what() << std::endl;
+        std::cout << "Allocation benchmark failed!" << std::endl;
+    }
+
+    return 1;
+}
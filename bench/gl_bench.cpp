@@ -18,9 +18,15 @@ limitations under the License.
 #include <min/bphysics.h>
 #include <min/bray.h>
 #include <min/bspatial.h>
+#include <min/bthread_pool.h>
 #include <min/bvector.h>
+#include <min/bvh.h>
 #include <min/bwavefront.h>
 #include <min/grid.h>
+#include <min/hash_grid.h>
+#include <min/linear_tree.h>
+#include <min/multi_grid.h>
+#include <min/sweep_prune.h>
 #include <min/tree.h>
 #include <string>
 
@@ -139,6 +145,133 @@ double tree(const size_t V)
     R += bench_sphere_oobb<double, double_oobb, min::vec3, min::tree>(V, dsw3, dob3);
     R += bench_sphere_sphere<double, double_both, min::vec3, min::tree>(V, dsw3, ds3);
 
+    // Run thread pool benchmarks, the subtrees are built and walked in parallel
+    std::cout << std::endl
+              << "Running in 3D parallel tree tests double precision mode" << std::endl
+              << std::endl;
+
+    for (const size_t S : {40000, 200000})
+    {
+        const std::vector<min::aabbox<double, min::vec3>> boxes = make_scatter_boxes<double>(S);
+        R += bench_parallel_pairs<double, min::tree>("parallel tree", S, dabw3, boxes);
+    }
+
+    return R;
+}
+
+double linear(const size_t V)
+{
+    double R = 0.0;
+
+    // Run linear tree benchmarks on the tree workloads
+    std::cout << std::endl
+              << "Running in 2D and 3D linear tree tests single precision mode" << std::endl
+              << std::endl;
+
+    R += bench_aabb_aabb<float, float_bb, min::vec2, min::linear_tree>(V, fabw2, fab2);
+    R += bench_aabb_aabb<float, float_bb, min::vec3, min::linear_tree>(V, fabw3, fab3);
+
+    // Run linear tree benchmarks on the tree workloads
+    std::cout << std::endl
+              << "Running in 2D and 3D linear tree tests double precision mode" << std::endl
+              << std::endl;
+
+    R += bench_aabb_aabb<double, double_both, min::vec2, min::linear_tree>(V, dabw2, dab2);
+    R += bench_aabb_aabb<double, double_both, min::vec3, min::linear_tree>(V, dabw3, dab3);
+
+    // Run scattered box benchmarks against the tree
+    std::cout << std::endl
+              << "Running in 3D scattered tree and linear tree tests single precision mode" << std::endl
+              << std::endl;
+
+    for (const size_t S : {40000, 200000})
+    {
+        const std::vector<min::aabbox<float, min::vec3>> boxes = make_scatter_boxes<float>(S);
+        R += bench_insert_pairs<float, min::tree>("scatter tree", S, fabw3, boxes);
+        R += bench_insert_pairs<float, min::linear_tree>("scatter linear tree", S, fabw3, boxes);
+    }
+
+    return R;
+}
+
+double hierarchy(const size_t V)
+{
+    double R = 0.0;
+
+    // Run bvh benchmarks on the tree workloads
+    std::cout << std::endl
+              << "Running in 2D and 3D bvh tests single precision mode" << std::endl
+              << std::endl;
+
+    R += bench_aabb_aabb<float, float_bb, min::vec2, min::bvh>(V, fabw2, fab2);
+    R += bench_aabb_aabb<float, float_bb, min::vec3, min::bvh>(V, fabw3, fab3);
+
+    // Run bvh benchmarks on the tree workloads
+    std::cout << std::endl
+              << "Running in 2D and 3D bvh tests double precision mode" << std::endl
+              << std::endl;
+
+    R += bench_aabb_aabb<double, double_both, min::vec2, min::bvh>(V, dabw2, dab2);
+    R += bench_aabb_aabb<double, double_both, min::vec3, min::bvh>(V, dabw3, dab3);
+
+    // Run clustered box benchmarks against the tree and hash grid
+    std::cout << std::endl
+              << "Running in 3D clustered tree, hash grid and bvh tests double precision mode" << std::endl
+              << std::endl;
+
+    const min::aabbox<double, min::vec3> world(min::vec3<double>(-1000000.0, -1000000.0, -1000000.0), min::vec3<double>(1000000.0, 1000000.0, 1000000.0));
+    for (const size_t S : {40000, 200000})
+    {
+        const std::vector<min::aabbox<double, min::vec3>> boxes = make_cluster_boxes<double>(S, 64);
+        R += bench_insert_pairs<double, min::tree>("cluster tree", S, world, boxes);
+        R += bench_insert_pairs<double, min::hash_grid>("cluster hash grid", S, world, boxes);
+        R += bench_insert_pairs<double, min::bvh>("cluster bvh", S, world, boxes);
+    }
+
+    // Run mixed size benchmarks against the tree
+    std::cout << std::endl
+              << "Running in 3D mixed size tree and bvh tests single precision mode" << std::endl
+              << std::endl;
+
+    for (const size_t S : {40000, 200000})
+    {
+        const std::vector<min::aabbox<float, min::vec3>> boxes = make_mixed_boxes<float>(S, 4);
+        R += bench_insert_pairs<float, min::tree>("mixed tree", S, fabw3, boxes);
+        R += bench_insert_pairs<float, min::bvh>("mixed bvh", S, fabw3, boxes);
+    }
+
+    // Run jittering box benchmarks, rebuilding against refitting every step
+    std::cout << std::endl
+              << "Running in 3D refit tree and bvh tests double precision mode" << std::endl
+              << std::endl;
+
+    const min::aabbox<double, min::vec3> wide(min::vec3<double>(-200000.0, -200000.0, -200000.0), min::vec3<double>(200000.0, 200000.0, 200000.0));
+    for (const size_t S : {40000, 200000})
+    {
+        const std::vector<min::aabbox<double, min::vec3>> boxes = make_scatter_boxes<double>(S);
+        R += bench_refit_pairs<double, min::tree>("refit tree", S, 10, wide, boxes);
+        R += bench_refit_pairs<double, min::bvh>("refit bvh", S, 10, wide, boxes);
+    }
+
+    return R;
+}
+
+double sweep(const size_t V)
+{
+    double R = 0.0;
+
+    // Run multi step physics benchmarks, the sweep keeps its sorted bounds between steps
+    std::cout << std::endl
+              << "Running in 2D and 3D physics step grid, tree and sweep tests single precision mode" << std::endl
+              << std::endl;
+
+    const size_t N = V / 4;
+    R += bench_physics_steps<float, min::vec2, min::grid>("physics_steps grid", N, 20, fabw2, fab2);
+    R += bench_physics_steps<float, min::vec2, min::sweep_prune>("physics_steps sweep", N, 20, fabw2, fab2);
+    R += bench_physics_steps<float, min::vec3, min::grid>("physics_steps grid", N, 20, fabw3, fab3);
+    R += bench_physics_steps<float, min::vec3, min::tree>("physics_steps tree", N, 20, fabw3, fab3);
+    R += bench_physics_steps<float, min::vec3, min::sweep_prune>("physics_steps sweep", N, 20, fabw3, fab3);
+
     return R;
 }
 
@@ -405,6 +538,80 @@ double ray3D(const size_t V)
     return R;
 }
 
+double closest()
+{
+    double R = 0.0;
+
+    // Run closest hit picking benchmarks
+    std::cout << std::endl
+              << "Running in 3D closest hit tests single precision mode" << std::endl
+              << std::endl;
+
+    R += bench_ray_closest<float, min::tree>(40000, fabw3);
+    R += bench_ray_closest<float, min::grid>(40000, fabw3);
+    R += bench_ray_batch<float, min::tree>(40000, fabw3);
+    R += bench_ray_batch<float, min::grid>(40000, fabw3);
+
+    return R;
+}
+
+double pairs()
+{
+    double R = 0.0;
+
+    // Run pair deduplication benchmarks at increasing scale
+    std::cout << std::endl
+              << "Running in 3D pair deduplication tests single precision mode" << std::endl
+              << std::endl;
+
+    for (const size_t V : {40000, 200000, 1000000})
+    {
+        R += bench_pair_dedup<float, min::tree>(V, fabw3);
+        R += bench_pair_dedup<float, min::grid>(V, fabw3);
+    }
+
+    return R;
+}
+
+double sparse()
+{
+    double R = 0.0;
+
+    // Run sparse world benchmarks, clusters of small boxes in a huge world
+    std::cout << std::endl
+              << "Running in 3D sparse world tests double precision mode" << std::endl
+              << std::endl;
+
+    const min::aabbox<double, min::vec3> world(min::vec3<double>(-1000000.0, -1000000.0, -1000000.0), min::vec3<double>(1000000.0, 1000000.0, 1000000.0));
+    for (const size_t V : {40000, 200000})
+    {
+        const std::vector<min::aabbox<double, min::vec3>> boxes = make_cluster_boxes<double>(V, 64);
+        R += bench_insert_pairs<double, min::grid>("sparse", V, world, boxes);
+        R += bench_insert_pairs<double, min::hash_grid>("sparse", V, world, boxes);
+    }
+
+    return R;
+}
+
+double mixed()
+{
+    double R = 0.0;
+
+    // Run mixed size benchmarks, a few large boxes among many small boxes
+    std::cout << std::endl
+              << "Running in 3D mixed size tests single precision mode" << std::endl
+              << std::endl;
+
+    for (const size_t V : {40000, 200000})
+    {
+        const std::vector<min::aabbox<float, min::vec3>> boxes = make_mixed_boxes<float>(V, 4);
+        R += bench_insert_pairs<float, min::grid>("mixed", V, fabw3, boxes);
+        R += bench_insert_pairs<float, min::multi_grid>("mixed", V, fabw3, boxes);
+    }
+
+    return R;
+}
+
 int main(int argc, char *argv[])
 {
     try
@@ -435,6 +642,15 @@ int main(int argc, char *argv[])
         // Test grid
         const double gt = grid(V_COL);
 
+        // Test linear tree
+        const double lt = linear(V_COL);
+
+        // Test bounding volume hierarchy
+        const double ht = hierarchy(V_COL);
+
+        // Test sweep and prune over many steps
+        const double sp = sweep(V_COL);
+
         // Test physics2D
         const double p2t = physics2D(V_COL);
 
@@ -447,6 +663,18 @@ int main(int argc, char *argv[])
         // Test ray3D
         const double r3t = ray3D(V_RAY);
 
+        // Test closest hit picking
+        const double ct = closest();
+
+        // Test pair deduplication scaling
+        const double pt = pairs();
+
+        // Test sparse worlds
+        const double st = sparse();
+
+        // Test mixed object sizes
+        const double mx = mixed();
+
         // Test load wavefront
         const double wt = bench_wavefront();
 
@@ -459,6 +687,9 @@ int main(int argc, char *argv[])
         // Test load vector
         const double sv = bench_static_vector();
 
+        // Test thread pool dispatch
+        const double tp = bench_thread_pool();
+
         // Enable logging to cout
         std::cout.clear();
 
@@ -466,17 +697,25 @@ int main(int argc, char *argv[])
         std::cout << std::endl
                   << "Tree took " << tt << " ms" << std::endl;
         std::cout << "Grid took " << gt << " ms" << std::endl;
+        std::cout << "Linear tree took " << lt << " ms" << std::endl;
+        std::cout << "BVH took " << ht << " ms" << std::endl;
+        std::cout << "Sweep took " << sp << " ms" << std::endl;
         std::cout << "Physics2D took " << p2t << " ms" << std::endl;
         std::cout << "Physics3D took " << p3t << " ms" << std::endl;
         std::cout << "Ray2D took " << r2t << " ms" << std::endl;
         std::cout << "Ray3D took " << r3t << " ms" << std::endl;
+        std::cout << "Closest hit took " << ct << " ms" << std::endl;
+        std::cout << "Pair dedup took " << pt << " ms" << std::endl;
+        std::cout << "Sparse took " << st << " ms" << std::endl;
+        std::cout << "Mixed took " << mx << " ms" << std::endl;
         std::cout << "Wavefront mesh took " << wt << " ms" << std::endl;
         std::cout << "Binary mesh took " << bt << " ms" << std::endl;
         std::cout << "MD5 mesh took " << mt << " ms" << std::endl;
         std::cout << "Static vector took " << sv << " ms" << std::endl;
+        std::cout << "Thread pool took " << tp << " ms" << std::endl;
 
         // Print the performance score
-        const double R = tt + gt + p2t + p3t + r2t + r3t + wt + bt + mt + sv;
+        const double R = tt + gt + p2t + p3t + r2t + r3t + wt + bt + mt + sv + tp;
         std::cout << "Graphics score is: " << V / R << std::endl;
         return 0;
     }
@@ -24,6 +24,7 @@ limitations under the License.
 #include <min/tree.h>
 #include <random>
 #include <stdexcept>
+#include <string>
 
 template <typename T, template <typename> class vec,
           template <typename, typename, typename, template <typename> class, template <typename, template <typename> class> class, template <typename, template <typename> class> class> class spatial>
@@ -259,4 +260,49 @@ double bench_physics_sphere_sphere(const size_t N, const min::sphere<T, vec> &wo
     return out;
 }
 
+template <typename T, template <typename> class vec,
+          template <typename, typename, typename, template <typename> class, template <typename, template <typename> class> class, template <typename, template <typename> class> class> class spatial>
+double bench_physics_steps(const std::string &name, const size_t N, const size_t steps, const min::aabbox<T, vec> &world, const std::vector<min::aabbox<T, vec>> &boxes)
+{
+    // Running multi step test
+    std::cout << name << ": Starting benchmark with " << N << " bodies over " << steps << " steps" << std::endl;
+
+    // Create simulation
+    vec<T> gravity = vec<T>::up() * -10.0;
+    min::physics<T, uint_fast16_t, uint_fast32_t, vec, min::aabbox, min::aabbox, spatial> simulation(world, gravity);
+    simulation.reserve(N);
+
+    // Create 'N' bodies
+    for (size_t i = 0; i < N; i++)
+    {
+        simulation.add_body(boxes[i], 100.0);
+    }
+
+    // Build the spatial structure on the first step
+    simulation.solve(0.001, 0.01);
+
+    // Start the time clock
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    // Solve the following steps, bodies move a little each step
+    for (size_t i = 0; i < steps; i++)
+    {
+        simulation.solve(0.001, 0.01);
+    }
+
+    // Calculate energy of the system
+    const double energy = simulation.get_total_energy();
+    std::cout << name << ": Energy after solving is: " << energy << std::endl;
+
+    // Calculate the difference between start and end
+    const auto dtime = std::chrono::high_resolution_clock::now() - start;
+
+    // Print the execution time
+    const double out = std::chrono::duration<double, std::milli>(dtime).count();
+    std::cout << name << ": steps completed in: " << out << " ms" << std::endl;
+
+    // Calculate cost of calculation (milliseconds)
+    return out;
+}
+
 #endif
@@ -15,10 +15,15 @@ limitations under the License.
 #ifndef _MGL_BENCHRAY_MGL_
 #define _MGL_BENCHRAY_MGL_
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <iostream>
 #include <min/ray.h>
 #include <min/sphere.h>
+#include <min/thread_pool.h>
+#include <min/vec3.h>
+#include <random>
 #include <stdexcept>
 
 template <typename T, template <typename> class vec,
@@ -399,4 +404,197 @@ double bench_ray_sphere(const size_t N, const min::sphere<T, vec> &world)
     // Calculate cost of calculation (milliseconds)
     return out;
 }
+template <typename T, template <typename, typename, typename, template <typename> class, template <typename, template <typename> class> class, template <typename, template <typename> class> class> class spatial>
+double bench_ray_closest(const size_t N, const min::aabbox<T, min::vec3> &world)
+{
+    // Running ray_closest test
+    std::cout << "ray_closest: Starting benchmark with " << N << " picking rays" << std::endl;
+
+    // Create spatial structure
+    spatial<T, uint_fast32_t, uint_fast64_t, min::vec3, min::aabbox, min::aabbox> g(world);
+
+    // Create 'N' overlapping boxes of mixed sizes with a fixed seed
+    std::mt19937 rng(1337);
+    const min::vec3<T> &min = world.get_min();
+    const min::vec3<T> &max = world.get_max();
+    std::uniform_real_distribution<T> x(min.x() * 0.9, max.x() * 0.9);
+    std::uniform_real_distribution<T> size(max.x() * 0.0005, max.x() * 0.005);
+    std::vector<min::aabbox<T, min::vec3>> items;
+    items.reserve(N);
+    for (size_t i = 0; i < N; i++)
+    {
+        const min::vec3<T> center(x(rng), x(rng), x(rng));
+        const T extent = size(rng);
+        items.emplace_back(center - extent, center + extent);
+    }
+
+    // Insert the boxes into the spatial structure
+    g.insert(items);
+
+    // Aim each ray from a random point at a random box
+    std::vector<min::ray<T, min::vec3>> rays;
+    rays.reserve(N);
+    for (size_t i = 0; i < N; i++)
+    {
+        const min::vec3<T> from(x(rng), x(rng), x(rng));
+        rays.emplace_back(from, items[(i * 7919) % N].get_center());
+    }
+
+    // Pick the nearest of the hits in the first occupied cell
+    const auto first_start = std::chrono::high_resolution_clock::now();
+    std::vector<T> first(N, std::numeric_limits<T>::max());
+    for (size_t i = 0; i < N; i++)
+    {
+        const min::ray<T, min::vec3> &r = rays[i];
+        for (const auto &hit : g.get_collisions(r))
+        {
+            first[i] = std::min(first[i], (hit.second - r.get_origin()).dot(r.get_direction()));
+        }
+    }
+    const auto first_dtime = std::chrono::high_resolution_clock::now() - first_start;
+    const double first_out = std::chrono::duration<double, std::milli>(first_dtime).count();
+
+    // Start the time clock
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    // Get the nearest hit with early termination
+    std::vector<T> closest(N, std::numeric_limits<T>::max());
+    for (size_t i = 0; i < N; i++)
+    {
+        uint_fast32_t key;
+        min::vec3<T> point;
+        const min::ray<T, min::vec3> &r = rays[i];
+        if (g.get_closest_hit(r, std::numeric_limits<T>::max(), key, point))
+        {
+            closest[i] = (point - r.get_origin()).dot(r.get_direction());
+        }
+    }
+
+    // Calculate the difference between start and end
+    const auto dtime = std::chrono::high_resolution_clock::now() - start;
+    const double out = std::chrono::duration<double, std::milli>(dtime).count();
+
+    // Every ray is aimed at a box, count rays where the first cell hid a nearer hit
+    size_t missed = 0;
+    size_t farther = 0;
+    for (size_t i = 0; i < N; i++)
+    {
+        missed += (closest[i] == std::numeric_limits<T>::max());
+        farther += (first[i] > closest[i]);
+    }
+    if (missed > 0)
+    {
+        throw std::runtime_error("ray_closest: Failed benchmark, ray missed its target");
+    }
+
+    // Print the execution time
+    std::cout << "ray_closest: first cell hits then nearest in: " << first_out << " ms, " << farther << " rays not nearest" << std::endl;
+    std::cout << "ray_closest: get_closest_hit() in: " << out << " ms" << std::endl;
+
+    // Calculate cost of calculation (milliseconds)
+    return out;
+}
+template <typename T, template <typename, typename, typename, template <typename> class, template <typename, template <typename> class> class, template <typename, template <typename> class> class> class spatial>
+double bench_ray_batch(const size_t N, const min::aabbox<T, min::vec3> &world)
+{
+    // Running ray_batch test
+    std::cout << "ray_batch: Starting benchmark with " << N << " line of sight rays" << std::endl;
+
+    // Create spatial structure
+    spatial<T, uint_fast32_t, uint_fast64_t, min::vec3, min::aabbox, min::aabbox> g(world);
+
+    // Create 'N' overlapping boxes of mixed sizes with a fixed seed
+    std::mt19937 rng(1337);
+    const min::vec3<T> &min = world.get_min();
+    const min::vec3<T> &max = world.get_max();
+    std::uniform_real_distribution<T> x(min.x() * 0.9, max.x() * 0.9);
+    std::uniform_real_distribution<T> size(max.x() * 0.0005, max.x() * 0.005);
+    std::vector<min::aabbox<T, min::vec3>> items;
+    items.reserve(N);
+    for (size_t i = 0; i < N; i++)
+    {
+        const min::vec3<T> center(x(rng), x(rng), x(rng));
+        const T extent = size(rng);
+        items.emplace_back(center - extent, center + extent);
+    }
+
+    // Insert the boxes into the spatial structure
+    g.insert(items);
+
+    // Half the rays fan out from a few eyes, half are random, shuffled like rays gathered from many agents
+    std::uniform_real_distribution<T> spread(max.x() * -0.02, max.x() * 0.02);
+    std::vector<min::ray<T, min::vec3>> rays;
+    rays.reserve(N);
+    const size_t fans = N / 128;
+    for (size_t i = 0; i < fans; i++)
+    {
+        const min::vec3<T> eye(x(rng), x(rng), x(rng));
+        const min::vec3<T> target = items[(i * 7919) % N].get_center();
+        for (size_t j = 0; j < 64; j++)
+        {
+            rays.emplace_back(eye, target + min::vec3<T>(spread(rng), spread(rng), spread(rng)));
+        }
+    }
+    while (rays.size() < N)
+    {
+        rays.emplace_back(min::vec3<T>(x(rng), x(rng), x(rng)), min::vec3<T>(x(rng), x(rng), x(rng)));
+    }
+    std::shuffle(rays.begin(), rays.end(), rng);
+
+    // Get the nearest hit of each ray one at a time
+    const auto single_start = std::chrono::high_resolution_clock::now();
+    std::vector<T> single(N, std::numeric_limits<T>::max());
+    for (size_t i = 0; i < N; i++)
+    {
+        uint_fast32_t key;
+        min::vec3<T> point;
+        const min::ray<T, min::vec3> &r = rays[i];
+        if (g.get_closest_hit(r, std::numeric_limits<T>::max(), key, point))
+        {
+            single[i] = (point - r.get_origin()).dot(r.get_direction());
+        }
+    }
+    const auto single_dtime = std::chrono::high_resolution_clock::now() - single_start;
+    const double single_out = std::chrono::duration<double, std::milli>(single_dtime).count();
+
+    // Get the nearest hits as one batch on a single thread, isolating the ray ordering and packets
+    min::thread_pool_config config;
+    config.set_threads(1);
+    min::thread_pool serial(config);
+    const auto serial_start = std::chrono::high_resolution_clock::now();
+    g.get_closest_hits(serial, rays, std::numeric_limits<T>::max());
+    const auto serial_dtime = std::chrono::high_resolution_clock::now() - serial_start;
+    const double serial_out = std::chrono::duration<double, std::milli>(serial_dtime).count();
+
+    // Start the time clock
+    min::thread_pool pool;
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    // Get the nearest hits as one batch on all threads
+    const auto &batch = g.get_closest_hits(pool, rays, std::numeric_limits<T>::max());
+
+    // Calculate the difference between start and end
+    const auto dtime = std::chrono::high_resolution_clock::now() - start;
+    const double out = std::chrono::duration<double, std::milli>(dtime).count();
+
+    // The batch must find the same nearest hits
+    const uint_fast32_t miss = std::numeric_limits<uint_fast32_t>::max();
+    for (size_t i = 0; i < N; i++)
+    {
+        const min::ray<T, min::vec3> &r = rays[i];
+        const T t = (batch[i].first == miss) ? std::numeric_limits<T>::max() : (batch[i].second - r.get_origin()).dot(r.get_direction());
+        if ((t == std::numeric_limits<T>::max()) != (single[i] == std::numeric_limits<T>::max()) || std::abs(t - single[i]) > max.x() * 1E-4)
+        {
+            throw std::runtime_error("ray_batch: Failed benchmark, batch hit does not match single ray");
+        }
+    }
+
+    // Print the execution time
+    std::cout << "ray_batch: get_closest_hit() per ray in: " << single_out << " ms" << std::endl;
+    std::cout << "ray_batch: get_closest_hits() 1 thread in: " << serial_out << " ms" << std::endl;
+    std::cout << "ray_batch: get_closest_hits() " << pool.get_thread_count() << " threads in: " << out << " ms" << std::endl;
+
+    // Calculate cost of calculation (milliseconds)
+    return out;
+}
 #endif
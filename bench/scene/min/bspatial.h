@@ -15,13 +15,17 @@ limitations under the License.
 #ifndef _MGL_BENCHSPATIAL_MGL_
 #define _MGL_BENCHSPATIAL_MGL_
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <min/aabbox.h>
+#include <min/bit_flag.h>
 #include <min/oobbox.h>
 #include <min/sphere.h>
+#include <min/thread_pool.h>
 #include <random>
 #include <stdexcept>
+#include <string>
 
 template <typename T, template <typename> class vec>
 constexpr min::sphere<T, vec> make_sphere()
@@ -498,4 +502,291 @@ double bench_oobb_sphere(const size_t N, const min::oobbox<T, vec> &world, const
     // Calculate cost of calculation (milliseconds)
     return out;
 }
+
+template <typename T>
+const std::vector<min::aabbox<T, min::vec3>> make_scatter_boxes(const size_t N)
+{
+    // Local variables
+    const T low = -99999.999;
+    const T high = 99999.999;
+    std::vector<min::aabbox<T, min::vec3>> items;
+    items.reserve(N);
+
+    // The objects will be between 1.0 and 100, scattered on all axes
+    std::uniform_real_distribution<T> x(low, high);
+    std::uniform_real_distribution<T> size(1.0, 100.0);
+
+    // Mersenne Twister: Good quality random number generator
+    std::mt19937 rng;
+    // Initialize with fixed seed
+    rng.seed(1337);
+
+    // Create 'N' random cubic aabb's
+    for (size_t i = 0; i < N; i++)
+    {
+        // Calculate AABB center and extent
+        const T cx = x(rng);
+        const T cy = x(rng);
+        const T cz = x(rng);
+        const min::vec3<T> center(cx, cy, cz);
+        const T extent = size(rng);
+
+        // Create the AABB
+        const min::vec3<T> min = center - extent;
+        const min::vec3<T> max = center + extent;
+        items.emplace_back(min, max);
+    }
+
+    return items;
+}
+
+template <typename T, template <typename, typename, typename, template <typename> class, template <typename, template <typename> class> class, template <typename, template <typename> class> class> class spatial>
+double bench_pair_dedup(const size_t N, const min::aabbox<T, min::vec3> &world)
+{
+    // Running pair_dedup test
+    std::cout << "pair_dedup: Starting benchmark with " << N << " insertions" << std::endl;
+
+    // Create 'N' scattered boxes
+    const std::vector<min::aabbox<T, min::vec3>> boxes = make_scatter_boxes<T>(N);
+
+    // Create the spatial data structure
+    spatial<T, uint_fast32_t, uint_fast64_t, min::vec3, min::aabbox, min::aabbox> g(world);
+    g.insert(boxes);
+
+    // Start the time clock
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    // Get all colliding objects, pairs are reported once by their owner cell
+    std::vector<std::pair<uint_fast32_t, uint_fast32_t>> collisions = g.get_collisions();
+
+    // Calculate the difference between start and end
+    const auto dtime = std::chrono::high_resolution_clock::now() - start;
+    const double out = std::chrono::duration<double, std::milli>(dtime).count();
+
+    // Report collisions found
+    std::cout << "pair_dedup: Collisions found: " << collisions.size() << std::endl;
+    std::cout << "pair_dedup: owner cell get_collisions() in: " << out << " ms" << std::endl;
+
+    // Every pair must be reported exactly once
+    std::sort(collisions.begin(), collisions.end());
+    if (std::adjacent_find(collisions.begin(), collisions.end()) != collisions.end())
+    {
+        throw std::runtime_error("pair_dedup: Failed benchmark, duplicate collision pairs");
+    }
+
+    // The previous scheme kept an N x N bit matrix and cleared it on every query
+    const double flag_mb = (static_cast<double>(N) * N) / (8.0 * 1024.0 * 1024.0);
+    std::cout << "pair_dedup: N^2 bit_flag would need " << flag_mb << " MB" << std::endl;
+    if (flag_mb > 512.0)
+    {
+        std::cout << "pair_dedup: N^2 bit_flag skipped, too large to allocate" << std::endl;
+        return out;
+    }
+
+    // Time the N^2 flag allocation, clear and a lookup per reported pair
+    const auto flag_start = std::chrono::high_resolution_clock::now();
+    min::bit_flag<uint_fast32_t, uint_fast64_t> flags(N, N);
+    flags.clear();
+    size_t dups = 0;
+    for (const auto &p : collisions)
+    {
+        dups += flags.get_set_on(p.first, p.second);
+    }
+
+    // Calculate the difference between start and end
+    const auto flag_dtime = std::chrono::high_resolution_clock::now() - flag_start;
+    const double flag_out = std::chrono::duration<double, std::milli>(flag_dtime).count();
+    std::cout << "pair_dedup: N^2 bit_flag dedup overhead: " << flag_out << " ms, " << dups << " duplicates" << std::endl;
+
+    // Calculate cost of calculation (milliseconds)
+    return out;
+}
+template <typename T>
+const std::vector<min::aabbox<T, min::vec3>> make_cluster_boxes(const size_t N, const size_t clusters)
+{
+    // Local variables
+    const T low = -999999.999;
+    const T high = 999999.999;
+    std::vector<min::aabbox<T, min::vec3>> items;
+    items.reserve(N);
+
+    // The objects will be between 1.0 and 10.0, packed in clusters far apart
+    std::uniform_real_distribution<T> x(low, high);
+    std::uniform_real_distribution<T> offset(-1000.0, 1000.0);
+    std::uniform_real_distribution<T> size(1.0, 10.0);
+
+    // Mersenne Twister: Good quality random number generator
+    std::mt19937 rng;
+    // Initialize with fixed seed
+    rng.seed(1337);
+
+    // Create 'N' random cubic aabb's around each cluster center
+    const size_t per = N / clusters;
+    for (size_t c = 0; c < clusters; c++)
+    {
+        const min::vec3<T> origin(x(rng), x(rng), x(rng));
+        for (size_t i = 0; i < per; i++)
+        {
+            // Calculate AABB center and extent
+            const min::vec3<T> center = origin + min::vec3<T>(offset(rng), offset(rng), offset(rng));
+            const T extent = size(rng);
+
+            // Create the AABB
+            const min::vec3<T> min = center - extent;
+            const min::vec3<T> max = center + extent;
+            items.emplace_back(min, max);
+        }
+    }
+
+    return items;
+}
+
+template <typename T>
+const std::vector<min::aabbox<T, min::vec3>> make_mixed_boxes(const size_t N, const size_t large)
+{
+    // Many small scattered boxes
+    std::vector<min::aabbox<T, min::vec3>> items = make_scatter_boxes<T>(N - large);
+
+    // A few static boxes spanning a large part of the world
+    for (size_t i = 0; i < large; i++)
+    {
+        const T offset = -60000.0 + 40000.0 * i;
+        const min::vec3<T> center(offset, -offset, offset);
+        items.emplace_back(center - 20000.0, center + 20000.0);
+    }
+
+    return items;
+}
+
+template <typename T, template <typename, typename, typename, template <typename> class, template <typename, template <typename> class> class, template <typename, template <typename> class> class> class spatial>
+double bench_insert_pairs(const std::string &name, const size_t N, const min::aabbox<T, min::vec3> &world, const std::vector<min::aabbox<T, min::vec3>> &boxes)
+{
+    // Running test
+    std::cout << name << ": Starting benchmark with " << N << " insertions" << std::endl;
+
+    // Create the spatial data structure
+    spatial<T, uint_fast32_t, uint_fast64_t, min::vec3, min::aabbox, min::aabbox> g(world);
+
+    // Start the time clock
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    // Insert the boxes and get all colliding objects
+    g.insert(boxes);
+    const std::vector<std::pair<uint_fast32_t, uint_fast32_t>> &collisions = g.get_collisions();
+
+    // Calculate the difference between start and end
+    const auto dtime = std::chrono::high_resolution_clock::now() - start;
+    const double out = std::chrono::duration<double, std::milli>(dtime).count();
+
+    // Report collisions found
+    std::cout << name << ": Grid scale: " << g.get_scale() << std::endl;
+    std::cout << name << ": Collisions found: " << collisions.size() << std::endl;
+    std::cout << name << ": insert() and get_collisions() in: " << out << " ms" << std::endl;
+
+    // Calculate cost of calculation (milliseconds)
+    return out;
+}
+
+template <typename T, template <typename, typename, typename, template <typename> class, template <typename, template <typename> class> class, template <typename, template <typename> class> class> class spatial>
+double bench_refit_pairs(const std::string &name, const size_t N, const size_t steps, const min::aabbox<T, min::vec3> &world, std::vector<min::aabbox<T, min::vec3>> boxes)
+{
+    // Running test
+    std::cout << name << ": Starting benchmark with " << N << " boxes over " << steps << " steps" << std::endl;
+
+    // Create the spatial data structures, one is rebuilt and one is refit every step
+    spatial<T, uint_fast32_t, uint_fast64_t, min::vec3, min::aabbox, min::aabbox> rebuilt(world);
+    spatial<T, uint_fast32_t, uint_fast64_t, min::vec3, min::aabbox, min::aabbox> refitted(world);
+    rebuilt.insert(boxes);
+    refitted.insert(boxes);
+
+    // The boxes jitter a little every step
+    std::uniform_real_distribution<T> step(-5.0, 5.0);
+    std::mt19937 rng;
+    rng.seed(1337);
+
+    double insert_time = 0.0;
+    double refit_time = 0.0;
+    size_t insert_count = 0;
+    size_t refit_count = 0;
+    size_t refits = 0;
+    for (size_t i = 0; i < steps; i++)
+    {
+        // Move every box
+        for (auto &b : boxes)
+        {
+            const min::vec3<T> offset(step(rng), step(rng), step(rng));
+            b = min::aabbox<T, min::vec3>(b.get_min() + offset, b.get_max() + offset);
+        }
+
+        // Rebuild and get all colliding objects
+        auto start = std::chrono::high_resolution_clock::now();
+        rebuilt.insert(boxes);
+        insert_count += rebuilt.get_collisions().size();
+        insert_time += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        // Refit and get all colliding objects
+        start = std::chrono::high_resolution_clock::now();
+        refits += refitted.refit(boxes);
+        refit_count += refitted.get_collisions().size();
+        refit_time += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // Both structures must find the same collisions
+    if (insert_count != refit_count)
+    {
+        throw std::runtime_error(name + ": refit collisions do not match insert");
+    }
+
+    // Report collisions found
+    std::cout << name << ": Collisions found: " << refit_count << std::endl;
+    std::cout << name << ": Steps refit without rebuild: " << refits << std::endl;
+    std::cout << name << ": insert() and get_collisions() in: " << insert_time << " ms" << std::endl;
+    std::cout << name << ": refit() and get_collisions() in: " << refit_time << " ms" << std::endl;
+
+    // Calculate cost of calculation (milliseconds)
+    return refit_time;
+}
+
+template <typename T, template <typename, typename, typename, template <typename> class, template <typename, template <typename> class> class, template <typename, template <typename> class> class> class spatial>
+double bench_parallel_pairs(const std::string &name, const size_t N, const min::aabbox<T, min::vec3> &world, const std::vector<min::aabbox<T, min::vec3>> &boxes)
+{
+    // Running test
+    std::cout << name << ": Starting benchmark with " << N << " insertions" << std::endl;
+
+    // Create the spatial data structures
+    spatial<T, uint_fast32_t, uint_fast64_t, min::vec3, min::aabbox, min::aabbox> serial(world);
+    spatial<T, uint_fast32_t, uint_fast64_t, min::vec3, min::aabbox, min::aabbox> parallel(world);
+
+    // Insert the boxes and get all colliding objects on one thread
+    const auto serial_start = std::chrono::high_resolution_clock::now();
+    serial.insert(boxes);
+    const std::vector<std::pair<uint_fast32_t, uint_fast32_t>> &expected = serial.get_collisions();
+    const double serial_out = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - serial_start).count();
+
+    // Start the time clock
+    min::thread_pool pool;
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    // Insert the boxes and get all colliding objects on all threads
+    parallel.insert(pool, boxes);
+    const std::vector<std::pair<uint_fast32_t, uint_fast32_t>> &collisions = parallel.get_collisions(pool);
+
+    // Calculate the difference between start and end
+    const auto dtime = std::chrono::high_resolution_clock::now() - start;
+    const double out = std::chrono::duration<double, std::milli>(dtime).count();
+
+    // The thread pool must find the same collisions
+    if (expected != collisions)
+    {
+        throw std::runtime_error(name + ": parallel collisions do not match serial");
+    }
+
+    // Report collisions found
+    std::cout << name << ": Collisions found: " << collisions.size() << std::endl;
+    std::cout << name << ": insert() and get_collisions() in: " << serial_out << " ms" << std::endl;
+    std::cout << name << ": insert() and get_collisions() " << pool.get_thread_count() << " threads in: " << out << " ms" << std::endl;
+
+    // Calculate cost of calculation (milliseconds)
+    return out;
+}
 #endif
@@ -0,0 +1,142 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_BENCH_THREAD_POOL_MGL_
+#define _MGL_BENCH_THREAD_POOL_MGL_
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <min/thread_pool.h>
+#include <stdexcept>
+#include <thread>
+
+double bench_thread_pool_dispatch(min::thread_pool &pool, const char *mode)
+{
+    const size_t runs = 10000;
+    const size_t items = pool.get_thread_count();
+
+    // Empty work items measure pure dispatch overhead
+    const auto empty = [](std::mt19937 &gen, const size_t i) {};
+
+    // Start the time clock
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    // Dispatch empty work to the pool
+    for (size_t i = 0; i < runs; i++)
+    {
+        pool.run(std::cref(empty), 0, items);
+    }
+
+    // Calculate the difference between start and end
+    const auto dtime = std::chrono::high_resolution_clock::now() - start;
+    const double out = std::chrono::duration<double, std::milli>(dtime).count();
+    std::cout << "thread_pool " << mode << ": dispatch latency " << (out * 1000.0) / runs << " us per run" << std::endl;
+
+    // Measure process CPU time while the pool sits idle between frames
+    const std::clock_t cpu_start = std::clock();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const std::clock_t cpu_stop = std::clock();
+    const double idle = (1000.0 * (cpu_stop - cpu_start)) / CLOCKS_PER_SEC;
+    std::cout << "thread_pool " << mode << ": idle cpu " << idle << " ms per 100 ms wall" << std::endl;
+
+    // Calculate cost of calculation (milliseconds)
+    return out;
+}
+
+// Allocations are counted by alloc_bench, which replaces the global allocator in its own binary
+double bench_thread_pool_alloc(min::thread_pool &pool, const std::atomic<size_t> &alloc_count)
+{
+    const size_t runs = 10000;
+    const size_t items = pool.get_thread_count();
+
+    // Capture enough state to overflow the small buffer in std::function
+    size_t sum = 0;
+    size_t *ptr = &sum;
+    const size_t a = 1, b = 2, c = 3, d = 4;
+    const auto work = [ptr, a, b, c, d](std::mt19937 &gen, const size_t i) {
+        if (i == 0)
+        {
+            *ptr += a + b + c + d;
+        }
+    };
+    const auto task = [ptr, a, b, c, d](std::mt19937 &gen) {
+        *ptr += a + b + c + d;
+    };
+
+    // Start the time clock
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    // Count allocations made by run()
+    const size_t run_start = alloc_count;
+    for (size_t i = 0; i < runs; i++)
+    {
+        pool.run(work, 0, items);
+    }
+    const size_t run_allocs = alloc_count - run_start;
+
+    // Count allocations made by submit() and wait()
+    const size_t submit_start = alloc_count;
+    for (size_t i = 0; i < runs; i++)
+    {
+        pool.submit(task).wait();
+    }
+    const size_t submit_allocs = alloc_count - submit_start;
+
+    // Calculate the difference between start and end
+    const auto dtime = std::chrono::high_resolution_clock::now() - start;
+    const double out = std::chrono::duration<double, std::milli>(dtime).count();
+    std::cout << "thread_pool: " << run_allocs << " allocations in " << runs << " runs" << std::endl;
+    std::cout << "thread_pool: " << submit_allocs << " allocations in " << runs << " submits" << std::endl;
+    std::cout << "thread_pool: " << (out * 1000.0) / (2 * runs) << " us per run or submit" << std::endl;
+
+    // Every job must have run
+    if (sum != 2 * runs * (a + b + c + d))
+    {
+        throw std::runtime_error("bench_thread_pool: jobs were lost");
+    }
+
+    // Task submission must not touch the heap
+    if (run_allocs > 0 || submit_allocs > 0)
+    {
+        throw std::runtime_error("bench_thread_pool: task submission allocated memory");
+    }
+
+    // Calculate cost of calculation (milliseconds)
+    return out;
+}
+
+double bench_thread_pool()
+{
+    // Running thread pool test
+    std::cout << std::endl
+              << "thread_pool: Starting dispatch benchmark" << std::endl;
+
+    // Create a threadpool for doing work in parallel
+    min::thread_pool pool;
+
+    // Workers spin briefly then park between runs
+    double out = bench_thread_pool_dispatch(pool, "sleep");
+
+    // Workers spin between runs
+    pool.wake();
+    out += bench_thread_pool_dispatch(pool, "turbo");
+    pool.sleep();
+
+    // Calculate cost of calculation (milliseconds)
+    return out;
+}
+
+#endif
@@ -15,6 +15,7 @@ limitations under the License.
 #ifndef _MGL_INTERSECT_MGL_
 #define _MGL_INTERSECT_MGL_
 
+#include <algorithm>
 #include <cmath>
 #include <min/aabbox.h>
 #include <min/frustum.h>
@@ -123,6 +124,43 @@ inline bool intersect(const aabbox<T, vec> &box, const ray<T, vec> &r, vec<T> &p
     return false;
 }
 
+// Distance along the ray to where it enters the box given by min and max
+// The distance is zero if the ray starts inside the box
+template <typename T, template <typename> class vec>
+inline bool ray_entry(const vec<T> &min, const vec<T> &max, const ray<T, vec> &r, T &t)
+{
+    const vec<T> &o = r.get_origin();
+    const vec<T> &inv = r.get_inverse();
+
+    // If parallel to an axis and not in slab
+    if (o.any_zero_outside(r.get_direction(), min, max))
+    {
+        return false;
+    }
+
+    // Calculate the intersection with near and far plane
+    vec<T> near = (min - o) * inv;
+    vec<T> far = (max - o) * inv;
+
+    // Order to get the nearer intersection points
+    vec<T>::order(near, far);
+
+    // Get the farthest entry into the slab
+    const T tmin = near.max();
+
+    // Get the nearest exit from a slab
+    const T tmax = far.min();
+
+    // If the nearest exit is in front of the ray and after the farthest entry
+    if (tmax >= tmin && tmax >= 0.0)
+    {
+        t = std::max(tmin, static_cast<T>(0.0));
+        return true;
+    }
+
+    return false;
+}
+
 template <typename T, template <typename> class vec>
 inline bool intersect(const oobbox<T, vec> &box, const ray<T, vec> &r, vec<T> &p)
 {
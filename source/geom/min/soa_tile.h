@@ -0,0 +1,426 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_SOA_TILE_MGL_
+#define _MGL_SOA_TILE_MGL_
+
+#include <cstddef>
+#include <min/aabbox.h>
+#include <min/sphere.h>
+#include <type_traits>
+
+// Define MGL_SIMD to test several shapes of a tile at a time with SSE2 or AVX
+#ifdef MGL_SIMD
+#if defined(__AVX__)
+#include <immintrin.h>
+#define MGL_SIMD_LANES
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MGL_SIMD_LANES
+#endif
+#endif
+
+namespace min
+{
+
+// A tile stores the bounds of N shapes as arrays of N values, one array per bound component
+// Both kernels test shape i against shapes [begin, n) and call f(j) for every overlap
+
+#ifdef MGL_SIMD_LANES
+#if defined(__AVX__)
+class soa_lanes_float
+{
+  public:
+    typedef __m256 type;
+    inline static constexpr size_t size()
+    {
+        return 8;
+    }
+    inline static type load(const float *const p)
+    {
+        return _mm256_loadu_ps(p);
+    }
+    inline static type set(const float a)
+    {
+        return _mm256_set1_ps(a);
+    }
+    inline static type add(const type a, const type b)
+    {
+        return _mm256_add_ps(a, b);
+    }
+    inline static type sub(const type a, const type b)
+    {
+        return _mm256_sub_ps(a, b);
+    }
+    inline static type mul(const type a, const type b)
+    {
+        return _mm256_mul_ps(a, b);
+    }
+    inline static type both(const type a, const type b)
+    {
+        return _mm256_and_ps(a, b);
+    }
+    inline static type le(const type a, const type b)
+    {
+        return _mm256_cmp_ps(a, b, _CMP_LE_OQ);
+    }
+    inline static type ge(const type a, const type b)
+    {
+        return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+    }
+    inline static int mask(const type a)
+    {
+        return _mm256_movemask_ps(a);
+    }
+};
+class soa_lanes_double
+{
+  public:
+    typedef __m256d type;
+    inline static constexpr size_t size()
+    {
+        return 4;
+    }
+    inline static type load(const double *const p)
+    {
+        return _mm256_loadu_pd(p);
+    }
+    inline static type set(const double a)
+    {
+        return _mm256_set1_pd(a);
+    }
+    inline static type add(const type a, const type b)
+    {
+        return _mm256_add_pd(a, b);
+    }
+    inline static type sub(const type a, const type b)
+    {
+        return _mm256_sub_pd(a, b);
+    }
+    inline static type mul(const type a, const type b)
+    {
+        return _mm256_mul_pd(a, b);
+    }
+    inline static type both(const type a, const type b)
+    {
+        return _mm256_and_pd(a, b);
+    }
+    inline static type le(const type a, const type b)
+    {
+        return _mm256_cmp_pd(a, b, _CMP_LE_OQ);
+    }
+    inline static type ge(const type a, const type b)
+    {
+        return _mm256_cmp_pd(a, b, _CMP_GE_OQ);
+    }
+    inline static int mask(const type a)
+    {
+        return _mm256_movemask_pd(a);
+    }
+};
+#else
+class soa_lanes_float
+{
+  public:
+    typedef __m128 type;
+    inline static constexpr size_t size()
+    {
+        return 4;
+    }
+    inline static type load(const float *const p)
+    {
+        return _mm_loadu_ps(p);
+    }
+    inline static type set(const float a)
+    {
+        return _mm_set1_ps(a);
+    }
+    inline static type add(const type a, const type b)
+    {
+        return _mm_add_ps(a, b);
+    }
+    inline static type sub(const type a, const type b)
+    {
+        return _mm_sub_ps(a, b);
+    }
+    inline static type mul(const type a, const type b)
+    {
+        return _mm_mul_ps(a, b);
+    }
+    inline static type both(const type a, const type b)
+    {
+        return _mm_and_ps(a, b);
+    }
+    inline static type le(const type a, const type b)
+    {
+        return _mm_cmple_ps(a, b);
+    }
+    inline static type ge(const type a, const type b)
+    {
+        return _mm_cmpge_ps(a, b);
+    }
+    inline static int mask(const type a)
+    {
+        return _mm_movemask_ps(a);
+    }
+};
+class soa_lanes_double
+{
+  public:
+    typedef __m128d type;
+    inline static constexpr size_t size()
+    {
+        return 2;
+    }
+    inline static type load(const double *const p)
+    {
+        return _mm_loadu_pd(p);
+    }
+    inline static type set(const double a)
+    {
+        return _mm_set1_pd(a);
+    }
+    inline static type add(const type a, const type b)
+    {
+        return _mm_add_pd(a, b);
+    }
+    inline static type sub(const type a, const type b)
+    {
+        return _mm_sub_pd(a, b);
+    }
+    inline static type mul(const type a, const type b)
+    {
+        return _mm_mul_pd(a, b);
+    }
+    inline static type both(const type a, const type b)
+    {
+        return _mm_and_pd(a, b);
+    }
+    inline static type le(const type a, const type b)
+    {
+        return _mm_cmple_pd(a, b);
+    }
+    inline static type ge(const type a, const type b)
+    {
+        return _mm_cmpge_pd(a, b);
+    }
+    inline static int mask(const type a)
+    {
+        return _mm_movemask_pd(a);
+    }
+};
+#endif
+
+template <typename F>
+inline void soa_lanes_report(int mask, const size_t j, F &f)
+{
+    // Report each set lane in order
+    for (size_t l = j; mask; l++, mask >>= 1)
+    {
+        if (mask & 1)
+        {
+            f(l);
+        }
+    }
+}
+template <typename L, typename T, typename F>
+inline size_t soa_box_lanes(const T *const tile, const size_t n, const size_t axes, const size_t i, const size_t begin, F &f)
+{
+    // Test L::size() boxes at a time, return the first box not tested
+    size_t j = begin;
+    for (; j + L::size() <= n; j += L::size())
+    {
+        typename L::type hit = L::le(L::load(tile + j), L::set(tile[n + i]));
+        hit = L::both(hit, L::ge(L::load(tile + n + j), L::set(tile[i])));
+        for (size_t a = 1; a < axes; a++)
+        {
+            const T *const min = tile + 2 * a * n;
+            const T *const max = min + n;
+            hit = L::both(hit, L::le(L::load(min + j), L::set(max[i])));
+            hit = L::both(hit, L::ge(L::load(max + j), L::set(min[i])));
+        }
+        soa_lanes_report(L::mask(hit), j, f);
+    }
+
+    return j;
+}
+template <typename L, typename T, typename F>
+inline size_t soa_sphere_lanes(const T *const tile, const size_t n, const size_t axes, const size_t i, const size_t begin, F &f)
+{
+    // Test L::size() spheres at a time, return the first sphere not tested
+    const T *const radius = tile + axes * n;
+    size_t j = begin;
+    for (; j + L::size() <= n; j += L::size())
+    {
+        typename L::type d = L::sub(L::load(tile + j), L::set(tile[i]));
+        typename L::type d2 = L::mul(d, d);
+        for (size_t a = 1; a < axes; a++)
+        {
+            const T *const center = tile + a * n;
+            d = L::sub(L::load(center + j), L::set(center[i]));
+            d2 = L::add(d2, L::mul(d, d));
+        }
+        const typename L::type sum = L::add(L::load(radius + j), L::set(radius[i]));
+        soa_lanes_report(L::mask(L::le(d2, L::mul(sum, sum))), j, f);
+    }
+
+    return j;
+}
+template <typename F>
+inline size_t soa_box_simd(const float *const tile, const size_t n, const size_t axes, const size_t i, const size_t begin, F &f)
+{
+    return soa_box_lanes<soa_lanes_float>(tile, n, axes, i, begin, f);
+}
+template <typename F>
+inline size_t soa_box_simd(const double *const tile, const size_t n, const size_t axes, const size_t i, const size_t begin, F &f)
+{
+    return soa_box_lanes<soa_lanes_double>(tile, n, axes, i, begin, f);
+}
+template <typename F>
+inline size_t soa_sphere_simd(const float *const tile, const size_t n, const size_t axes, const size_t i, const size_t begin, F &f)
+{
+    return soa_sphere_lanes<soa_lanes_float>(tile, n, axes, i, begin, f);
+}
+template <typename F>
+inline size_t soa_sphere_simd(const double *const tile, const size_t n, const size_t axes, const size_t i, const size_t begin, F &f)
+{
+    return soa_sphere_lanes<soa_lanes_double>(tile, n, axes, i, begin, f);
+}
+
+// Fallback for types without lanes, nothing is tested
+template <typename T, typename F>
+inline size_t soa_box_simd(const T *const, const size_t, const size_t, const size_t, const size_t begin, F &)
+{
+    return begin;
+}
+template <typename T, typename F>
+inline size_t soa_sphere_simd(const T *const, const size_t, const size_t, const size_t, const size_t begin, F &)
+{
+    return begin;
+}
+#endif
+
+template <typename T, typename F>
+inline void soa_box_overlap(const T *const tile, const size_t n, const size_t axes, const size_t i, const size_t begin, F &f)
+{
+    // Boxes are stored as min and max arrays per axis
+    size_t j = begin;
+#ifdef MGL_SIMD_LANES
+    j = soa_box_simd(tile, n, axes, i, begin, f);
+#endif
+
+    // Test the remaining boxes one at a time
+    for (; j < n; j++)
+    {
+        bool hit = true;
+        for (size_t a = 0; a < axes && hit; a++)
+        {
+            const T *const min = tile + 2 * a * n;
+            const T *const max = min + n;
+            hit = min[j] <= max[i] && max[j] >= min[i];
+        }
+        if (hit)
+        {
+            f(j);
+        }
+    }
+}
+template <typename T, typename F>
+inline void soa_sphere_overlap(const T *const tile, const size_t n, const size_t axes, const size_t i, const size_t begin, F &f)
+{
+    // Spheres are stored as center arrays per axis followed by the radius array
+    size_t j = begin;
+#ifdef MGL_SIMD_LANES
+    j = soa_sphere_simd(tile, n, axes, i, begin, f);
+#endif
+
+    // Test the remaining spheres one at a time
+    const T *const radius = tile + axes * n;
+    for (; j < n; j++)
+    {
+        T d2 = 0;
+        for (size_t a = 0; a < axes; a++)
+        {
+            const T d = tile[a * n + j] - tile[a * n + i];
+            d2 += d * d;
+        }
+        const T sum = radius[j] + radius[i];
+        if (d2 <= sum * sum)
+        {
+            f(j);
+        }
+    }
+}
+
+// Shapes without a tile layout are tested with the scalar intersect functions
+// The oobbox bounds ignore rotation so it has no tile layout
+template <typename T, template <typename> class vec, template <typename, template <typename> class> class shape>
+class soa_tile : public std::false_type
+{
+  public:
+    inline static constexpr size_t stride()
+    {
+        return 0;
+    }
+};
+template <typename T, template <typename> class vec>
+class soa_tile<T, vec, aabbox> : public std::true_type
+{
+  public:
+    inline static constexpr size_t stride()
+    {
+        return 2 * vec<T>::soa_size();
+    }
+    inline static void store(T *const tile, const size_t n, const size_t i, const aabbox<T, vec> &box)
+    {
+        // Interleave the min and max arrays of each axis
+        T lower[vec<T>::soa_size()];
+        T upper[vec<T>::soa_size()];
+        box.get_min().soa_store(lower, 1);
+        box.get_max().soa_store(upper, 1);
+        for (size_t a = 0; a < vec<T>::soa_size(); a++)
+        {
+            tile[2 * a * n + i] = lower[a];
+            tile[(2 * a + 1) * n + i] = upper[a];
+        }
+    }
+    template <typename F>
+    inline static void overlap(const T *const tile, const size_t n, const size_t i, const size_t begin, F &f)
+    {
+        soa_box_overlap(tile, n, vec<T>::soa_size(), i, begin, f);
+    }
+};
+template <typename T, template <typename> class vec>
+class soa_tile<T, vec, sphere> : public std::true_type
+{
+  public:
+    inline static constexpr size_t stride()
+    {
+        return vec<T>::soa_size() + 1;
+    }
+    inline static void store(T *const tile, const size_t n, const size_t i, const sphere<T, vec> &s)
+    {
+        // Center arrays per axis followed by the radius array
+        s.get_center().soa_store(tile + i, n);
+        tile[vec<T>::soa_size() * n + i] = s.get_radius();
+    }
+    template <typename F>
+    inline static void overlap(const T *const tile, const size_t n, const size_t i, const size_t begin, F &f)
+    {
+        soa_sphere_overlap(tile, n, vec<T>::soa_size(), i, begin, f);
+    }
+};
+}
+
+#endif
@@ -259,6 +259,15 @@ class vec2
         // Return the grid index key for accessing cell
         return col * scale + row;
     }
+    inline static size_t grid_owner(const size_t a, const size_t b, const size_t scale)
+    {
+        // Lowest cell shared by two overlapping cell ranges, given the lowest cell key of each range
+        const min::bi<size_t> ia = grid_index(a, scale);
+        const min::bi<size_t> ib = grid_index(b, scale);
+
+        // Take the max row / col of both ranges
+        return grid_key(min::bi<size_t>(std::max(ia.x(), ib.x()), std::max(ia.y(), ib.y())), scale);
+    }
     inline static constexpr size_t over_size()
     {
         return 9;
@@ -448,6 +457,11 @@ class vec2
         // Return the grid index key for accessing cell
         return col * scale + row;
     }
+    inline static T grid_ray_exit(const std::tuple<T, T, T, T, int_fast8_t, int_fast8_t> &grid_ray)
+    {
+        // Distance along the ray to the exit of the current cell
+        return std::min(std::get<0>(grid_ray), std::get<2>(grid_ray));
+    }
     template <typename F>
     inline static void grid_range(const vec2<T> &min, const vec2<T> &extent, const size_t scale,
                                   const vec2<T> &over_min, const vec2<T> &over_max,
@@ -471,6 +485,14 @@ class vec2
             }
         }
     }
+    inline static void grow_box(vec2<T> &min, vec2<T> &max, const vec2<T> &b_min, const vec2<T> &b_max)
+    {
+        // Grow the min and max vector range to hold the box range
+        min._x = std::min(min._x, b_min._x);
+        min._y = std::min(min._y, b_min._y);
+        max._x = std::max(max._x, b_max._x);
+        max._y = std::max(max._y, b_max._y);
+    }
     inline bool inside(const vec2<T> &min, const vec2<T> &max) const
     {
         // Return true if this vector is inside the min and max vector range
@@ -484,6 +506,12 @@ class vec2
         // return inverse
         return vec2<T>(x, y);
     }
+    inline static vec2<T> lowest()
+    {
+        // Vector with every component at the lowest finite value
+        const T lowest = std::numeric_limits<T>::lowest();
+        return vec2<T>(lowest, lowest);
+    }
     inline static vec2<T> lerp(const vec2<T> &v0, const vec2<T> &v1, T t)
     {
         return (v0 + (v1 - v0) * (t));
@@ -914,6 +942,50 @@ class vec2
 
         return key;
     }
+    inline static constexpr size_t soa_size()
+    {
+        return 2;
+    }
+    inline void soa_store(T *const out, const size_t stride) const
+    {
+        // Store each axis in its own array, stride elements apart
+        out[0] = _x;
+        out[stride] = _y;
+    }
+    inline static constexpr size_t morton_width()
+    {
+        return 2;
+    }
+    inline static size_t morton_key(const vec2<T> &min, const vec2<T> &extent, const size_t scale, const vec2<T> &point)
+    {
+        // Calculate the cell location, clamped into the grid
+        const min::bi<size_t> index = grid_index(min, extent, point);
+        const size_t col = std::min(index.x(), scale - 1);
+        const size_t row = std::min(index.y(), scale - 1);
+
+        // Interleave the bits of each axis from the top, x is the most significant like subdivide_key
+        size_t key = 0;
+        for (size_t bit = scale >> 1; bit > 0; bit >>= 1)
+        {
+            key = (key << 2) | ((col & bit) ? 0x2 : 0x0) | ((row & bit) ? 0x1 : 0x0);
+        }
+
+        return key;
+    }
+    inline static vec2<T> morton_min(const vec2<T> &min, const vec2<T> &extent, size_t key)
+    {
+        // Split the interleaved bits back into the cell location
+        size_t col = 0;
+        size_t row = 0;
+        for (size_t bit = 1; key > 0; bit <<= 1, key >>= 2)
+        {
+            col |= (key & 0x2) ? bit : 0x0;
+            row |= (key & 0x1) ? bit : 0x0;
+        }
+
+        // Return the minimum corner of the cell
+        return vec2<T>(min.x() + col * extent.x(), min.y() + row * extent.y());
+    }
     inline static constexpr size_t sub_size()
     {
         return 4;
@@ -1225,6 +1297,20 @@ class vec2
 
         return out;
     }
+    inline static vec2<T> subdivide_lower(const vec2<T> &lower, const vec2<T> &center, const uint_fast8_t sub)
+    {
+        // Raise the lower bound to the center on each axis where sub cell 'sub' is in the upper half
+        const T x = (sub & 0x2) ? std::max(lower.x(), center.x()) : lower.x();
+        const T y = (sub & 0x1) ? std::max(lower.y(), center.y()) : lower.y();
+
+        return vec2<T>(x, y);
+    }
+    inline static bool subdivide_owner(const vec2<T> &a_min, const vec2<T> &b_min, const vec2<T> &lower)
+    {
+        // True if the max of both min corners is above the lower bound on every axis
+        // Only one of the sub cells holding both shapes passes this test
+        return (a_min.x() > lower.x() || b_min.x() > lower.x()) && (a_min.y() > lower.y() || b_min.y() > lower.y());
+    }
     inline static auto subdivide_overlap(const vec2<T> &min, const vec2<T> &max, const vec2<T> &center)
     {
         min::stack_vector<uint_fast8_t, vec2<T>::sub_size()> out;
@@ -307,6 +307,15 @@ class vec3
         // Return the grid index key for accessing cell
         return col * scale * scale + row * scale + zin;
     }
+    inline static size_t grid_owner(const size_t a, const size_t b, const size_t scale)
+    {
+        // Lowest cell shared by two overlapping cell ranges, given the lowest cell key of each range
+        const min::tri<size_t> ia = grid_index(a, scale);
+        const min::tri<size_t> ib = grid_index(b, scale);
+
+        // Take the max row / col of both ranges
+        return grid_key(min::tri<size_t>(std::max(ia.x(), ib.x()), std::max(ia.y(), ib.y()), std::max(ia.z(), ib.z())), scale);
+    }
     inline static constexpr size_t over_size()
     {
         return 27;
@@ -619,6 +628,11 @@ class vec3
         // Return the grid index key for accessing cell
         return col * scale * scale + row * scale + zin;
     }
+    inline static T grid_ray_exit(const std::tuple<T, T, T, T, T, T, int_fast8_t, int_fast8_t, int_fast8_t> &grid_ray)
+    {
+        // Distance along the ray to the exit of the current cell
+        return std::min(std::min(std::get<0>(grid_ray), std::get<2>(grid_ray)), std::get<4>(grid_ray));
+    }
     template <typename F>
     inline static void grid_range(const vec3<T> &min, const vec3<T> &extent, const size_t scale,
                                   const vec3<T> &over_min, const vec3<T> &over_max,
@@ -672,6 +686,16 @@ class vec3
 
         return std::make_pair(vec3<T>(), vec3<T>());
     }
+    inline static void grow_box(vec3<T> &min, vec3<T> &max, const vec3<T> &b_min, const vec3<T> &b_max)
+    {
+        // Grow the min and max vector range to hold the box range
+        min._x = std::min(min._x, b_min._x);
+        min._y = std::min(min._y, b_min._y);
+        min._z = std::min(min._z, b_min._z);
+        max._x = std::max(max._x, b_max._x);
+        max._y = std::max(max._y, b_max._y);
+        max._z = std::max(max._z, b_max._z);
+    }
     inline bool inside(const vec3<T> &min, const vec3<T> &max) const
     {
         // Return true if this vector is inside the min and max vector range
@@ -686,6 +710,12 @@ class vec3
         // return inverse
         return vec3<T>(x, y, z);
     }
+    inline static vec3<T> lowest()
+    {
+        // Vector with every component at the lowest finite value
+        const T lowest = std::numeric_limits<T>::lowest();
+        return vec3<T>(lowest, lowest, lowest);
+    }
     inline static vec3<T> lerp(const vec3<T> &v0, const vec3<T> &v1, T t)
     {
         return (v0 + (v1 - v0) * (t));
@@ -1364,6 +1394,54 @@ class vec3
 
         return key;
     }
+    inline static constexpr size_t soa_size()
+    {
+        return 3;
+    }
+    inline void soa_store(T *const out, const size_t stride) const
+    {
+        // Store each axis in its own array, stride elements apart
+        out[0] = _x;
+        out[stride] = _y;
+        out[2 * stride] = _z;
+    }
+    inline static constexpr size_t morton_width()
+    {
+        return 3;
+    }
+    inline static size_t morton_key(const vec3<T> &min, const vec3<T> &extent, const size_t scale, const vec3<T> &point)
+    {
+        // Calculate the cell location, clamped into the grid
+        const min::tri<size_t> index = grid_index(min, extent, point);
+        const size_t col = std::min(index.x(), scale - 1);
+        const size_t row = std::min(index.y(), scale - 1);
+        const size_t zin = std::min(index.z(), scale - 1);
+
+        // Interleave the bits of each axis from the top, x is the most significant like subdivide_key
+        size_t key = 0;
+        for (size_t bit = scale >> 1; bit > 0; bit >>= 1)
+        {
+            key = (key << 3) | ((col & bit) ? 0x4 : 0x0) | ((row & bit) ? 0x2 : 0x0) | ((zin & bit) ? 0x1 : 0x0);
+        }
+
+        return key;
+    }
+    inline static vec3<T> morton_min(const vec3<T> &min, const vec3<T> &extent, size_t key)
+    {
+        // Split the interleaved bits back into the cell location
+        size_t col = 0;
+        size_t row = 0;
+        size_t zin = 0;
+        for (size_t bit = 1; key > 0; bit <<= 1, key >>= 3)
+        {
+            col |= (key & 0x4) ? bit : 0x0;
+            row |= (key & 0x2) ? bit : 0x0;
+            zin |= (key & 0x1) ? bit : 0x0;
+        }
+
+        // Return the minimum corner of the cell
+        return vec3<T>(min.x() + col * extent.x(), min.y() + row * extent.y(), min.z() + zin * extent.z());
+    }
     inline static constexpr size_t sub_size()
     {
         return 8;
@@ -2301,6 +2379,21 @@ class vec3
 
         return out;
     }
+    inline static vec3<T> subdivide_lower(const vec3<T> &lower, const vec3<T> &center, const uint_fast8_t sub)
+    {
+        // Raise the lower bound to the center on each axis where sub cell 'sub' is in the upper half
+        const T x = (sub & 0x4) ? std::max(lower.x(), center.x()) : lower.x();
+        const T y = (sub & 0x2) ? std::max(lower.y(), center.y()) : lower.y();
+        const T z = (sub & 0x1) ? std::max(lower.z(), center.z()) : lower.z();
+
+        return vec3<T>(x, y, z);
+    }
+    inline static bool subdivide_owner(const vec3<T> &a_min, const vec3<T> &b_min, const vec3<T> &lower)
+    {
+        // True if the max of both min corners is above the lower bound on every axis
+        // Only one of the sub cells holding both shapes passes this test
+        return (a_min.x() > lower.x() || b_min.x() > lower.x()) && (a_min.y() > lower.y() || b_min.y() > lower.y()) && (a_min.z() > lower.z() || b_min.z() > lower.z());
+    }
     inline static auto subdivide_overlap(const vec3<T> &min, const vec3<T> &max, const vec3<T> &center)
     {
         min::stack_vector<uint_fast8_t, vec3<T>::sub_size()> out;
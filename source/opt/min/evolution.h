@@ -51,31 +51,31 @@ class evolution
     T _top_score;
     unsigned _year;
 
-    inline void average_fitness_score()
+    inline void average_fitness_score(min::thread_pool &pool)
     {
         // Initialize statistical variables
         _average_top = 0.0;
-        _average_fitness = 0.0;
 
         // Calculate sum of scores per species
-        for (size_t i = 0; i < _species; i++)
-        {
+        const auto species_sum = [this](std::mt19937 &gen, const size_t i) -> T {
             // Zero out the average
-            _ave[i] = 0.0;
+            this->_ave[i] = 0.0;
 
             // Calculate species sum
             for (size_t j = 0; j < _species_size; j++)
             {
-                _ave[i] += _scores[i][j];
+                this->_ave[i] += this->_scores[i][j];
             }
-        }
+
+            return this->_ave[i];
+        };
+
+        // Calculate total score in parallel
+        _average_fitness = pool.parallel_reduce(species_sum, [](const T a, const T b) { return a + b; }, static_cast<T>(0.0), 0, _species);
 
         // Calculate average score per species
         for (size_t i = 0; i < _species; i++)
         {
-            // Calculate total average
-            _average_fitness += _ave[i];
-
             // Normalize species average
             _ave[i] *= _inv_species_size;
         }
@@ -150,7 +150,7 @@ class evolution
     inline void evolve_pool(min::thread_pool &pool)
     {
         // Create index vector to sort 0 to N
-        average_fitness_score();
+        average_fitness_score(pool);
 
         // Evolve the gene pool
         const auto evolve = [this](std::mt19937 &gen, const size_t i) {
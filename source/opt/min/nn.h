@@ -59,15 +59,18 @@ class net_rng
             const std::uniform_real_distribution<T> &ran_dist,
             const std::uniform_int_distribution<unsigned> &int_dist)
         : _mut_dist(mut_dist), _ran_dist(ran_dist), _int_dist(int_dist) {}
-    inline T mutation(std::mt19937 &gen)
+    template <typename G>
+    inline T mutation(G &gen)
     {
         return _mut_dist(gen);
     }
-    inline T random(std::mt19937 &gen)
+    template <typename G>
+    inline T random(G &gen)
     {
         return _ran_dist(gen);
     }
-    inline unsigned random_int(std::mt19937 &gen)
+    template <typename G>
+    inline unsigned random_int(G &gen)
     {
         return _int_dist(gen);
     }
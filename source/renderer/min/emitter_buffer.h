@@ -17,6 +17,7 @@ limitations under the License.
 
 #include <cmath>
 #include <min/gl_type.h>
+#include <min/philox.h>
 #include <min/vec3.h>
 #include <min/window.h>
 #include <random>
@@ -60,11 +61,13 @@ class emitter_buffer
     vec3<T> _start_speed;
     vec3<T> _wind_force;
     std::uniform_real_distribution<T> _dist;
+    std::vector<T> _rand;
     std::vector<vec3<T>> _position;
     std::vector<vec3<T>> _speed;
     std::vector<std::pair<vec3<T>, T>> _attractors;
 
-    inline void accumulate(std::mt19937 &rand, const T dt)
+    template <typename G>
+    inline void accumulate(G &rand, const T dt)
     {
         _emit_accum += dt;
 
@@ -138,8 +141,29 @@ class emitter_buffer
         // Compute the force from Newton's 2nd Law
         return attract + _grav_force + _wind_force;
     }
-    inline void seed(std::mt19937 &rand, const size_t start, const size_t len)
+    template <typename G>
+    inline void generate(G &rand, const size_t n)
     {
+        // Draw random numbers one at a time
+        _rand.resize(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            _rand[i] = _dist(rand);
+        }
+    }
+    inline void generate(philox &rand, const size_t n)
+    {
+        // Counter based generators fill the whole batch at once
+        _rand.resize(n);
+        rand.uniform(_rand.data(), n, _dist.a(), _dist.b());
+    }
+    template <typename G>
+    inline void seed(G &rand, const size_t start, const size_t len)
+    {
+        // Draw three speed components per particle, plus one interpolant per particle if attracted
+        const size_t attrs = _attractors.size();
+        generate(rand, (attrs > 0) ? len * 4 : len * 3);
+
         // Reset all particles to the start position
         const size_t size = start + len;
         for (size_t i = start; i < size; i++)
@@ -148,16 +172,17 @@ class emitter_buffer
             _position[i] = _start_pos;
 
             // Set speed
-            _speed[i] = _start_speed + random(rand);
+            const size_t r = (i - start) * 3;
+            _speed[i] = _start_speed + vec3<T>(_rand[r], _rand[r + 1], _rand[r + 2]);
         }
 
-        const size_t attrs = _attractors.size();
         if (attrs > 0)
         {
+            const size_t offset = len * 3;
             for (size_t i = start; i < size; i++)
             {
                 const size_t group = i % attrs;
-                const T rand_interp = _dist(rand) / _random;
+                const T rand_interp = _rand[offset + (i - start)] / _random;
                 _position[i] = _start_pos + (_attractors[group].first - _start_pos) * rand_interp;
             }
         }
@@ -263,12 +288,14 @@ class emitter_buffer
     {
         return _start_pos;
     }
-    inline void initialize(std::mt19937 &rand)
+    template <typename G>
+    inline void initialize(G &rand)
     {
         // Initialize the simulation
         seed(rand, 0, _position.size());
     }
-    inline vec3<T> random(std::mt19937 &rand)
+    template <typename G>
+    inline vec3<T> random(G &rand)
     {
         // Compute a random speed modifier for dispersion of particles
         const T randx = _dist(rand);
@@ -278,7 +305,8 @@ class emitter_buffer
         // Calculate random speed
         return vec3<T>(randx, randy, randz);
     }
-    inline void reset(std::mt19937 &rand)
+    template <typename G>
+    inline void reset(G &rand)
     {
         // Initialize the simulation
         initialize(rand);
@@ -327,7 +355,8 @@ class emitter_buffer
     {
         _wind_force = wind;
     }
-    inline void step(std::mt19937 &rand, const T dt)
+    template <typename G>
+    inline void step(G &rand, const T dt)
     {
         // Accumulate this time step
         accumulate(rand, dt);
@@ -352,8 +381,8 @@ class emitter_buffer
             position += speed * dt;
         }
     }
-    template <typename F>
-    inline void set(std::mt19937 &rand, const F &f, const T dt)
+    template <typename G, typename F>
+    inline void set(G &rand, const F &f, const T dt)
     {
         // Accumulate this time step
         accumulate(rand, dt);
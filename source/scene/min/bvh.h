@@ -0,0 +1,884 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_BVH_MGL_
+#define _MGL_BVH_MGL_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <min/intersect.h>
+#include <min/ray.h>
+#include <min/utility.h>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The shape class must fulfill the following interface to be inserted into the spatial structure
+// shape.get_center()
+// shape.get_min()
+// shape.get_max()
+// intersect(shape, shape)
+
+// A bounding volume hierarchy built with the binned surface area heuristic on the widest center axis
+// Nodes are stored in depth first order with a skip index past their subtree, so every traversal is a loop without a stack
+// Each shape is stored once, node bounds adapt to the shapes instead of subdividing space
+// Moving shapes refit the node bounds in place and only rebuild when the node area grows past a ratio of the built area
+
+// Forward declaration for bvh_node
+namespace min
+{
+template <typename T, typename K, typename L, template <typename> class vec, template <typename, template <typename> class> class cell, template <typename, template <typename> class> class shape>
+class bvh;
+}
+
+namespace min
+{
+
+template <typename T, typename K, typename L, template <typename> class vec, template <typename, template <typename> class> class cell, template <typename, template <typename> class> class shape>
+class bvh_node
+{
+    friend class bvh<T, K, L, vec, cell, shape>;
+
+  private:
+    vec<T> _min;
+    vec<T> _max;
+    K _begin;
+    K _end;
+    L _skip;
+
+    inline void set_skip(const L skip)
+    {
+        _skip = skip;
+    }
+
+  public:
+    bvh_node(const vec<T> &min, const vec<T> &max, const K begin, const K end)
+        : _min(min), _max(max), _begin(begin), _end(end), _skip(0) {}
+    inline K get_begin() const
+    {
+        return _begin;
+    }
+    inline K get_end() const
+    {
+        return _end;
+    }
+    inline const vec<T> &get_max() const
+    {
+        return _max;
+    }
+    inline const vec<T> &get_min() const
+    {
+        return _min;
+    }
+    inline L get_skip() const
+    {
+        return _skip;
+    }
+    inline bool overlap(const vec<T> &min, const vec<T> &max) const
+    {
+        return _min <= max && _max >= min;
+    }
+};
+
+template <typename T, typename K, typename L, template <typename> class vec, template <typename, template <typename> class> class cell, template <typename, template <typename> class> class shape>
+class bvh
+{
+  private:
+    static constexpr size_t _bins = 16;
+    static constexpr size_t _min_leaf = 4;
+    static constexpr size_t _max_leaf = 8;
+    static constexpr size_t _max_sah_depth = 64;
+    static constexpr T _max_refit_growth = 1.5;
+    std::vector<shape<T, vec>> _shapes;
+    std::vector<K> _index_map;
+    std::vector<K> _keys;
+    std::vector<vec<T>> _min_cache;
+    std::vector<vec<T>> _max_cache;
+    std::vector<T> _axis_cache;
+    std::vector<bvh_node<T, K, L, vec, cell, shape>> _nodes;
+    mutable std::vector<std::pair<K, K>> _hits;
+    mutable std::vector<std::pair<K, vec<T>>> _ray_hits;
+    mutable std::vector<K> _point_keys;
+    cell<T, vec> _root;
+    vec<T> _lower_bound;
+    vec<T> _upper_bound;
+    T _build_cost;
+    K _depth;
+    bool _sorted;
+
+    inline static T area(const vec<T> &min, const vec<T> &max)
+    {
+        // Surface area of a box up to a constant, the perimeter in 2D
+        T e[vec<T>::soa_size()];
+        (max - min).soa_store(e, 1);
+        if (vec<T>::soa_size() == 2)
+        {
+            return e[0] + e[1];
+        }
+
+        return e[0] * e[1] + e[1] * e[2] + e[2] * e[0];
+    }
+    inline T cost() const
+    {
+        // Total node area relative to the root area, tracks the quality of the hierarchy as shapes move
+        T total = 0.0;
+        for (const auto &node : _nodes)
+        {
+            total += area(node.get_min(), node.get_max());
+        }
+        const T root = area(_nodes[0].get_min(), _nodes[0].get_max());
+
+        return (root > 0.0) ? total / root : 0.0;
+    }
+    inline bool is_leaf(const L i) const
+    {
+        // A leaf skips to the next node
+        return _nodes[i].get_skip() == i + 1;
+    }
+    template <typename F>
+    inline K partition(K begin, K end, const F &left)
+    {
+        // Move every position where left(i) is true to the front, swapping the keys and caches together
+        const size_t size = _keys.size();
+        while (true)
+        {
+            while (begin < end && left(begin))
+            {
+                begin++;
+            }
+            while (begin < end && !left(end - 1))
+            {
+                end--;
+            }
+            if (begin == end)
+            {
+                return begin;
+            }
+
+            // Swap the first right with the last left
+            end--;
+            std::swap(_keys[begin], _keys[end]);
+            std::swap(_min_cache[begin], _min_cache[end]);
+            std::swap(_max_cache[begin], _max_cache[end]);
+            for (size_t a = 0; a < vec<T>::soa_size(); a++)
+            {
+                std::swap(_axis_cache[a * size + begin], _axis_cache[a * size + end]);
+            }
+            begin++;
+        }
+    }
+    inline bool split_middle(const K begin, const K end, const vec<T> &c_min, const vec<T> &c_max, K &mid)
+    {
+        // Find the widest center axis
+        T lower[vec<T>::soa_size()];
+        T e[vec<T>::soa_size()];
+        c_min.soa_store(lower, 1);
+        (c_max - c_min).soa_store(e, 1);
+        const size_t axis = std::max_element(e, e + vec<T>::soa_size()) - e;
+
+        // Split the shapes at the middle of the axis
+        const T *const centers = &_axis_cache[axis * _keys.size()];
+        const T middle = lower[axis] + e[axis] * 0.5;
+        mid = partition(begin, end, [centers, middle](const K i) {
+            return centers[i] < middle;
+        });
+
+        // Both sides must hold shapes
+        return mid != begin && mid != end;
+    }
+    inline bool split_sah(const K begin, const K end, const vec<T> &min, const vec<T> &max, const vec<T> &c_min, const vec<T> &c_max, K &mid)
+    {
+        // Center range of each axis
+        constexpr size_t dims = vec<T>::soa_size();
+        T lower[dims];
+        T extent[dims];
+        c_min.soa_store(lower, 1);
+        (c_max - c_min).soa_store(extent, 1);
+
+        // Only bin the widest center axis, binning every axis costs more to build than it saves in queries
+        const size_t axis = std::max_element(extent, extent + dims) - extent;
+        if (!(extent[axis] > 0.0))
+        {
+            return false;
+        }
+
+        // Bin the shapes by center, the caches are in build order
+        const size_t count = end - begin;
+        const size_t bins = (count < _bins) ? count : _bins;
+        size_t counts[_bins] = {};
+        vec<T> b_min[_bins];
+        vec<T> b_max[_bins];
+        const T *const centers = &_axis_cache[axis * _keys.size()];
+        const T low = lower[axis];
+        const T scale = bins / extent[axis];
+        const auto bin = [centers, low, scale, bins](const K i) {
+            return std::min(static_cast<size_t>((centers[i] - low) * scale), bins - 1);
+        };
+        for (K i = begin; i < end; i++)
+        {
+            const size_t b = bin(i);
+            if (counts[b]++ == 0)
+            {
+                b_min[b] = _min_cache[i];
+                b_max[b] = _max_cache[i];
+            }
+            else
+            {
+                vec<T>::grow_box(b_min[b], b_max[b], _min_cache[i], _max_cache[i]);
+            }
+        }
+
+        // Sweep from the right to get the area of every right side
+        T right_area[_bins];
+        size_t right_count[_bins];
+        vec<T> r_min;
+        vec<T> r_max;
+        size_t total = 0;
+        for (size_t b = bins; b-- > 1;)
+        {
+            if (counts[b] > 0)
+            {
+                if (total == 0)
+                {
+                    r_min = b_min[b];
+                    r_max = b_max[b];
+                }
+                else
+                {
+                    vec<T>::grow_box(r_min, r_max, b_min[b], b_max[b]);
+                }
+                total += counts[b];
+            }
+            right_area[b] = (total > 0) ? area(r_min, r_max) : 0.0;
+            right_count[b] = total;
+        }
+
+        // A leaf costs one intersection per shape, a split costs one extra traversal
+        // Both costs are scaled by the node area to avoid dividing by a flat node
+        const T parent = area(min, max);
+        T best = (count > _max_leaf) ? std::numeric_limits<T>::max() : parent * count;
+        size_t best_bin = 0;
+
+        // Sweep from the left, splitting before bin b
+        vec<T> l_min;
+        vec<T> l_max;
+        total = 0;
+        for (size_t b = 1; b < bins; b++)
+        {
+            const size_t prev = b - 1;
+            if (counts[prev] > 0)
+            {
+                if (total == 0)
+                {
+                    l_min = b_min[prev];
+                    l_max = b_max[prev];
+                }
+                else
+                {
+                    vec<T>::grow_box(l_min, l_max, b_min[prev], b_max[prev]);
+                }
+                total += counts[prev];
+            }
+
+            // Both sides must hold shapes
+            if (total == 0 || right_count[b] == 0)
+            {
+                continue;
+            }
+
+            // Keep the cheapest split
+            const T cost = parent + area(l_min, l_max) * total + right_area[b] * right_count[b];
+            if (cost < best)
+            {
+                best = cost;
+                best_bin = b;
+            }
+        }
+
+        // A leaf is cheaper
+        if (best_bin == 0)
+        {
+            return false;
+        }
+
+        // Partition the shapes on the split bin
+        mid = partition(begin, end, [&bin, best_bin](const K i) {
+            return bin(i) < best_bin;
+        });
+
+        return true;
+    }
+    inline void build(const K begin, const K end, const K depth)
+    {
+        // Get the bounds of the shapes and their centers
+        vec<T> min = _min_cache[begin];
+        vec<T> max = _max_cache[begin];
+        vec<T> c_min = (min + max) * 0.5;
+        vec<T> c_max = c_min;
+        for (K i = begin + 1; i < end; i++)
+        {
+            const vec<T> c = (_min_cache[i] + _max_cache[i]) * 0.5;
+            vec<T>::grow_box(min, max, _min_cache[i], _max_cache[i]);
+            vec<T>::grow_box(c_min, c_max, c, c);
+        }
+
+        // Add the node in depth first order
+        const L index = _nodes.size();
+        _nodes.emplace_back(min, max, begin, end);
+        _depth = std::max(_depth, depth);
+
+        // Small nodes are leaves, else split with the surface area heuristic
+        // Past the depth limit split at the middle of the centers to bound the depth
+        K mid;
+        const size_t count = end - begin;
+        bool split = false;
+        if (count > _min_leaf)
+        {
+            split = (depth < _max_sah_depth) ? split_sah(begin, end, min, max, c_min, c_max, mid) : split_middle(begin, end, c_min, c_max, mid);
+        }
+
+        // All centers are equal, split in half to keep leaves small
+        if (!split && count > _max_leaf)
+        {
+            mid = begin + count / 2;
+            split = true;
+        }
+
+        // Build the children
+        if (split)
+        {
+            build(begin, mid, depth + 1);
+            build(mid, end, depth + 1);
+        }
+
+        // Skip past the subtree of this node
+        _nodes[index].set_skip(_nodes.size());
+    }
+    inline void build_nodes(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Cache the bounds of every shape and each axis of its center, the caches are reordered with the keys
+        const size_t size = shapes.size();
+        _min_cache.resize(size);
+        _max_cache.resize(size);
+        _axis_cache.resize(size * vec<T>::soa_size());
+        for (size_t i = 0; i < size; i++)
+        {
+            _min_cache[i] = shapes[i].get_min();
+            _max_cache[i] = shapes[i].get_max();
+            const vec<T> c = (_min_cache[i] + _max_cache[i]) * 0.5;
+            c.soa_store(&_axis_cache[i], size);
+        }
+
+        // Build the hierarchy from all shapes
+        _keys.resize(size);
+        std::iota(_keys.begin(), _keys.end(), 0);
+        _nodes.clear();
+        _nodes.reserve(2 * size);
+        _depth = 0;
+        build(0, static_cast<K>(size), 0);
+
+        // Store the cost of the fresh hierarchy to compare refits against
+        _build_cost = cost();
+    }
+    inline void sort(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Build the hierarchy
+        build_nodes(shapes);
+
+        // Store the shapes in leaf order, the index map converts keys back to insertion order
+        const size_t size = shapes.size();
+        _index_map.resize(size);
+        _shapes.clear();
+        _shapes.reserve(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            _index_map[i] = _keys[i];
+            _shapes.emplace_back(shapes[_keys[i]]);
+            _keys[i] = static_cast<K>(i);
+        }
+        _sorted = true;
+    }
+    inline void no_sort(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Build the hierarchy, keys are insertion order
+        build_nodes(shapes);
+
+        // Insert shapes without sorting
+        _shapes.clear();
+        _shapes.reserve(shapes.size());
+        _shapes.insert(_shapes.end(), shapes.begin(), shapes.end());
+        _sorted = false;
+    }
+    template <typename F>
+    inline void get_overlap(const vec<T> &min, const vec<T> &max, F &f) const
+    {
+        // Skip every subtree the box misses
+        const L size = _nodes.size();
+        for (L i = 0; i < size;)
+        {
+            const bvh_node<T, K, L, vec, cell, shape> &node = _nodes[i];
+            if (!node.overlap(min, max))
+            {
+                i = node.get_skip();
+                continue;
+            }
+
+            // Call f(key) for every shape in the leaf with overlapping bounds
+            if (is_leaf(i))
+            {
+                const K end = node.get_end();
+                for (K j = node.get_begin(); j < end; j++)
+                {
+                    const K key = _keys[j];
+                    const shape<T, vec> &s = _shapes[key];
+                    if (s.get_min() <= max && s.get_max() >= min)
+                    {
+                        f(key);
+                    }
+                }
+            }
+
+            // Enter the subtree
+            i++;
+        }
+    }
+    template <typename F>
+    inline void get_leaf_pairs(const K p, const K begin, const K end, F &f) const
+    {
+        // Perform an intersection test of shape p against the shapes in the range
+        const K key = _keys[p];
+        for (K j = begin; j < end; j++)
+        {
+            // Prefer a < b
+            K a = key;
+            K b = _keys[j];
+            if (a > b)
+            {
+                a = b;
+                b = key;
+            }
+
+            // Get the two shapes
+            if (intersect(_shapes[a], _shapes[b]))
+            {
+                f(a, b);
+            }
+        }
+    }
+    template <typename F>
+    inline void get_pairs(F &f) const
+    {
+        // Walk the hierarchy once for every leaf, only visiting leaves at or after it in depth first order
+        // Each pair is seen once from the leaf that comes first
+        const L size = _nodes.size();
+        for (L l = 0; l < size; l++)
+        {
+            // Find the next leaf
+            if (!is_leaf(l))
+            {
+                continue;
+            }
+            const bvh_node<T, K, L, vec, cell, shape> &leaf = _nodes[l];
+            const K begin = leaf.get_begin();
+            const K end = leaf.get_end();
+
+            // Test the shapes in the leaf against each other
+            for (K p = begin; p < end; p++)
+            {
+                get_leaf_pairs(p, p + 1, end, f);
+            }
+
+            // Skip subtrees holding only earlier leaves or missing the leaf bounds
+            for (L i = 0; i < size;)
+            {
+                const bvh_node<T, K, L, vec, cell, shape> &node = _nodes[i];
+                if (node.get_end() <= end || !node.overlap(leaf.get_min(), leaf.get_max()))
+                {
+                    i = node.get_skip();
+                    continue;
+                }
+
+                // Test the shapes in the leaf that overlap the later leaf
+                if (is_leaf(i))
+                {
+                    for (K p = begin; p < end; p++)
+                    {
+                        if (node.overlap(_min_cache[p], _max_cache[p]))
+                        {
+                            get_leaf_pairs(p, node.get_begin(), node.get_end(), f);
+                        }
+                    }
+                }
+
+                // Enter the subtree
+                i++;
+            }
+        }
+    }
+    inline void get_closest_hit(const ray<T, vec> &r, T &best, bool &found, K &key, vec<T> &point) const
+    {
+        // Skip every subtree the ray misses or enters past the nearest hit
+        const L size = _nodes.size();
+        vec<T> p;
+        for (L i = 0; i < size;)
+        {
+            const bvh_node<T, K, L, vec, cell, shape> &node = _nodes[i];
+            T t;
+            if (!ray_entry(node.get_min(), node.get_max(), r, t) || t > best)
+            {
+                i = node.get_skip();
+                continue;
+            }
+
+            // Perform an N intersection test for all shapes in this leaf against the ray, keeping the nearest hit
+            if (is_leaf(i))
+            {
+                const K end = node.get_end();
+                for (K j = node.get_begin(); j < end; j++)
+                {
+                    const K k = _keys[j];
+                    if (intersect(_shapes[k], r, p))
+                    {
+                        // Distance along the ray to the hit
+                        const T d = (p - r.get_origin()).dot(r.get_direction());
+                        if (d <= best)
+                        {
+                            best = d;
+                            found = true;
+                            key = k;
+                            point = p;
+                        }
+                    }
+                }
+            }
+
+            // Enter the subtree
+            i++;
+        }
+    }
+    inline void get_ray_intersect(const ray<T, vec> &r) const
+    {
+        // Skip every subtree the ray misses
+        const L size = _nodes.size();
+        vec<T> p;
+        for (L i = 0; i < size;)
+        {
+            const bvh_node<T, K, L, vec, cell, shape> &node = _nodes[i];
+            T t;
+            if (!ray_entry(node.get_min(), node.get_max(), r, t))
+            {
+                i = node.get_skip();
+                continue;
+            }
+
+            // Perform an N intersection test for all shapes in this leaf against the ray
+            if (is_leaf(i))
+            {
+                const K end = node.get_end();
+                for (K j = node.get_begin(); j < end; j++)
+                {
+                    const K k = _keys[j];
+                    if (intersect(_shapes[k], r, p))
+                    {
+                        _ray_hits.emplace_back(k, p);
+                    }
+                }
+            }
+
+            // Enter the subtree
+            i++;
+        }
+    }
+
+  public:
+    bvh(const cell<T, vec> &c)
+        : _root(c),
+          _lower_bound(_root.get_min() + var<T>::TOL_PHYS_EDGE),
+          _upper_bound(_root.get_max() - var<T>::TOL_PHYS_EDGE),
+          _build_cost(0.0), _depth(0), _sorted(true) {}
+    inline void resize(const cell<T, vec> &c)
+    {
+        _root = c;
+        _lower_bound = _root.get_min() + var<T>::TOL_PHYS_EDGE;
+        _upper_bound = _root.get_max() - var<T>::TOL_PHYS_EDGE;
+    }
+    inline void check_size(const std::vector<shape<T, vec>> &shapes) const
+    {
+        // Check size of the number of objects to insert into the hierarchy
+        if (shapes.size() > std::numeric_limits<K>::max() - 1)
+        {
+            throw std::runtime_error("bvh(): too many objects to insert, max supported is " + std::to_string(std::numeric_limits<K>::max()));
+        }
+    }
+    inline vec<T> clamp_bounds(const vec<T> &point) const
+    {
+        return vec<T>(point).clamp(_lower_bound, _upper_bound);
+    }
+    template <typename F>
+    inline void for_each_collision(F &&f) const
+    {
+        // Call f(a, b) with a < b for every intersecting pair, each pair is reported once
+        get_pairs(f);
+    }
+    template <typename F>
+    inline void for_each_overlap(const shape<T, vec> &overlap, F &&f) const
+    {
+        // Call f(key) for every shape with bounds overlapping the shape
+        get_overlap(overlap.get_min(), overlap.get_max(), f);
+    }
+    inline const std::vector<std::pair<K, K>> &get_collisions() const
+    {
+        // Clear out the old collision vector
+        _hits.clear();
+        _hits.reserve(_shapes.size());
+
+        // get all intersecting pairs
+        for_each_collision([this](const K a, const K b) {
+            this->_hits.emplace_back(a, b);
+        });
+
+        // Return the list
+        return _hits;
+    }
+    inline const std::vector<std::pair<K, K>> &get_collisions(const vec<T> &point) const
+    {
+        // Clear out the old collision vector
+        _hits.clear();
+
+        // Perform an N^2-N intersection test for all shapes holding the point
+        const std::vector<K> &keys = point_inside(point);
+        const size_t size = keys.size();
+        for (size_t i = 0; i < size; i++)
+        {
+            for (size_t j = i + 1; j < size; j++)
+            {
+                // Prefer a < b
+                K a = keys[i];
+                K b = keys[j];
+                if (a > b)
+                {
+                    a = keys[j];
+                    b = keys[i];
+                }
+
+                // Get the two shapes
+                if (intersect(_shapes[a], _shapes[b]))
+                {
+                    _hits.emplace_back(a, b);
+                }
+            }
+        }
+
+        // Return the list
+        return _hits;
+    }
+    inline const std::vector<std::pair<K, vec<T>>> &get_collisions(const ray<T, vec> &r) const
+    {
+        // Output vector
+        _ray_hits.clear();
+
+        // Get every shape intersecting ray
+        get_ray_intersect(r);
+
+        // Return the collision list
+        return _ray_hits;
+    }
+    inline bool get_closest_hit(const ray<T, vec> &r, const T t_max, K &key, vec<T> &point) const
+    {
+        // Get the nearest shape intersecting ray, pruning subtrees past the nearest hit
+        T best = t_max;
+        bool found = false;
+        get_closest_hit(r, best, found, key, point);
+
+        return found;
+    }
+    inline K get_depth() const
+    {
+        return _depth;
+    }
+    inline const std::vector<K> &get_index_map() const
+    {
+        return _index_map;
+    }
+    inline const std::vector<bvh_node<T, K, L, vec, cell, shape>> &get_nodes() const
+    {
+        return _nodes;
+    }
+    inline const std::vector<std::pair<K, K>> &get_overlap(const shape<T, vec> &overlap) const
+    {
+        // Clear out the old collision vector
+        _hits.clear();
+
+        // Get the overlapping shapes
+        for_each_overlap(overlap, [this](const K key) {
+            this->_hits.emplace_back(key, 0);
+        });
+
+        // Return the list
+        return _hits;
+    }
+    inline const vec<T> &get_lower_bound() const
+    {
+        return _lower_bound;
+    }
+    inline const vec<T> &get_upper_bound() const
+    {
+        return _upper_bound;
+    }
+    inline K get_scale() const
+    {
+        // Most shapes in a leaf before the surface area heuristic may split it
+        return _max_leaf;
+    }
+    inline const std::vector<shape<T, vec>> &get_shapes()
+    {
+        return _shapes;
+    }
+    inline bool inside(const vec<T> &point) const
+    {
+        return _root.point_inside(point);
+    }
+    inline void insert(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Clear out the old hierarchy
+        _nodes.clear();
+        _keys.clear();
+
+        const size_t size = shapes.size();
+        if (size > 0)
+        {
+            // Build the hierarchy and sort shapes by leaf
+            sort(shapes);
+        }
+    }
+    inline void insert_no_sort(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Clear out the old hierarchy
+        _nodes.clear();
+        _keys.clear();
+
+        const size_t size = shapes.size();
+        if (size > 0)
+        {
+            // Build the hierarchy but do not sort shapes
+            no_sort(shapes);
+        }
+    }
+    inline void radius_query(const vec<T> &point, const T radius, std::vector<K> &out) const
+    {
+        // Output vector
+        out.clear();
+
+        // Get the shapes with centers inside the sphere
+        const T r2 = radius * radius;
+        const auto f = [this, &point, r2, &out](const K key) {
+            const vec<T> d = this->_shapes[key].get_center() - point;
+            if (d.dot(d) <= r2)
+            {
+                out.push_back(key);
+            }
+        };
+        get_overlap(point - radius, point + radius, f);
+    }
+    inline bool refit(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Rebuild if the number of shapes changed, returns true if the hierarchy was refit
+        const size_t size = shapes.size();
+        if (size == 0 || size != _shapes.size() || _nodes.size() == 0)
+        {
+            insert(shapes);
+            return false;
+        }
+
+        // Copy the new shapes into their slots, sorted slots map back to insertion order
+        for (size_t i = 0; i < size; i++)
+        {
+            _shapes[i] = shapes[_sorted ? _index_map[i] : i];
+        }
+
+        // Children come after their parent in depth first order, refit the node bounds bottom up
+        for (L i = _nodes.size(); i-- > 0;)
+        {
+            bvh_node<T, K, L, vec, cell, shape> &node = _nodes[i];
+            if (is_leaf(i))
+            {
+                // Refresh the cached shape bounds and fit the leaf around them
+                const K begin = node.get_begin();
+                const K end = node.get_end();
+                for (K p = begin; p < end; p++)
+                {
+                    const shape<T, vec> &s = _shapes[_keys[p]];
+                    _min_cache[p] = s.get_min();
+                    _max_cache[p] = s.get_max();
+                }
+                node._min = _min_cache[begin];
+                node._max = _max_cache[begin];
+                for (K p = begin + 1; p < end; p++)
+                {
+                    vec<T>::grow_box(node._min, node._max, _min_cache[p], _max_cache[p]);
+                }
+            }
+            else
+            {
+                // The left child follows the node and the right child follows the left subtree
+                const bvh_node<T, K, L, vec, cell, shape> &left = _nodes[i + 1];
+                const bvh_node<T, K, L, vec, cell, shape> &right = _nodes[left.get_skip()];
+                node._min = left.get_min();
+                node._max = left.get_max();
+                vec<T>::grow_box(node._min, node._max, right.get_min(), right.get_max());
+            }
+        }
+
+        // Rebuild if the refit nodes grew too much compared to the fresh hierarchy
+        if (cost() > _max_refit_growth * _build_cost)
+        {
+            if (_sorted)
+            {
+                insert(shapes);
+            }
+            else
+            {
+                insert_no_sort(shapes);
+            }
+
+            return false;
+        }
+
+        return true;
+    }
+    inline void update(const std::vector<shape<T, vec>> &shapes, const std::vector<K> &moved)
+    {
+        // Keep the topology and refit the node bounds, rebuilds when the hierarchy degrades
+        refit(shapes);
+    }
+    inline const std::vector<K> &point_inside(const vec<T> &point) const
+    {
+        // Output vector
+        _point_keys.clear();
+
+        // Get the keys of every shape with bounds holding the point
+        const vec<T> clamped = clamp_bounds(point);
+        const auto f = [this](const K key) {
+            this->_point_keys.push_back(key);
+        };
+        get_overlap(clamped, clamped, f);
+
+        return _point_keys;
+    }
+};
+}
+
+#endif
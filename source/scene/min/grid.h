@@ -17,14 +17,16 @@ limitations under the License.
 
 #include <algorithm>
 #include <cmath>
-#include <min/bit_flag.h>
 #include <min/intersect.h>
 #include <min/ray.h>
+#include <min/soa_tile.h>
 #include <min/sort.h>
+#include <min/thread_pool.h>
 #include <min/utility.h>
 #include <numeric>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 // The shape class must fulfill the following interface to be inserted into the spatial structure
@@ -50,24 +52,57 @@ class grid_node
     friend class grid<T, K, L, vec, cell, shape>;
 
   private:
-    std::vector<K> _keys;
+    size_t _offset;
+    size_t _capacity;
+    K _size;
     cell<T, vec> _cell;
-    inline void add_key(K key)
+    inline bool add_key(std::vector<K> &keys, const K key)
     {
-        _keys.push_back(key);
+        // Cell slice is full
+        if (_size == _capacity)
+        {
+            return false;
+        }
+
+        // Insert key keeping the slice in ascending order
+        const auto begin = keys.begin() + _offset;
+        const auto end = begin + _size;
+        const auto it = std::lower_bound(begin, end, key);
+        std::move_backward(it, end, end + 1);
+        *it = key;
+        _size++;
+
+        return true;
     }
     inline void clear()
     {
         // Clear out the cell data
-        _keys.clear();
+        _size = 0;
+    }
+    inline void remove_key(std::vector<K> &keys, const K key)
+    {
+        // Erase key keeping the slice in ascending order
+        const auto begin = keys.begin() + _offset;
+        const auto end = begin + _size;
+        const auto it = std::lower_bound(begin, end, key);
+        if (it != end && *it == key)
+        {
+            std::move(it + 1, end, it);
+            _size--;
+        }
+    }
+    inline static size_t slack(const size_t size)
+    {
+        // Spare room in each cell slice for incremental updates
+        return size / 4 + 1;
     }
 
   public:
-    grid_node(const vec<T> &min, const vec<T> &max) : _cell(min, max) {}
-    grid_node(const vec<T> &c, const T r) : _cell(c, r) {}
-    inline const std::vector<K> &get_keys() const
+    grid_node(const vec<T> &min, const vec<T> &max) : _offset(0), _capacity(0), _size(0), _cell(min, max) {}
+    grid_node(const vec<T> &c, const T r) : _offset(0), _capacity(0), _size(0), _cell(c, r) {}
+    inline size_t get_offset() const
     {
-        return _keys;
+        return _offset;
     }
     inline const cell<T, vec> &get_cell() const
     {
@@ -80,7 +115,7 @@ class grid_node
     }
     inline K size() const
     {
-        return _keys.size();
+        return _size;
     }
 };
 
@@ -90,25 +125,37 @@ class grid
   private:
     std::vector<shape<T, vec>> _shapes;
     std::vector<grid_node<T, K, L, vec, cell, shape>> _cells;
+    std::vector<K> _keys;
     std::vector<K> _index_map;
+    std::vector<K> _inverse_map;
     std::vector<size_t> _key_cache;
+    std::vector<size_t> _owner;
+    std::vector<size_t> _bins;
     std::vector<K> _sort_copy;
+    mutable std::vector<K> _point_keys;
+    mutable std::vector<T> _tile;
     mutable std::vector<std::pair<K, K>> _hits;
+    mutable std::vector<std::vector<std::pair<K, K>>> _block_hits;
+    mutable std::vector<std::vector<K>> _block_keys;
     mutable std::vector<std::pair<K, vec<T>>> _ray_hits;
-    mutable bit_flag<K, L> _flags;
+    mutable std::vector<std::pair<K, vec<T>>> _closest;
+    mutable std::vector<size_t> _ray_index;
+    mutable std::vector<size_t> _ray_copy;
+    mutable std::vector<size_t> _ray_keys;
     cell<T, vec> _root;
     vec<T> _cell_extent;
     vec<T> _lower_bound;
     vec<T> _upper_bound;
+    size_t _max_capacity;
     K _scale;
     K _cached_scale;
 
-    inline void build()
+    inline bool build_cells()
     {
         // Break out if scale is zero
         if (_scale == 0)
         {
-            return;
+            return false;
         }
 
         // Build grid if scale has been changed
@@ -130,8 +177,19 @@ class grid
             }
         }
 
-        // Calculate intersections of sub cell with list of shapes
+        return true;
+    }
+    inline void build()
+    {
+        // Create or reset the grid cells
+        if (!build_cells())
+        {
+            return;
+        }
+
+        // Count the keys in each cell from the intersections of sub cell with list of shapes
         const K size = _shapes.size();
+        _owner.resize(size);
         for (K i = 0; i < size; i++)
         {
             // Get the surrounding overlapping neighbor cells
@@ -141,54 +199,151 @@ class grid
             // All surrounding neighbors overlap
             for (auto &n : overlap)
             {
-                // Assign keys to cell
-                _cells[n].add_key(i);
+                _cells[n]._size++;
             }
+
+            // The first overlapping cell is the lowest corner of the cell range
+            _owner[i] = overlap[0];
         }
 
-        // Reset the flag size if size changes
-        if (size > _flags.col())
+        // Prefix sum the cell counts into offsets in the key array, leaving slack for updates
+        size_t offset = 0;
+        _max_capacity = 0;
+        for (auto &node : _cells)
         {
-            // Resize the flag buffer
-            _flags.resize(size, size);
+            node._offset = offset;
+            node._capacity = node._size + node.slack(node._size);
+            offset += node._capacity;
+            node._size = 0;
+            _max_capacity = std::max(_max_capacity, node._capacity);
         }
-        else
+        _keys.resize(offset);
+
+        // Fill the key array, keys in each cell stay in ascending order
+        for (K i = 0; i < size; i++)
+        {
+            // Get the surrounding overlapping neighbor cells
+            const auto &b = _shapes[i];
+            const auto overlap = vec<T>::grid_overlap(_root.get_min(), _cell_extent, _scale, b.get_min(), b.get_max());
+
+            // Assign keys to cell
+            for (auto &n : overlap)
+            {
+                grid_node<T, K, L, vec, cell, shape> &node = _cells[n];
+                _keys[node._offset + node._size++] = i;
+            }
+        }
+    }
+    inline void build(thread_pool &pool)
+    {
+        // Create or reset the grid cells
+        if (!build_cells())
+        {
+            return;
+        }
+
+        // Split the shapes into one block per thread
+        const K size = _shapes.size();
+        const size_t cells = _cells.size();
+        const size_t blocks = std::max(static_cast<size_t>(1), std::min(pool.get_thread_count(), static_cast<size_t>(size)));
+        _owner.resize(size);
+
+        // Each block counts its keys in each cell into its own histogram
+        _bins.assign(blocks * cells, 0);
+        const auto count = [this, size, cells, blocks](std::mt19937 &gen, const size_t b) {
+            const K begin = (b * size) / blocks;
+            const K end = ((b + 1) * size) / blocks;
+            size_t *const bins = this->_bins.data() + b * cells;
+            for (K i = begin; i < end; i++)
+            {
+                // Get the surrounding overlapping neighbor cells
+                const auto &s = this->_shapes[i];
+                const auto overlap = vec<T>::grid_overlap(this->_root.get_min(), this->_cell_extent, this->_scale, s.get_min(), s.get_max());
+                for (auto &n : overlap)
+                {
+                    bins[n]++;
+                }
+
+                // The first overlapping cell is the lowest corner of the cell range
+                this->_owner[i] = overlap[0];
+            }
+        };
+        pool.run(std::cref(count), 0, blocks);
+
+        // Prefix sum the histograms, cell major then block order, into each block's write cursor
+        size_t offset = 0;
+        _max_capacity = 0;
+        for (size_t n = 0; n < cells; n++)
         {
-            // Clear the flag buffer
-            _flags.clear();
+            grid_node<T, K, L, vec, cell, shape> &node = _cells[n];
+            node._offset = offset;
+            for (size_t b = 0; b < blocks; b++)
+            {
+                size_t &bin = _bins[b * cells + n];
+                const size_t c = bin;
+                bin = offset;
+                offset += c;
+            }
+            node._size = static_cast<K>(offset - node._offset);
+
+            // Leave slack for updates
+            node._capacity = node._size + node.slack(node._size);
+            offset = node._offset + node._capacity;
+            _max_capacity = std::max(_max_capacity, node._capacity);
         }
+        _keys.resize(offset);
+
+        // Each block fills its range of every cell, keys in each cell stay in ascending order
+        const auto fill = [this, size, cells, blocks](std::mt19937 &gen, const size_t b) {
+            const K begin = (b * size) / blocks;
+            const K end = ((b + 1) * size) / blocks;
+            size_t *const bins = this->_bins.data() + b * cells;
+            for (K i = begin; i < end; i++)
+            {
+                // Get the surrounding overlapping neighbor cells
+                const auto &s = this->_shapes[i];
+                const auto overlap = vec<T>::grid_overlap(this->_root.get_min(), this->_cell_extent, this->_scale, s.get_min(), s.get_max());
+                for (auto &n : overlap)
+                {
+                    this->_keys[bins[n]++] = i;
+                }
+            }
+        };
+        pool.run(std::cref(fill), 0, blocks);
     }
     inline size_t get_key(const vec<T> &point) const
     {
         // This must be guaranteed to be safe by callers
         return vec<T>::grid_key(_root.get_min(), _cell_extent, _scale, point);
     }
-    inline void get_overlap(const size_t key) const
+    template <typename F>
+    inline void get_overlap(const size_t key, const size_t min_key, F &f) const
     {
         // Get the cell from the next key
         const grid_node<T, K, L, vec, cell, shape> &node = _cells[key];
 
         // Get all keys in this cell
-        const std::vector<K> &keys = node.get_keys();
-        const K size = keys.size();
+        const K *const keys = _keys.data() + node.get_offset();
+        const K size = node.size();
         for (K i = 0; i < size; i++)
         {
-            if (!_flags.get_set_on(keys[i], 0))
+            // Only the lowest cell shared with the overlap range reports this shape
+            if (vec<T>::grid_owner(_owner[keys[i]], min_key, _scale) == key)
             {
-                _hits.emplace_back(keys[i], 0);
+                f(keys[i]);
             }
         }
     }
     inline void get_pairs(const grid_node<T, K, L, vec, cell, shape> &node) const
     {
         // Perform an N^2-N intersection test for all shapes in this cell
-        const std::vector<K> &keys = node.get_keys();
-        const K size = keys.size();
+        const K *const keys = _keys.data() + node.get_offset();
+        const K size = node.size();
         for (K i = 0; i < size; i++)
         {
             for (K j = i + 1; j < size; j++)
             {
-                // See if this collision has already been found; prefer a < b
+                // Prefer a < b
                 K a = keys[i];
                 K b = keys[j];
                 if (a > b)
@@ -197,16 +352,205 @@ class grid
                     b = keys[i];
                 }
 
-                // Add the test to flags to avoid retesting
-                if (!_flags.get_set_on(a, b))
+                // Get the two cells
+                const shape<T, vec> &a_shape = _shapes[a];
+                const shape<T, vec> &b_shape = _shapes[b];
+                if (intersect(a_shape, b_shape))
                 {
-                    // Get the two cells
-                    const shape<T, vec> &a_shape = _shapes[a];
-                    const shape<T, vec> &b_shape = _shapes[b];
-                    if (intersect(a_shape, b_shape))
-                    {
-                        _hits.emplace_back(a, b);
-                    }
+                    _hits.emplace_back(a, b);
+                }
+            }
+        }
+    }
+    template <typename F>
+    inline void get_overlap(const vec<T> &min, const vec<T> &max, F &f) const
+    {
+        // Callback function
+        const size_t min_key = get_key(min);
+        const auto g = [this, min_key, &f](const size_t key) {
+            // Call f(key) for the overlapping shapes in this cell
+            this->get_overlap(key, min_key, f);
+        };
+
+        // Do callback on range of cells in overlapping region
+        vec<T>::grid_range(_root.get_min(), _cell_extent, _scale, min, max, g);
+    }
+    template <typename F>
+    inline void get_radius(const vec<T> &point, const T radius, F &f) const
+    {
+        // Visit the shapes overlapping the box around the sphere
+        const T r2 = radius * radius;
+        const auto g = [this, &point, r2, &f](const K key) {
+            // Call f(key) if the shape center is inside the sphere
+            const vec<T> d = this->_shapes[key].get_center() - point;
+            if (d.dot(d) <= r2)
+            {
+                f(key);
+            }
+        };
+        get_overlap(clamp_bounds(point - radius), clamp_bounds(point + radius), g);
+    }
+    inline static bool nearer(const std::pair<K, T> &a, const std::pair<K, T> &b)
+    {
+        // Order by distance, then by key to break ties
+        return (a.second < b.second) || (a.second == b.second && a.first < b.first);
+    }
+    inline static void push_nearest(std::pair<K, T> *const heap, size_t &size, const size_t k, const K key, const T d2)
+    {
+        // Bounded max heap, the farthest of the k nearest shapes is on top
+        const std::pair<K, T> p(key, d2);
+        if (size < k)
+        {
+            heap[size++] = p;
+            std::push_heap(heap, heap + size, nearer);
+        }
+        else if (nearer(p, heap[0]))
+        {
+            std::pop_heap(heap, heap + size, nearer);
+            heap[size - 1] = p;
+            std::push_heap(heap, heap + size, nearer);
+        }
+    }
+    inline size_t knn(const vec<T> &point, const size_t k, std::pair<K, T> *const heap) const
+    {
+        // Check if grid is not built yet
+        size_t size = 0;
+        if (_cells.size() == 0 || k == 0)
+        {
+            return size;
+        }
+
+        // Grow the search radius from half a cell until k shapes are inside it
+        const vec<T> &world_min = _root.get_min();
+        const vec<T> &world_max = _root.get_max();
+        T radius = _cell_extent.max() * 0.5;
+        while (true)
+        {
+            // Keep the k nearest shapes inside the search radius
+            size = 0;
+            const auto f = [this, &point, k, heap, &size](const K key) {
+                const vec<T> d = this->_shapes[key].get_center() - point;
+                push_nearest(heap, size, k, key, d.dot(d));
+            };
+            get_radius(point, radius, f);
+
+            // Any shape outside the radius is farther than all shapes found, stop if the radius covers the world
+            if (size == k || ((point - radius) <= world_min && (point + radius) >= world_max))
+            {
+                break;
+            }
+
+            // Each doubling visits 2^N more cells, so the cells visited before are a small fraction
+            radius *= 2.0;
+        }
+
+        // Sort the heap nearest first
+        std::sort_heap(heap, heap + size, nearer);
+
+        return size;
+    }
+    template <typename F>
+    inline void get_pairs(const grid_node<T, K, L, vec, cell, shape> &node, const size_t key, T *const tile, F &f) const
+    {
+        // Use the tile only if the shape has a tile layout
+        get_pairs(node, key, tile, f, soa_tile<T, vec, shape>());
+    }
+    template <typename F>
+    inline void get_pairs(const grid_node<T, K, L, vec, cell, shape> &node, const size_t key, T *const, F &f, std::false_type) const
+    {
+        // Perform an N^2-N intersection test for all shapes in this cell
+        const K *const keys = _keys.data() + node.get_offset();
+        const K size = node.size();
+        for (K i = 0; i < size; i++)
+        {
+            const size_t owner = _owner[keys[i]];
+            for (K j = i + 1; j < size; j++)
+            {
+                // Only the lowest cell shared by both shapes reports the pair
+                if (vec<T>::grid_owner(owner, _owner[keys[j]], _scale) != key)
+                {
+                    continue;
+                }
+
+                // Prefer a < b
+                K a = keys[i];
+                K b = keys[j];
+                if (a > b)
+                {
+                    a = keys[j];
+                    b = keys[i];
+                }
+
+                // Get the two cells
+                const shape<T, vec> &a_shape = _shapes[a];
+                const shape<T, vec> &b_shape = _shapes[b];
+                if (intersect(a_shape, b_shape))
+                {
+                    f(a, b);
+                }
+            }
+        }
+    }
+    template <typename F>
+    inline void get_pairs(const grid_node<T, K, L, vec, cell, shape> &node, const size_t key, T *const tile, F &f, std::true_type) const
+    {
+        // Copy the bounds of all shapes in this cell into the tile
+        const K *const keys = _keys.data() + node.get_offset();
+        const K size = node.size();
+        for (K i = 0; i < size; i++)
+        {
+            soa_tile<T, vec, shape>::store(tile, size, i, _shapes[keys[i]]);
+        }
+
+        // Test each shape against the shapes after it, several at a time with MGL_SIMD
+        for (K i = 0; i < size; i++)
+        {
+            const size_t owner = _owner[keys[i]];
+            const auto g = [this, keys, i, owner, key, &f](const size_t j) {
+                // Only the lowest cell shared by both shapes reports the pair
+                if (vec<T>::grid_owner(owner, this->_owner[keys[j]], this->_scale) != key)
+                {
+                    return;
+                }
+
+                // Prefer a < b
+                K a = keys[i];
+                K b = keys[j];
+                if (a > b)
+                {
+                    a = keys[j];
+                    b = keys[i];
+                }
+
+                // Confirm with the exact test so results match the scalar path
+                if (intersect(this->_shapes[a], this->_shapes[b]))
+                {
+                    f(a, b);
+                }
+            };
+            soa_tile<T, vec, shape>::overlap(tile, size, i, i + 1, g);
+        }
+    }
+    inline void get_closest_hit(const grid_node<T, K, L, vec, cell, shape> &node, const ray<T, vec> &r, T &best, bool &found, K &key, vec<T> &point) const
+    {
+        // Perform an N intersection test for all shapes in this cell against the ray, keeping the nearest hit
+        const K *const keys = _keys.data() + node.get_offset();
+        const K size = node.size();
+        vec<T> p;
+        for (K i = 0; i < size; i++)
+        {
+            const K k = keys[i];
+            const shape<T, vec> &s = _shapes[k];
+            if (intersect(s, r, p))
+            {
+                // Distance along the ray to the hit
+                const T t = (p - r.get_origin()).dot(r.get_direction());
+                if (t <= best)
+                {
+                    best = t;
+                    found = true;
+                    key = k;
+                    point = p;
                 }
             }
         }
@@ -214,8 +558,8 @@ class grid
     inline void get_ray_intersect(const grid_node<T, K, L, vec, cell, shape> &node, const ray<T, vec> &r) const
     {
         // Perform an N intersection test for all shapes in this cell against the ray
-        const std::vector<K> &keys = node.get_keys();
-        const K size = keys.size();
+        const K *const keys = _keys.data() + node.get_offset();
+        const K size = node.size();
         vec<T> point;
         for (K i = 0; i < size; i++)
         {
@@ -295,10 +639,38 @@ class grid
         // Iterate over sorted indices and store sorted shapes
         _shapes.clear();
         _shapes.reserve(size);
-        for (const K i : _index_map)
+        _inverse_map.resize(size);
+        for (K i = 0; i < size; i++)
+        {
+            const K j = _index_map[i];
+            _shapes.emplace_back(shapes[j]);
+            _inverse_map[j] = i;
+        }
+    }
+    inline void sort_rays(const std::vector<ray<T, vec>> &rays) const
+    {
+        // Direction bins span the unit cube in 4 steps per axis
+        const vec<T> dir_min = vec<T>().set_all(-1.0);
+        const vec<T> dir_max = vec<T>().set_all(0.999);
+        const vec<T> dir_extent = vec<T>().set_all(0.5);
+        const size_t dir_bins = vec<T>::grid_key(dir_min, dir_extent, 4, dir_max) + 1;
+
+        // Cache key of the origin cell and direction bin of each ray
+        const size_t size = rays.size();
+        _ray_keys.resize(size);
+        for (size_t i = 0; i < size; i++)
         {
-            _shapes.emplace_back(shapes[i]);
+            const vec<T> dir = vec<T>(rays[i].get_direction()).clamp(dir_min, dir_max);
+            const size_t dir_key = vec<T>::grid_key(dir_min, dir_extent, 4, dir);
+            _ray_keys[i] = get_key(clamp_bounds(rays[i].get_origin())) * dir_bins + dir_key;
         }
+
+        // Sort ray indices so rays starting in the same cell heading the same way are adjacent
+        _ray_index.resize(size);
+        std::iota(_ray_index.begin(), _ray_index.end(), 0);
+        uint_sort<size_t>(_ray_index, _ray_copy, [this](const size_t a) {
+            return this->_ray_keys[a];
+        });
     }
 
   public:
@@ -306,7 +678,7 @@ class grid
         : _root(c),
           _lower_bound(_root.get_min() + var<T>::TOL_PHYS_EDGE),
           _upper_bound(_root.get_max() - var<T>::TOL_PHYS_EDGE),
-          _scale(0), _cached_scale(0) {}
+          _max_capacity(0), _scale(0), _cached_scale(0) {}
 
     inline void check_size(const std::vector<shape<T, vec>> &shapes) const
     {
@@ -325,6 +697,37 @@ class grid
         // Must rebuild if any shape has increased its size from the previous build
         _cached_scale = 0;
     }
+    template <typename F>
+    inline void for_each_collision(F &&f) const
+    {
+        // Check if grid is not built yet
+        if (_cells.size() == 0)
+        {
+            return;
+        }
+
+        // Tile for the shape bounds of the largest cell
+        _tile.resize(soa_tile<T, vec, shape>::stride() * _max_capacity);
+
+        // Call f(a, b) with a < b for every intersecting pair, each pair is reported once
+        const size_t cells = _cells.size();
+        for (size_t i = 0; i < cells; i++)
+        {
+            get_pairs(_cells[i], i, _tile.data(), f);
+        }
+    }
+    template <typename F>
+    inline void for_each_overlap(const shape<T, vec> &overlap, F &&f) const
+    {
+        // Check if grid is not built yet
+        if (_cells.size() == 0)
+        {
+            return;
+        }
+
+        // Clamp overlap min and max to world edges and call f(key) for every overlapping shape
+        get_overlap(clamp_bounds(overlap.get_min()), clamp_bounds(overlap.get_max()), f);
+    }
     inline const std::vector<std::pair<K, K>> &get_collisions() const
     {
         // Check if grid is not built yet
@@ -333,17 +736,64 @@ class grid
             return _hits;
         }
 
-        // Clear out the old collision sets and vectors
-        _flags.clear();
-
         // Output vector
         _hits.clear();
         _hits.reserve(_shapes.size());
 
         // Calculate the intersection pairs for every cell
-        for (const auto &node : _cells)
+        for_each_collision([this](const K a, const K b) {
+            this->_hits.emplace_back(a, b);
+        });
+
+        // Return the collision list
+        return _hits;
+    }
+    inline const std::vector<std::pair<K, K>> &get_collisions(thread_pool &pool) const
+    {
+        // Check if grid is not built yet
+        if (_cells.size() == 0)
+        {
+            return _hits;
+        }
+
+        // Split the cells into more blocks than threads to balance uneven cells
+        const size_t cells = _cells.size();
+        const size_t blocks = std::min(pool.get_thread_count() * 8, cells);
+        if (_block_hits.size() < blocks)
         {
-            get_pairs(node);
+            _block_hits.resize(blocks);
+        }
+
+        // Calculate the intersection pairs for every cell, each block has its own hit buffer
+        const auto pairs = [this, cells, blocks](std::mt19937 &gen, arena &scratch, const size_t b) {
+            const size_t begin = (b * cells) / blocks;
+            const size_t end = ((b + 1) * cells) / blocks;
+            std::vector<std::pair<K, K>> &out = this->_block_hits[b];
+            out.clear();
+            const auto f = [&out](const K a, const K b) {
+                out.emplace_back(a, b);
+            };
+
+            // Each block has its own tile for the shape bounds of the largest cell
+            T *const tile = scratch.allocate<T>(soa_tile<T, vec, shape>::stride() * this->_max_capacity);
+            for (size_t i = begin; i < end; i++)
+            {
+                this->get_pairs(this->_cells[i], i, tile, f);
+            }
+        };
+        pool.run(std::cref(pairs), 0, blocks);
+
+        // Concatenate the hits in block order so the output is the same for any thread count
+        size_t size = 0;
+        for (size_t b = 0; b < blocks; b++)
+        {
+            size += _block_hits[b].size();
+        }
+        _hits.clear();
+        _hits.reserve(size);
+        for (size_t b = 0; b < blocks; b++)
+        {
+            _hits.insert(_hits.end(), _block_hits[b].begin(), _block_hits[b].end());
         }
 
         // Return the collision list
@@ -357,9 +807,6 @@ class grid
             return _hits;
         }
 
-        // Clear out the old collision sets and vectors
-        _flags.clear();
-
         // Clamp point into world bounds
         const vec<T> clamped = clamp_bounds(point);
 
@@ -430,6 +877,87 @@ class grid
         // Return the collision list
         return _ray_hits;
     }
+    inline bool get_closest_hit(const ray<T, vec> &r, const T t_max, K &key, vec<T> &point) const
+    {
+        // Check if grid is not built yet
+        if (_cells.size() == 0)
+        {
+            return false;
+        }
+
+        // Find where the ray enters the grid
+        T t_start;
+        if (!ray_entry(_root.get_min(), _root.get_max(), r, t_start) || t_start > t_max)
+        {
+            return false;
+        }
+        const vec<T> start = clamp_bounds(r.interpolate(t_start));
+
+        // This function computes the ray lengths along the grid cell
+        auto grid_ray = vec<T>::grid_ray(_root.get_min(), _cell_extent, start, r.get_direction(), r.get_inverse());
+
+        // Get the grid cell of ray entry
+        auto grid_index = vec<T>::grid_index(_root.get_min(), _cell_extent, start);
+        size_t next = vec<T>::grid_key(grid_index, _scale);
+
+        // Walk the cells front to back keeping the nearest hit
+        T best = t_max;
+        bool found = false;
+        bool bad_flag = false;
+        while (!bad_flag)
+        {
+            // Get the nearest hit in this cell
+            get_closest_hit(_cells[next], r, best, found, key, point);
+
+            // Shapes are in every cell they overlap, so no later cell can have a nearer hit
+            if (best <= t_start + vec<T>::grid_ray_exit(grid_ray))
+            {
+                break;
+            }
+
+            // Find the next cell along the ray to test, bad flag signals that we have hit the last valid cell
+            next = vec<T>::grid_ray_next(grid_index, grid_ray, bad_flag, _scale);
+        }
+
+        return found;
+    }
+    inline const std::vector<std::pair<K, vec<T>>> &get_closest_hits(thread_pool &pool, const std::vector<ray<T, vec>> &rays, const T t_max) const
+    {
+        // Every ray starts as a miss, marked with the max key since check_size never allows it
+        const size_t size = rays.size();
+        _closest.assign(size, std::make_pair(std::numeric_limits<K>::max(), vec<T>()));
+
+        // Check if grid is not built yet
+        if (_cells.size() == 0 || size == 0)
+        {
+            return _closest;
+        }
+
+        // Order rays so neighboring rays in a block walk the same cells while they are cached
+        sort_rays(rays);
+
+        // Split the sorted rays into more blocks than threads to balance uneven rays
+        const size_t blocks = std::min(pool.get_thread_count() * 8, size);
+
+        // Find the closest hit for each ray, results are stored at the ray index so blocks never share an entry
+        const auto closest = [this, &rays, t_max, size, blocks](std::mt19937 &gen, const size_t b) {
+            const size_t begin = (b * size) / blocks;
+            const size_t end = ((b + 1) * size) / blocks;
+            for (size_t i = begin; i < end; i++)
+            {
+                const size_t r = this->_ray_index[i];
+                std::pair<K, vec<T>> &hit = this->_closest[r];
+                if (!this->get_closest_hit(rays[r], t_max, hit.first, hit.second))
+                {
+                    hit.first = std::numeric_limits<K>::max();
+                }
+            }
+        };
+        pool.run(std::cref(closest), 0, blocks);
+
+        // Return the closest hit of each ray
+        return _closest;
+    }
     inline const std::vector<K> &get_index_map() const
     {
         return _index_map;
@@ -462,25 +990,14 @@ class grid
             return _hits;
         }
 
-        // Clear out the old collision sets and vectors
-        _flags.clear();
-
         // Output vector
         _hits.clear();
         _hits.reserve(_shapes.size());
 
-        // Callback function
-        const auto f = [this](const size_t key) {
-            // Get the intersecting pairs in this cell
-            this->get_overlap(key);
-        };
-
-        // Clamp overlap min and max to world edges
-        const vec<T> min = clamp_bounds(overlap.get_min());
-        const vec<T> max = clamp_bounds(overlap.get_max());
-
-        // Do callback on range of cells in overlapping region
-        vec<T>::grid_range(_root.get_min(), _cell_extent, _scale, min, max, f);
+        // Get the overlapping shapes in every cell of the overlapping region
+        for_each_overlap(overlap, [this](const K key) {
+            this->_hits.emplace_back(key, 0);
+        });
 
         // Return the overlap list
         return _hits;
@@ -507,6 +1024,20 @@ class grid
             build();
         }
     }
+    inline void insert(thread_pool &pool, const std::vector<shape<T, vec>> &shapes)
+    {
+        if (shapes.size() > 0)
+        {
+            // Set the grid scale
+            scale(shapes);
+
+            // Sort the shape array and store copy
+            sort(shapes);
+
+            // Rebuild the grid in parallel after changing the contents
+            build(pool);
+        }
+    }
     inline void insert(const std::vector<shape<T, vec>> &shapes, const K depth)
     {
         // !! For this function to succeed can't create cells smaller than the largest shape!!
@@ -533,10 +1064,31 @@ class grid
             _shapes.clear();
             _shapes.insert(_shapes.end(), shapes.begin(), shapes.end());
 
+            // Shapes are in insertion order, update() will rebuild
+            _inverse_map.clear();
+
             // Rebuild the grid after changing the contents
             build();
         }
     }
+    inline void knn(const vec<T> &point, const size_t k, std::vector<std::pair<K, T>> &out) const
+    {
+        // Get the k shapes with nearest centers and their square distance, nearest first
+        out.resize(k);
+        out.resize(knn(point, k, out.data()));
+    }
+    inline void knn(thread_pool &pool, const std::vector<vec<T>> &points, const size_t k, std::vector<std::pair<K, T>> &out) const
+    {
+        // Each point gets k entries, missing neighbors are marked with the max key
+        const size_t size = points.size();
+        out.assign(size * k, std::make_pair(std::numeric_limits<K>::max(), std::numeric_limits<T>::max()));
+
+        // Get the k nearest shapes of each point, each point writes its own slice
+        const auto nearest = [this, &points, k, &out](std::mt19937 &gen, const size_t i) {
+            this->knn(points[i], k, out.data() + i * k);
+        };
+        pool.run(std::cref(nearest), 0, size);
+    }
     inline const std::vector<K> &point_inside(const vec<T> &point) const
     {
         // Check if grid is not built yet
@@ -548,8 +1100,78 @@ class grid
         // Clamp point into world bounds
         const vec<T> clamped = clamp_bounds(point);
 
-        // Get the keys on the cell node
-        return get_node(clamped).get_keys();
+        // Copy the keys on the cell node
+        const grid_node<T, K, L, vec, cell, shape> &node = get_node(clamped);
+        const auto begin = _keys.begin() + node.get_offset();
+        _point_keys.assign(begin, begin + node.size());
+
+        return _point_keys;
+    }
+    inline void radius_query(const vec<T> &point, const T radius, std::vector<K> &out) const
+    {
+        // Output vector
+        out.clear();
+
+        // Check if grid is not built yet
+        if (_cells.size() == 0)
+        {
+            return;
+        }
+
+        // Get the shapes with centers inside the sphere
+        const auto f = [&out](const K key) {
+            out.push_back(key);
+        };
+        get_radius(point, radius, f);
+    }
+    inline void radius_query(thread_pool &pool, const std::vector<vec<T>> &points, const T radius, std::vector<K> &out, std::vector<size_t> &offsets) const
+    {
+        // The shapes of point i are out[offsets[i]] to out[offsets[i + 1]]
+        const size_t size = points.size();
+        offsets.assign(size + 1, 0);
+        out.clear();
+
+        // Check if grid is not built yet
+        if (_cells.size() == 0 || size == 0)
+        {
+            return;
+        }
+
+        // Split the points into more blocks than threads to balance uneven queries
+        const size_t blocks = std::min(pool.get_thread_count() * 8, size);
+        if (_block_keys.size() < blocks)
+        {
+            _block_keys.resize(blocks);
+        }
+
+        // Get the shapes of each point and count them, each block has its own key buffer
+        const auto query = [this, &points, radius, &offsets, size, blocks](std::mt19937 &gen, const size_t b) {
+            const size_t begin = (b * size) / blocks;
+            const size_t end = ((b + 1) * size) / blocks;
+            std::vector<K> &keys = this->_block_keys[b];
+            keys.clear();
+            const auto f = [&keys](const K key) {
+                keys.push_back(key);
+            };
+            for (size_t i = begin; i < end; i++)
+            {
+                const size_t start = keys.size();
+                this->get_radius(points[i], radius, f);
+                offsets[i + 1] = keys.size() - start;
+            }
+        };
+        pool.run(std::cref(query), 0, blocks);
+
+        // Prefix sum the counts into offsets, blocks are in point order
+        for (size_t i = 0; i < size; i++)
+        {
+            offsets[i + 1] += offsets[i];
+        }
+        out.reserve(offsets[size]);
+        for (size_t b = 0; b < blocks; b++)
+        {
+            out.insert(out.end(), _block_keys[b].begin(), _block_keys[b].end());
+        }
     }
     inline void resize(const cell<T, vec> &c)
     {
@@ -560,6 +1182,84 @@ class grid
         // Force rebuilding the grid
         force_rebuild();
     }
+    inline void update(const std::vector<shape<T, vec>> &shapes, const std::vector<K> &moved)
+    {
+        // 'shapes' is the vector last passed to insert(), 'moved' indexes the shapes whose bounds changed
+        // Keys only move for the moved shapes, but every shape is refreshed for the intersection tests
+        // Rebuild if the grid wasn't built by insert() with these shapes
+        const size_t size = shapes.size();
+        if (_cells.size() == 0 || _shapes.size() != size || _inverse_map.size() != size)
+        {
+            insert(shapes);
+            return;
+        }
+
+        // Rebuild if any moved shape has outgrown the grid cells
+        const T cell_size = _cell_extent.dot(_cell_extent);
+        for (const K m : moved)
+        {
+            if (shapes[m].square_size() > cell_size)
+            {
+                insert(shapes);
+                return;
+            }
+        }
+
+        // Move keys of the moved shapes between cells
+        bool full = false;
+        for (const K m : moved)
+        {
+            // Stop moving keys if a cell is full, the grid will be rebuilt
+            if (full)
+            {
+                break;
+            }
+
+            // Get the old and new overlapping cells
+            const K key = _inverse_map[m];
+            const shape<T, vec> &from_s = _shapes[key];
+            const shape<T, vec> &to_s = shapes[m];
+            const auto from = vec<T>::grid_overlap(_root.get_min(), _cell_extent, _scale, from_s.get_min(), from_s.get_max());
+            const auto to = vec<T>::grid_overlap(_root.get_min(), _cell_extent, _scale, to_s.get_min(), to_s.get_max());
+
+            // Remove the key from cells it has left
+            for (const auto n : from)
+            {
+                if (std::find(to.begin(), to.end(), n) == to.end())
+                {
+                    _cells[n].remove_key(_keys, key);
+                }
+            }
+
+            // Add the key to cells it has entered
+            for (const auto n : to)
+            {
+                if (std::find(from.begin(), from.end(), n) == from.end())
+                {
+                    if (!_cells[n].add_key(_keys, key))
+                    {
+                        full = true;
+                        break;
+                    }
+                }
+            }
+
+            // The first overlapping cell is the lowest corner of the cell range
+            _owner[key] = to[0];
+        }
+
+        // Refresh every stored shape, a shape can rotate without changing its bounds
+        for (size_t i = 0; i < size; i++)
+        {
+            _shapes[_inverse_map[i]] = shapes[i];
+        }
+
+        // Rebuild the cells from the stored shapes if a cell ran out of room
+        if (full)
+        {
+            build();
+        }
+    }
 };
 }
 
@@ -0,0 +1,737 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_HASH_GRID_MGL_
+#define _MGL_HASH_GRID_MGL_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <min/intersect.h>
+#include <min/ray.h>
+#include <min/sort.h>
+#include <min/thread_pool.h>
+#include <min/utility.h>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The shape class must fulfill the following interface to be inserted into the spatial structure
+// shape.get_center()
+// shape.get_min()
+// shape.get_max()
+// shape.square_size()
+// intersect(shape, shape)
+
+// Forward declaration for hash_grid_node
+namespace min
+{
+template <typename T, typename K, typename L, template <typename> class vec, template <typename, template <typename> class> class cell, template <typename, template <typename> class> class shape>
+class hash_grid;
+}
+
+namespace min
+{
+
+template <typename T, typename K, typename L, template <typename> class vec, template <typename, template <typename> class> class cell, template <typename, template <typename> class> class shape>
+class hash_grid_node
+{
+    friend class hash_grid<T, K, L, vec, cell, shape>;
+
+  private:
+    size_t _key;
+    size_t _offset;
+    K _size;
+
+  public:
+    hash_grid_node(const size_t key) : _key(key), _offset(0), _size(0) {}
+    inline size_t get_key() const
+    {
+        return _key;
+    }
+    inline size_t get_offset() const
+    {
+        return _offset;
+    }
+    inline K size() const
+    {
+        return _size;
+    }
+};
+
+// Grid over the world cell that only allocates occupied cells
+// Cells are found through an open addressing table keyed by the grid key of the cell
+template <typename T, typename K, typename L, template <typename> class vec, template <typename, template <typename> class> class cell, template <typename, template <typename> class> class shape>
+class hash_grid
+{
+  private:
+    std::vector<shape<T, vec>> _shapes;
+    std::vector<hash_grid_node<T, K, L, vec, cell, shape>> _nodes;
+    std::vector<size_t> _table;
+    size_t _shift;
+    std::vector<K> _keys;
+    std::vector<K> _index_map;
+    std::vector<size_t> _key_cache;
+    std::vector<size_t> _owner;
+    std::vector<K> _sort_copy;
+    mutable std::vector<K> _point_keys;
+    mutable std::vector<std::pair<K, K>> _hits;
+    mutable std::vector<std::vector<std::pair<K, K>>> _block_hits;
+    mutable std::vector<std::pair<K, vec<T>>> _ray_hits;
+    cell<T, vec> _root;
+    vec<T> _cell_extent;
+    vec<T> _lower_bound;
+    vec<T> _upper_bound;
+    size_t _scale;
+
+    inline static constexpr size_t empty()
+    {
+        return std::numeric_limits<size_t>::max();
+    }
+    inline static constexpr K max_depth()
+    {
+        // Three dimensions of 20 bit cell coordinates fit in a 64 bit key
+        return 20;
+    }
+    inline static size_t hash(const size_t key)
+    {
+        // Fibonacci hashing, the high bits of the product depend on every bit of the key
+        return static_cast<size_t>(key * static_cast<uint64_t>(0x9E3779B97F4A7C15));
+    }
+    inline static size_t table_shift(const size_t size)
+    {
+        // Shift that keeps the top log2(size) bits of a hash
+        size_t shift = std::numeric_limits<size_t>::digits;
+        for (size_t s = size; s > 1; s >>= 1)
+        {
+            shift--;
+        }
+
+        return shift;
+    }
+    inline size_t home(const size_t key) const
+    {
+        // The low bits of the product only depend on the low bits of the key, so take the high bits
+        return hash(key) >> _shift;
+    }
+    inline size_t find(const size_t key) const
+    {
+        // Linear probe until the key or an empty slot is found
+        const size_t mask = _table.size() - 1;
+        for (size_t h = home(key);; h = (h + 1) & mask)
+        {
+            const size_t index = _table[h];
+            if (index == empty() || _nodes[index]._key == key)
+            {
+                return index;
+            }
+        }
+    }
+    inline size_t find_or_add(const size_t key)
+    {
+        // Keep the table at most half full
+        if (2 * (_nodes.size() + 1) > _table.size())
+        {
+            rehash(2 * _table.size());
+        }
+
+        // Linear probe until the key or an empty slot is found
+        const size_t mask = _table.size() - 1;
+        for (size_t h = home(key);; h = (h + 1) & mask)
+        {
+            const size_t index = _table[h];
+            if (index == empty())
+            {
+                // Allocate the occupied cell
+                _table[h] = _nodes.size();
+                _nodes.emplace_back(key);
+                return _table[h];
+            }
+            else if (_nodes[index]._key == key)
+            {
+                return index;
+            }
+        }
+    }
+    inline void rehash(const size_t size)
+    {
+        // Reinsert all occupied cells into a larger table
+        _table.assign(size, empty());
+        _shift = table_shift(size);
+        const size_t mask = size - 1;
+        const size_t nodes = _nodes.size();
+        for (size_t i = 0; i < nodes; i++)
+        {
+            size_t h = home(_nodes[i]._key);
+            while (_table[h] != empty())
+            {
+                h = (h + 1) & mask;
+            }
+            _table[h] = i;
+        }
+    }
+    inline void build()
+    {
+        // Break out if scale is zero
+        if (_scale == 0)
+        {
+            return;
+        }
+
+        // Empty the table, sized for about two cells per shape
+        const K size = _shapes.size();
+        _nodes.clear();
+        size_t table_size = 16;
+        while (table_size < 4 * static_cast<size_t>(size))
+        {
+            table_size *= 2;
+        }
+        if (_table.size() < table_size)
+        {
+            _table.resize(table_size);
+            _shift = table_shift(table_size);
+        }
+        std::fill(_table.begin(), _table.end(), empty());
+
+        // Count the keys in each occupied cell
+        _owner.resize(size);
+        for (K i = 0; i < size; i++)
+        {
+            // Callback function
+            bool first = true;
+            const auto f = [this, i, &first](const size_t key) {
+                // Allocate cell if not occupied
+                this->_nodes[this->find_or_add(key)]._size++;
+
+                // The first cell in range is the lowest corner of the cell range
+                if (first)
+                {
+                    this->_owner[i] = key;
+                    first = false;
+                }
+            };
+
+            // Do callback on range of cells the shape overlaps
+            const auto &b = _shapes[i];
+            vec<T>::grid_range(_root.get_min(), _cell_extent, _scale, clamp_bounds(b.get_min()), clamp_bounds(b.get_max()), f);
+        }
+
+        // Prefix sum the cell counts into offsets in the key array
+        size_t offset = 0;
+        for (auto &node : _nodes)
+        {
+            node._offset = offset;
+            offset += node._size;
+            node._size = 0;
+        }
+        _keys.resize(offset);
+
+        // Fill the key array, keys in each cell stay in ascending order
+        for (K i = 0; i < size; i++)
+        {
+            // Callback function
+            const auto f = [this, i](const size_t key) {
+                hash_grid_node<T, K, L, vec, cell, shape> &node = this->_nodes[this->find(key)];
+                this->_keys[node._offset + node._size++] = i;
+            };
+
+            // Do callback on range of cells the shape overlaps
+            const auto &b = _shapes[i];
+            vec<T>::grid_range(_root.get_min(), _cell_extent, _scale, clamp_bounds(b.get_min()), clamp_bounds(b.get_max()), f);
+        }
+    }
+    inline size_t get_key(const vec<T> &point) const
+    {
+        // This must be guaranteed to be safe by callers
+        return vec<T>::grid_key(_root.get_min(), _cell_extent, _scale, point);
+    }
+    template <typename F>
+    inline void get_overlap(const hash_grid_node<T, K, L, vec, cell, shape> &node, const size_t min_key, F &f) const
+    {
+        // Get all keys in this cell
+        const K *const keys = _keys.data() + node.get_offset();
+        const K size = node.size();
+        const size_t key = node.get_key();
+        for (K i = 0; i < size; i++)
+        {
+            // Only the lowest cell shared with the overlap range reports this shape
+            if (vec<T>::grid_owner(_owner[keys[i]], min_key, _scale) == key)
+            {
+                f(keys[i]);
+            }
+        }
+    }
+    template <typename F>
+    inline void get_pairs(const hash_grid_node<T, K, L, vec, cell, shape> &node, const bool owned, F &f) const
+    {
+        // Perform an N^2-N intersection test for all shapes in this cell
+        const K *const keys = _keys.data() + node.get_offset();
+        const K size = node.size();
+        const size_t key = node.get_key();
+        for (K i = 0; i < size; i++)
+        {
+            const size_t owner = _owner[keys[i]];
+            for (K j = i + 1; j < size; j++)
+            {
+                // Only the lowest cell shared by both shapes reports the pair
+                if (owned && vec<T>::grid_owner(owner, _owner[keys[j]], _scale) != key)
+                {
+                    continue;
+                }
+
+                // Prefer a < b
+                K a = keys[i];
+                K b = keys[j];
+                if (a > b)
+                {
+                    a = keys[j];
+                    b = keys[i];
+                }
+
+                // Get the two cells
+                const shape<T, vec> &a_shape = _shapes[a];
+                const shape<T, vec> &b_shape = _shapes[b];
+                if (intersect(a_shape, b_shape))
+                {
+                    f(a, b);
+                }
+            }
+        }
+    }
+    inline void get_ray_intersect(const size_t key, const ray<T, vec> &r) const
+    {
+        // Skip empty cells
+        const size_t index = find(key);
+        if (index == empty())
+        {
+            return;
+        }
+
+        // Perform an N intersection test for all shapes in this cell against the ray
+        const hash_grid_node<T, K, L, vec, cell, shape> &node = _nodes[index];
+        const K *const keys = _keys.data() + node.get_offset();
+        const K size = node.size();
+        vec<T> point;
+        for (K i = 0; i < size; i++)
+        {
+            const K k = keys[i];
+            const shape<T, vec> &s = _shapes[k];
+            if (intersect(s, r, point))
+            {
+                _ray_hits.emplace_back(k, point);
+            }
+        }
+    }
+    inline void set_scale(const K depth)
+    {
+        // Set the grid cell scale 2^depth, empty cells cost nothing so don't limit by shape count
+        // Cap the depth so cell keys of all dimensions fit in size_t
+        _scale = static_cast<size_t>(1) << std::min(max_depth(), depth);
+
+        // Set the grid cell extent
+        _cell_extent = _root.get_extent() / static_cast<T>(_scale);
+    }
+    inline void scale(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Find the largest object in the collection
+        // Square distance across the extent
+        T max = shapes[0].square_size();
+
+        // Calculate the maximum square distance across each extent
+        const K size = shapes.size();
+        for (K i = 1; i < size; i++)
+        {
+            // Update the maximum
+            const T d2 = shapes[i].square_size();
+            if (d2 > max)
+            {
+                max = d2;
+            }
+        }
+
+        // Calculate the world cell extent
+        const T d2 = std::sqrt(_root.square_size());
+        max = std::sqrt(max);
+
+        // Calculate the scale to be the world cell extent / max object extent
+        const T ratio = std::max(std::log2(d2 / max), static_cast<T>(0.0));
+        const K depth = static_cast<K>(std::min(std::ceil(ratio), static_cast<T>(max_depth())));
+
+        // Set the scale from depth
+        set_scale(depth);
+    }
+    inline void sort(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Create index vector to sort 0 to N
+        const K size = shapes.size();
+        _index_map.resize(size);
+        std::iota(_index_map.begin(), _index_map.end(), 0);
+
+        // Cache key calculation for sorting speed up
+        _key_cache.resize(size);
+        for (K i = 0; i < size; i++)
+        {
+            _key_cache[i] = this->get_key(clamp_bounds(shapes[i].get_center()));
+        }
+
+        // use uint radix sort for sorting keys
+        // lambda function to create sorted array indices based on grid key
+        uint_sort<K>(_index_map, _sort_copy, [this](const K a) {
+            return this->_key_cache[a];
+        });
+
+        // Iterate over sorted indices and store sorted shapes
+        _shapes.clear();
+        _shapes.reserve(size);
+        for (const K i : _index_map)
+        {
+            _shapes.emplace_back(shapes[i]);
+        }
+    }
+
+  public:
+    hash_grid(const cell<T, vec> &c)
+        : _table(16, empty()),
+          _shift(table_shift(16)),
+          _root(c),
+          _lower_bound(_root.get_min() + var<T>::TOL_PHYS_EDGE),
+          _upper_bound(_root.get_max() - var<T>::TOL_PHYS_EDGE),
+          _scale(0) {}
+
+    inline void check_size(const std::vector<shape<T, vec>> &shapes) const
+    {
+        // Check size of the number of objects to insert into grid
+        if (shapes.size() > std::numeric_limits<K>::max() - 1)
+        {
+            throw std::runtime_error("hash_grid: too many objects to insert, max supported is " + std::to_string(std::numeric_limits<K>::max()));
+        }
+    }
+    inline vec<T> clamp_bounds(const vec<T> &point) const
+    {
+        return vec<T>(point).clamp(_lower_bound, _upper_bound);
+    }
+    inline size_t get_cell_count() const
+    {
+        return _nodes.size();
+    }
+    template <typename F>
+    inline void for_each_collision(F &&f) const
+    {
+        // Call f(a, b) with a < b for every intersecting pair, each pair is reported once
+        for (const auto &node : _nodes)
+        {
+            get_pairs(node, true, f);
+        }
+    }
+    template <typename F>
+    inline void for_each_overlap(const shape<T, vec> &overlap, F &&f) const
+    {
+        // Check if grid is not built yet
+        if (_nodes.size() == 0)
+        {
+            return;
+        }
+
+        // Clamp overlap min and max to world edges
+        const vec<T> min = clamp_bounds(overlap.get_min());
+        const vec<T> max = clamp_bounds(overlap.get_max());
+        const size_t min_key = get_key(min);
+        const size_t max_key = get_key(max);
+
+        // Visit the cells in range if there are fewer of them than occupied cells
+        if (max_key - min_key < _nodes.size())
+        {
+            // Callback function
+            const auto g = [this, min_key, &f](const size_t key) {
+                const size_t index = this->find(key);
+                if (index != empty())
+                {
+                    this->get_overlap(this->_nodes[index], min_key, f);
+                }
+            };
+
+            // Do callback on range of cells in overlapping region
+            vec<T>::grid_range(_root.get_min(), _cell_extent, _scale, min, max, g);
+        }
+        else
+        {
+            // Otherwise test every occupied cell against the range
+            for (const auto &node : _nodes)
+            {
+                const size_t key = node.get_key();
+                if (vec<T>::grid_owner(key, min_key, _scale) == key && vec<T>::grid_owner(key, max_key, _scale) == max_key)
+                {
+                    get_overlap(node, min_key, f);
+                }
+            }
+        }
+    }
+    inline const std::vector<std::pair<K, K>> &get_collisions() const
+    {
+        // Output vector
+        _hits.clear();
+        _hits.reserve(_shapes.size());
+
+        // Calculate the intersection pairs for every occupied cell
+        for_each_collision([this](const K a, const K b) {
+            this->_hits.emplace_back(a, b);
+        });
+
+        // Return the collision list
+        return _hits;
+    }
+    inline const std::vector<std::pair<K, K>> &get_collisions(thread_pool &pool) const
+    {
+        // Output vector
+        _hits.clear();
+
+        // Check if grid is not built yet
+        if (_nodes.size() == 0)
+        {
+            return _hits;
+        }
+
+        // Split the occupied cells into more blocks than threads to balance uneven cells
+        const size_t nodes = _nodes.size();
+        const size_t blocks = std::min(pool.get_thread_count() * 8, nodes);
+        if (_block_hits.size() < blocks)
+        {
+            _block_hits.resize(blocks);
+        }
+
+        // Calculate the intersection pairs for every occupied cell, each block has its own hit buffer
+        const auto pairs = [this, nodes, blocks](std::mt19937 &gen, const size_t b) {
+            const size_t begin = (b * nodes) / blocks;
+            const size_t end = ((b + 1) * nodes) / blocks;
+            std::vector<std::pair<K, K>> &out = this->_block_hits[b];
+            out.clear();
+            const auto f = [&out](const K a, const K b) {
+                out.emplace_back(a, b);
+            };
+            for (size_t i = begin; i < end; i++)
+            {
+                this->get_pairs(this->_nodes[i], true, f);
+            }
+        };
+        pool.run(std::cref(pairs), 0, blocks);
+
+        // Concatenate the hits in block order so the output is the same for any thread count
+        size_t size = 0;
+        for (size_t b = 0; b < blocks; b++)
+        {
+            size += _block_hits[b].size();
+        }
+        _hits.reserve(size);
+        for (size_t b = 0; b < blocks; b++)
+        {
+            _hits.insert(_hits.end(), _block_hits[b].begin(), _block_hits[b].end());
+        }
+
+        // Return the collision list
+        return _hits;
+    }
+    inline const std::vector<std::pair<K, K>> &get_collisions(const vec<T> &point) const
+    {
+        // Output vector
+        _hits.clear();
+
+        // Check if grid is not built yet
+        if (_nodes.size() == 0)
+        {
+            return _hits;
+        }
+
+        // Get the occupied cell from the clamped point
+        const size_t index = find(get_key(clamp_bounds(point)));
+        if (index != empty())
+        {
+            // Get the intersecting pairs in this cell
+            _hits.reserve(_nodes[index].size());
+            const auto f = [this](const K a, const K b) {
+                this->_hits.emplace_back(a, b);
+            };
+            get_pairs(_nodes[index], false, f);
+        }
+
+        // Return the collision list
+        return _hits;
+    }
+    inline const std::vector<std::pair<K, vec<T>>> &get_collisions(const ray<T, vec> &r) const
+    {
+        // Output vector
+        _ray_hits.clear();
+
+        // Check if grid is not built yet
+        if (_nodes.size() == 0)
+        {
+            return _ray_hits;
+        }
+
+        // Get the cell from the ray origin
+        const vec<T> origin = clamp_bounds(r.get_origin());
+        get_ray_intersect(get_key(origin), r);
+
+        // If we found shapes return early
+        if (_ray_hits.size() > 0)
+        {
+            return _ray_hits;
+        }
+
+        // This function computes the ray lengths along the grid cell
+        auto grid_ray = vec<T>::grid_ray(_root.get_min(), _cell_extent, origin, r.get_direction(), r.get_inverse());
+
+        // Get the grid cell of ray origin
+        auto grid_index = vec<T>::grid_index(_root.get_min(), _cell_extent, origin);
+
+        // While we didn't hit anything in the grid
+        bool bad_flag = false;
+        while (_ray_hits.size() == 0 && !bad_flag)
+        {
+            // Find the next cell along the ray to test, bad flag signals that we have hit the last valid cell
+            const size_t next = vec<T>::grid_ray_next(grid_index, grid_ray, bad_flag, _scale);
+            if (bad_flag)
+            {
+                return _ray_hits;
+            }
+
+            // Get the intersecting shapes in this cell if occupied
+            get_ray_intersect(next, r);
+        }
+
+        // Return the collision list
+        return _ray_hits;
+    }
+    inline const std::vector<K> &get_index_map() const
+    {
+        return _index_map;
+    }
+    inline const vec<T> &get_lower_bound() const
+    {
+        return _lower_bound;
+    }
+    inline const vec<T> &get_upper_bound() const
+    {
+        return _upper_bound;
+    }
+    inline K get_scale() const
+    {
+        return static_cast<K>(_scale);
+    }
+    inline const std::vector<std::pair<K, K>> &get_overlap(const shape<T, vec> &overlap) const
+    {
+        // Output vector
+        _hits.clear();
+
+        // Get the overlapping shapes in every occupied cell of the overlapping region
+        for_each_overlap(overlap, [this](const K key) {
+            this->_hits.emplace_back(key, 0);
+        });
+
+        // Return the overlap list
+        return _hits;
+    }
+    inline const std::vector<shape<T, vec>> &get_shapes()
+    {
+        return _shapes;
+    }
+    inline bool inside(const vec<T> &point) const
+    {
+        return _root.point_inside(point);
+    }
+    inline void insert(const std::vector<shape<T, vec>> &shapes)
+    {
+        if (shapes.size() > 0)
+        {
+            // Set the grid scale
+            scale(shapes);
+
+            // Sort the shape array and store copy
+            sort(shapes);
+
+            // Rebuild the grid after changing the contents
+            build();
+        }
+    }
+    inline void insert(thread_pool &pool, const std::vector<shape<T, vec>> &shapes)
+    {
+        // Cells are allocated on first touch in the table, build is serial
+        insert(shapes);
+    }
+    inline void insert(const std::vector<shape<T, vec>> &shapes, const K depth)
+    {
+        if (shapes.size() > 0)
+        {
+            // Set the grid scale from depth
+            set_scale(depth);
+
+            // Sort the shape array and store copy
+            sort(shapes);
+
+            // Rebuild the grid after changing the contents
+            build();
+        }
+    }
+    inline void insert_no_sort(const std::vector<shape<T, vec>> &shapes)
+    {
+        if (shapes.size() > 0)
+        {
+            // Set the grid scale
+            scale(shapes);
+
+            // Insert shapes without sorting
+            _shapes.clear();
+            _shapes.insert(_shapes.end(), shapes.begin(), shapes.end());
+
+            // Rebuild the grid after changing the contents
+            build();
+        }
+    }
+    inline const std::vector<K> &point_inside(const vec<T> &point) const
+    {
+        // Output vector
+        _point_keys.clear();
+
+        // Check if grid is not built yet
+        if (_nodes.size() == 0)
+        {
+            return _point_keys;
+        }
+
+        // Copy the keys on the occupied cell
+        const size_t index = find(get_key(clamp_bounds(point)));
+        if (index != empty())
+        {
+            const hash_grid_node<T, K, L, vec, cell, shape> &node = _nodes[index];
+            const auto begin = _keys.begin() + node.get_offset();
+            _point_keys.assign(begin, begin + node.size());
+        }
+
+        return _point_keys;
+    }
+    inline void resize(const cell<T, vec> &c)
+    {
+        _root = c;
+        _lower_bound = _root.get_min() + var<T>::TOL_PHYS_EDGE;
+        _upper_bound = _root.get_max() - var<T>::TOL_PHYS_EDGE;
+    }
+    inline void update(const std::vector<shape<T, vec>> &shapes, const std::vector<K> &moved)
+    {
+        // Occupied cells are rebuilt from scratch, there are no empty cells to reset
+        insert(shapes);
+    }
+};
+}
+
+#endif
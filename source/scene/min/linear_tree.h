@@ -0,0 +1,697 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_LINEAR_TREE_MGL_
+#define _MGL_LINEAR_TREE_MGL_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <min/intersect.h>
+#include <min/ray.h>
+#include <min/sort.h>
+#include <min/utility.h>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The shape class must fulfill the following interface to be inserted into the spatial structure
+// shape.get_center()
+// shape.get_min()
+// shape.get_max()
+// shape.square_size()
+// intersect(shape, shape)
+
+// A pointerless octree, or quadtree in 2D, stored as flat arrays in morton order
+// Every shape is stored once in the smallest node holding its bounds, a node is a morton key prefix
+// Nodes are nested or disjoint, so intersecting shapes always have nested nodes
+
+namespace min
+{
+
+template <typename T, typename K, typename L, template <typename> class vec, template <typename, template <typename> class> class cell, template <typename, template <typename> class> class shape>
+class linear_tree
+{
+  private:
+    std::vector<shape<T, vec>> _shapes;
+    std::vector<K> _index_map;
+    std::vector<size_t> _code_cache;
+    std::vector<size_t> _low_cache;
+    std::vector<size_t> _high_cache;
+    std::vector<uint_fast8_t> _level_cache;
+    std::vector<size_t> _order;
+    std::vector<size_t> _copy;
+    std::vector<K> _keys;
+    std::vector<size_t> _codes;
+    std::vector<size_t> _lows;
+    std::vector<size_t> _highs;
+    std::vector<uint_fast8_t> _levels;
+    mutable std::vector<std::pair<K, K>> _hits;
+    mutable std::vector<std::pair<K, vec<T>>> _ray_hits;
+    mutable std::vector<K> _point_keys;
+    cell<T, vec> _root;
+    vec<T> _cell_extent;
+    vec<T> _lower_bound;
+    vec<T> _upper_bound;
+    size_t _axis_masks[vec<T>::morton_width()];
+    K _depth;
+    K _scale;
+
+    inline static constexpr size_t max_depth()
+    {
+        // Deepest level whose morton keys fit in size_t, 63 bit keys in 3D with a 64 bit size_t and 30 bit keys with a 32 bit size_t
+        return (std::numeric_limits<size_t>::digits - 1) / vec<T>::morton_width();
+    }
+    inline static size_t node_mask(const size_t level)
+    {
+        // Low key bits of the leaves inside a node 'level' levels above the leaves
+        return (static_cast<size_t>(0x1) << (vec<T>::morton_width() * level)) - 1;
+    }
+    inline size_t node_end(const size_t i) const
+    {
+        // Last leaf key inside the node of entry i
+        return _codes[i] | node_mask(_levels[i]);
+    }
+    inline void node_bounds(const size_t i, vec<T> &min, vec<T> &max) const
+    {
+        // The node of entry i spans 2^level leaf cells on each axis
+        min = vec<T>::morton_min(_root.get_min(), _cell_extent, _codes[i]);
+        max = min + _cell_extent * static_cast<T>(static_cast<size_t>(0x1) << _levels[i]);
+    }
+    inline bool node_overlap(const size_t code, const size_t level, const size_t low, const size_t high) const
+    {
+        // Masking a morton key to one axis keeps the order along that axis, so compare the cell range of each axis
+        const size_t end = code | node_mask(level);
+        for (size_t i = 0; i < vec<T>::morton_width(); i++)
+        {
+            const size_t mask = _axis_masks[i];
+            if ((code & mask) > (high & mask) || (end & mask) < (low & mask))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+    inline size_t get_code(const vec<T> &min, const vec<T> &max, uint_fast8_t &level, size_t &low, size_t &high) const
+    {
+        // Morton keys of the leaves holding the box corners
+        const vec<T> &lower = _root.get_min();
+        low = vec<T>::morton_key(lower, _cell_extent, _scale, clamp_bounds(min));
+        high = vec<T>::morton_key(lower, _cell_extent, _scale, clamp_bounds(max));
+
+        // The smallest node holding both corners is the common prefix of their keys
+        const size_t a = low;
+        const size_t diff = a ^ high;
+        level = 0;
+        while ((diff >> (vec<T>::morton_width() * level)) != 0)
+        {
+            level++;
+        }
+
+        return a & ~node_mask(level);
+    }
+    template <typename F>
+    inline void get_inside(size_t i, const size_t end, const size_t level, const size_t low, const size_t high, F &f) const
+    {
+        // Call f(i) for every entry from i with a key up to end whose node overlaps the leaves from low to high
+        // Nodes below 'level' missing those leaves are skipped with everything inside them
+        const size_t size = _keys.size();
+        while (i < size && _codes[i] <= end)
+        {
+            // Find the largest node holding entry i that misses the leaves, entries are never split from their node
+            const size_t code = _codes[i];
+            size_t l = level;
+            while (l > _levels[i] && node_overlap(code & ~node_mask(l - 1), l - 1, low, high))
+            {
+                l--;
+            }
+
+            // Skip the missed node, the node of entry i is the last one tested
+            if (l > _levels[i])
+            {
+                const size_t last = code | node_mask(l - 1);
+                i = std::upper_bound(_codes.begin() + i, _codes.begin() + size, last) - _codes.begin();
+                continue;
+            }
+
+            f(i);
+            i++;
+        }
+    }
+    template <typename F>
+    inline void get_nested(const size_t code, const uint_fast8_t level, const size_t low, const size_t high, F &f) const
+    {
+        // Call f(i) for every entry whose node holds or is inside the query node
+        const auto first = _codes.begin();
+        const auto last = _codes.end();
+
+        // Nodes holding the query node start at the query key with the low bits cleared, root first
+        size_t prev = code;
+        for (size_t l = _depth; l > level; l--)
+        {
+            // Keys equal to the query key are searched below, each other key is searched once
+            const size_t parent = code & ~node_mask(l);
+            if (parent == code || parent == prev)
+            {
+                continue;
+            }
+            prev = parent;
+
+            // Entries at this key hold the query node if their node reaches it
+            for (auto it = std::lower_bound(first, last, parent); it != last && *it == parent; ++it)
+            {
+                const size_t i = it - first;
+                if (node_end(i) >= code)
+                {
+                    f(i);
+                }
+            }
+        }
+
+        // Nodes inside the query node are contiguous in morton order
+        const size_t begin = std::lower_bound(first, last, code) - first;
+        get_inside(begin, code | node_mask(level), level, low, high, f);
+    }
+    template <typename F>
+    inline void get_overlap(const vec<T> &min, const vec<T> &max, F &f) const
+    {
+        // Find the node of the overlap box
+        uint_fast8_t level;
+        size_t low, high;
+        const size_t code = get_code(min, max, level, low, high);
+
+        // Visit the shapes in nested nodes with overlapping bounds
+        const auto g = [this, &min, &max, &f](const size_t i) {
+            const K key = this->_keys[i];
+            const shape<T, vec> &s = this->_shapes[key];
+            if (s.get_min() <= max && s.get_max() >= min)
+            {
+                f(key);
+            }
+        };
+        get_nested(code, level, low, high, g);
+    }
+    template <typename F>
+    inline void get_pairs(F &f) const
+    {
+        // Every later entry with a key up to the last leaf key of an entry is inside its node
+        // Each nested pair is seen once from the entry that comes first in morton order
+        const size_t size = _keys.size();
+        for (size_t i = 0; i < size; i++)
+        {
+            const K key = _keys[i];
+            const auto g = [this, key, &f](const size_t j) {
+                // Prefer a < b
+                K a = key;
+                K b = this->_keys[j];
+                if (a > b)
+                {
+                    a = b;
+                    b = key;
+                }
+
+                // Get the two shapes
+                const shape<T, vec> &a_shape = this->_shapes[a];
+                const shape<T, vec> &b_shape = this->_shapes[b];
+                if (intersect(a_shape, b_shape))
+                {
+                    f(a, b);
+                }
+            };
+
+            // Only visit the nodes inside this node that overlap the leaves of this shape
+            get_inside(i + 1, node_end(i), _levels[i], _lows[i], _highs[i], g);
+        }
+    }
+    inline size_t skip_node(const size_t i) const
+    {
+        // Entries after i up to its last leaf key are inside its node, return the first entry past them
+        return std::upper_bound(_codes.begin() + i, _codes.end(), node_end(i)) - _codes.begin();
+    }
+    inline void get_closest_hit(const ray<T, vec> &r, T &best, bool &found, K &key, vec<T> &point) const
+    {
+        // Entries are in depth first order, nodes come before the nodes inside them
+        const size_t size = _keys.size();
+        vec<T> min, max, p;
+        for (size_t i = 0; i < size;)
+        {
+            // Skip the node and everything inside it if the ray enters past the nearest hit
+            node_bounds(i, min, max);
+            T t;
+            if (!ray_entry(min, max, r, t) || t > best)
+            {
+                i = skip_node(i);
+                continue;
+            }
+
+            // Perform an N intersection test for all shapes in this node against the ray, keeping the nearest hit
+            const size_t code = _codes[i];
+            const uint_fast8_t level = _levels[i];
+            for (; i < size && _codes[i] == code && _levels[i] == level; i++)
+            {
+                const K k = _keys[i];
+                if (intersect(_shapes[k], r, p))
+                {
+                    // Distance along the ray to the hit
+                    const T d = (p - r.get_origin()).dot(r.get_direction());
+                    if (d <= best)
+                    {
+                        best = d;
+                        found = true;
+                        key = k;
+                        point = p;
+                    }
+                }
+            }
+        }
+    }
+    inline void get_ray_intersect(const ray<T, vec> &r) const
+    {
+        // Entries are in depth first order, nodes come before the nodes inside them
+        const size_t size = _keys.size();
+        vec<T> min, max, p;
+        for (size_t i = 0; i < size;)
+        {
+            // Skip the node and everything inside it if the ray misses it
+            node_bounds(i, min, max);
+            T t;
+            if (!ray_entry(min, max, r, t))
+            {
+                i = skip_node(i);
+                continue;
+            }
+
+            // Perform an N intersection test for all shapes in this node against the ray
+            const size_t code = _codes[i];
+            const uint_fast8_t level = _levels[i];
+            for (; i < size && _codes[i] == code && _levels[i] == level; i++)
+            {
+                const K k = _keys[i];
+                if (intersect(_shapes[k], r, p))
+                {
+                    _ray_hits.emplace_back(k, p);
+                }
+            }
+        }
+    }
+    inline void set_scale(const K depth)
+    {
+        // Set the tree cell scale 2^depth, keys must fit in K and in a size_t morton key
+        const size_t bits = std::min(static_cast<size_t>(std::numeric_limits<K>::digits - 1), max_depth());
+        _depth = static_cast<K>(std::min(bits, static_cast<size_t>(depth)));
+
+        // Set the tree cell extent
+        _scale = static_cast<K>(0x1 << _depth);
+        _cell_extent = _root.get_extent() / static_cast<T>(_scale);
+    }
+    inline void scale(const std::vector<shape<T, vec>> &shapes)
+    {
+        // square distance across the extent
+        T max = shapes[0].square_size();
+
+        // Calculate the maximum square distance across each extent
+        const K size = shapes.size();
+        for (K i = 1; i < size; i++)
+        {
+            // Update the maximum
+            const T d2 = shapes[i].square_size();
+            if (d2 > max)
+            {
+                max = d2;
+            }
+        }
+
+        // Calculate the world cell extent
+        const T d2 = std::sqrt(_root.square_size());
+        max = std::sqrt(max);
+
+        // Calculate the depth of the tree
+        const K depth = static_cast<K>(std::ceil(std::log2(d2 / max)));
+
+        // Set the scale from depth
+        set_scale(depth);
+    }
+    inline void sort_codes(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Cache the node of every shape
+        const size_t size = shapes.size();
+        _code_cache.resize(size);
+        _level_cache.resize(size);
+        _low_cache.resize(size);
+        _high_cache.resize(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            _code_cache[i] = get_code(shapes[i].get_min(), shapes[i].get_max(), _level_cache[i], _low_cache[i], _high_cache[i]);
+        }
+
+        // Counting sort the shapes by level, largest nodes first
+        size_t counts[std::numeric_limits<size_t>::digits + 1] = {};
+        for (const uint_fast8_t level : _level_cache)
+        {
+            counts[_depth - level]++;
+        }
+        size_t total = 0;
+        for (size_t &count : counts)
+        {
+            const size_t old_count = count;
+            count = total;
+            total += old_count;
+        }
+        _order.resize(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            _order[counts[_depth - _level_cache[i]]++] = i;
+        }
+
+        // Use uint radix sort for sorting keys, nodes sharing a key keep the largest nodes first
+        uint_sort<size_t>(_order, _copy, [this](const size_t a) {
+            return this->_code_cache[a];
+        });
+
+        // Small inputs are not sorted stable, so restore the largest first order between equal keys
+        for (size_t i = 1; i < size; i++)
+        {
+            const size_t o = _order[i];
+            size_t j = i;
+            for (; j > 0 && _code_cache[_order[j - 1]] == _code_cache[o] && _level_cache[_order[j - 1]] < _level_cache[o]; j--)
+            {
+                _order[j] = _order[j - 1];
+            }
+            _order[j] = o;
+        }
+
+        // Store the nodes in sorted order
+        _codes.resize(size);
+        _lows.resize(size);
+        _highs.resize(size);
+        _levels.resize(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            const size_t o = _order[i];
+            _codes[i] = _code_cache[o];
+            _lows[i] = _low_cache[o];
+            _highs[i] = _high_cache[o];
+            _levels[i] = _level_cache[o];
+        }
+    }
+    inline void sort(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Sort the nodes in morton order
+        sort_codes(shapes);
+
+        // Store the shapes in morton order, the index map converts keys back to insertion order
+        const size_t size = shapes.size();
+        _index_map.resize(size);
+        _keys.resize(size);
+        _shapes.clear();
+        _shapes.reserve(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            _index_map[i] = static_cast<K>(_order[i]);
+            _keys[i] = static_cast<K>(i);
+            _shapes.emplace_back(shapes[_order[i]]);
+        }
+    }
+    inline void no_sort(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Sort the nodes in morton order
+        sort_codes(shapes);
+
+        // Keys are insertion order
+        const size_t size = shapes.size();
+        _keys.resize(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            _keys[i] = static_cast<K>(_order[i]);
+        }
+
+        // Insert shapes without sorting
+        _shapes.clear();
+        _shapes.reserve(size);
+        _shapes.insert(_shapes.end(), shapes.begin(), shapes.end());
+    }
+
+  public:
+    linear_tree(const cell<T, vec> &c)
+        : _root(c),
+          _lower_bound(_root.get_min() + var<T>::TOL_PHYS_EDGE),
+          _upper_bound(_root.get_max() - var<T>::TOL_PHYS_EDGE),
+          _depth(0), _scale(0)
+    {
+        // Bits of each axis in a morton key, x is the most significant bit of each level
+        const size_t width = vec<T>::morton_width();
+        for (size_t i = 0; i < width; i++)
+        {
+            _axis_masks[i] = 0;
+            for (size_t d = 0; d < max_depth(); d++)
+            {
+                _axis_masks[i] |= static_cast<size_t>(0x1) << (d * width + width - 1 - i);
+            }
+        }
+    }
+    inline void resize(const cell<T, vec> &c)
+    {
+        _root = c;
+        _lower_bound = _root.get_min() + var<T>::TOL_PHYS_EDGE;
+        _upper_bound = _root.get_max() - var<T>::TOL_PHYS_EDGE;
+    }
+    inline void check_size(const std::vector<shape<T, vec>> &shapes) const
+    {
+        // Check size of the number of objects to insert into tree
+        if (shapes.size() > std::numeric_limits<K>::max() - 1)
+        {
+            throw std::runtime_error("linear_tree(): too many objects to insert, max supported is " + std::to_string(std::numeric_limits<K>::max()));
+        }
+    }
+    inline vec<T> clamp_bounds(const vec<T> &point) const
+    {
+        return vec<T>(point).clamp(_lower_bound, _upper_bound);
+    }
+    template <typename F>
+    inline void for_each_collision(F &&f) const
+    {
+        // Call f(a, b) with a < b for every intersecting pair, each pair is reported once
+        get_pairs(f);
+    }
+    template <typename F>
+    inline void for_each_overlap(const shape<T, vec> &overlap, F &&f) const
+    {
+        // Check if tree is not built yet
+        if (_keys.size() == 0)
+        {
+            return;
+        }
+
+        // Call f(key) for every shape with bounds overlapping the shape
+        get_overlap(overlap.get_min(), overlap.get_max(), f);
+    }
+    inline const std::vector<std::pair<K, K>> &get_collisions() const
+    {
+        // Clear out the old collision vector
+        _hits.clear();
+        _hits.reserve(_shapes.size());
+
+        // get all intersecting pairs
+        for_each_collision([this](const K a, const K b) {
+            this->_hits.emplace_back(a, b);
+        });
+
+        // Return the list
+        return _hits;
+    }
+    inline const std::vector<std::pair<K, K>> &get_collisions(const vec<T> &point) const
+    {
+        // Clear out the old collision vector
+        _hits.clear();
+
+        // Perform an N^2-N intersection test for all shapes in nodes holding the point
+        const std::vector<K> &keys = point_inside(point);
+        const size_t size = keys.size();
+        for (size_t i = 0; i < size; i++)
+        {
+            for (size_t j = i + 1; j < size; j++)
+            {
+                // Prefer a < b
+                K a = keys[i];
+                K b = keys[j];
+                if (a > b)
+                {
+                    a = keys[j];
+                    b = keys[i];
+                }
+
+                // Get the two shapes
+                if (intersect(_shapes[a], _shapes[b]))
+                {
+                    _hits.emplace_back(a, b);
+                }
+            }
+        }
+
+        // Return the list
+        return _hits;
+    }
+    inline const std::vector<std::pair<K, vec<T>>> &get_collisions(const ray<T, vec> &r) const
+    {
+        // Output vector
+        _ray_hits.clear();
+
+        // Get every shape intersecting ray
+        get_ray_intersect(r);
+
+        // Return the collision list
+        return _ray_hits;
+    }
+    inline bool get_closest_hit(const ray<T, vec> &r, const T t_max, K &key, vec<T> &point) const
+    {
+        // Get the nearest shape intersecting ray, pruning nodes past the nearest hit
+        T best = t_max;
+        bool found = false;
+        get_closest_hit(r, best, found, key, point);
+
+        return found;
+    }
+    inline K get_depth() const
+    {
+        return _depth;
+    }
+    inline const std::vector<K> &get_index_map() const
+    {
+        return _index_map;
+    }
+    inline const std::vector<std::pair<K, K>> &get_overlap(const shape<T, vec> &overlap) const
+    {
+        // Clear out the old collision vector
+        _hits.clear();
+
+        // Get the overlapping shapes
+        for_each_overlap(overlap, [this](const K key) {
+            this->_hits.emplace_back(key, 0);
+        });
+
+        // Return the list
+        return _hits;
+    }
+    inline const vec<T> &get_lower_bound() const
+    {
+        return _lower_bound;
+    }
+    inline const vec<T> &get_upper_bound() const
+    {
+        return _upper_bound;
+    }
+    inline K get_scale() const
+    {
+        return _scale;
+    }
+    inline const std::vector<shape<T, vec>> &get_shapes()
+    {
+        return _shapes;
+    }
+    inline bool inside(const vec<T> &point) const
+    {
+        return _root.point_inside(point);
+    }
+    inline void insert(const std::vector<shape<T, vec>> &shapes)
+    {
+        const size_t size = shapes.size();
+        if (size > 0)
+        {
+            // Set the tree depth
+            scale(shapes);
+
+            // Process and sort shapes by morton key
+            sort(shapes);
+        }
+    }
+    inline void insert(const std::vector<shape<T, vec>> &shapes, const K depth)
+    {
+        const size_t size = shapes.size();
+        if (size > 0)
+        {
+            // Set the scale from depth
+            set_scale(depth);
+
+            // Process and sort shapes by morton key
+            sort(shapes);
+        }
+    }
+    inline void insert_no_sort(const std::vector<shape<T, vec>> &shapes)
+    {
+        const size_t size = shapes.size();
+        if (size > 0)
+        {
+            // Set the tree depth
+            scale(shapes);
+
+            // Process but do not sort shapes
+            no_sort(shapes);
+        }
+    }
+    inline void radius_query(const vec<T> &point, const T radius, std::vector<K> &out) const
+    {
+        // Output vector
+        out.clear();
+
+        // Check if tree is not built yet
+        if (_keys.size() == 0)
+        {
+            return;
+        }
+
+        // Get the shapes with centers inside the sphere
+        const T r2 = radius * radius;
+        const auto f = [this, &point, r2, &out](const K key) {
+            const vec<T> d = this->_shapes[key].get_center() - point;
+            if (d.dot(d) <= r2)
+            {
+                out.push_back(key);
+            }
+        };
+        get_overlap(point - radius, point + radius, f);
+    }
+    inline void update(const std::vector<shape<T, vec>> &shapes, const std::vector<K> &moved)
+    {
+        // The tree has no incremental update, rebuild it
+        insert(shapes);
+    }
+    inline const std::vector<K> &point_inside(const vec<T> &point) const
+    {
+        // Output vector
+        _point_keys.clear();
+
+        // Check if tree is not built yet
+        if (_keys.size() == 0)
+        {
+            return _point_keys;
+        }
+
+        // Get the keys in every node holding the leaf of the point
+        uint_fast8_t level;
+        size_t low, high;
+        const vec<T> clamped = clamp_bounds(point);
+        const size_t code = get_code(clamped, clamped, level, low, high);
+        const auto f = [this](const size_t i) {
+            this->_point_keys.push_back(this->_keys[i]);
+        };
+        get_nested(code, level, low, high, f);
+
+        return _point_keys;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,684 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_MULTI_GRID_MGL_
+#define _MGL_MULTI_GRID_MGL_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <min/intersect.h>
+#include <min/ray.h>
+#include <min/sort.h>
+#include <min/thread_pool.h>
+#include <min/utility.h>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The shape class must fulfill the following interface to be inserted into the spatial structure
+// shape.get_center()
+// shape.get_min()
+// shape.get_max()
+// shape.square_size()
+// intersect(shape, shape)
+
+namespace min
+{
+
+// Stack of grids over the world cell, each level has half the scale of the level below it
+// Shapes are stored on the level whose cells match their size, so small shapes never share cells sized for large shapes
+template <typename T, typename K, typename L, template <typename> class vec, template <typename, template <typename> class> class cell, template <typename, template <typename> class> class shape>
+class multi_grid
+{
+  private:
+    std::vector<shape<T, vec>> _shapes;
+    std::vector<size_t> _offsets;
+    std::vector<K> _keys;
+    std::vector<K> _level;
+    std::vector<size_t> _owner;
+    std::vector<size_t> _scales;
+    std::vector<vec<T>> _extents;
+    std::vector<size_t> _base;
+    std::vector<K> _counts;
+    std::vector<K> _index_map;
+    std::vector<size_t> _key_cache;
+    std::vector<K> _sort_copy;
+    mutable std::vector<K> _point_keys;
+    mutable std::vector<std::pair<K, K>> _hits;
+    mutable std::vector<std::vector<std::pair<K, K>>> _block_hits;
+    mutable std::vector<std::pair<K, vec<T>>> _ray_hits;
+    cell<T, vec> _root;
+    vec<T> _lower_bound;
+    vec<T> _upper_bound;
+
+    inline void build()
+    {
+        // Break out if there are no levels
+        const size_t levels = _scales.size();
+        if (levels == 0)
+        {
+            return;
+        }
+
+        // Allocate cells only on levels that hold shapes
+        size_t cells = 0;
+        _base.resize(levels);
+        for (size_t l = 0; l < levels; l++)
+        {
+            _base[l] = cells;
+            if (_counts[l] > 0)
+            {
+                // The center of the last cell has the largest key on this level
+                cells += vec<T>::grid_key(_root.get_min(), _extents[l], _scales[l], _root.get_max() - _extents[l] * 0.5) + 1;
+            }
+        }
+
+        // Clear the cell counts
+        _offsets.assign(cells + 1, 0);
+
+        // Count the keys in each cell
+        const K size = _shapes.size();
+        _owner.resize(size);
+        for (K i = 0; i < size; i++)
+        {
+            // Callback function
+            const K l = _level[i];
+            bool first = true;
+            const auto f = [this, i, l, &first](const size_t key) {
+                this->_offsets[this->_base[l] + key + 1]++;
+
+                // The first cell in range is the lowest corner of the cell range
+                if (first)
+                {
+                    this->_owner[i] = key;
+                    first = false;
+                }
+            };
+
+            // Do callback on range of cells the shape overlaps on its level
+            const auto &b = _shapes[i];
+            vec<T>::grid_range(_root.get_min(), _extents[l], _scales[l], clamp_bounds(b.get_min()), clamp_bounds(b.get_max()), f);
+        }
+
+        // Prefix sum the cell counts into offsets in the key array
+        for (size_t n = 0; n < cells; n++)
+        {
+            _offsets[n + 1] += _offsets[n];
+        }
+        _keys.resize(_offsets[cells]);
+
+        // Fill the key array, keys in each cell stay in ascending order
+        for (K i = 0; i < size; i++)
+        {
+            // Callback function
+            const K l = _level[i];
+            const auto f = [this, i, l](const size_t key) {
+                this->_keys[this->_offsets[this->_base[l] + key]++] = i;
+            };
+
+            // Do callback on range of cells the shape overlaps on its level
+            const auto &b = _shapes[i];
+            vec<T>::grid_range(_root.get_min(), _extents[l], _scales[l], clamp_bounds(b.get_min()), clamp_bounds(b.get_max()), f);
+        }
+
+        // Filling advanced each offset to the start of the next cell, shift them back
+        for (size_t n = cells; n > 0; n--)
+        {
+            _offsets[n] = _offsets[n - 1];
+        }
+        _offsets[0] = 0;
+    }
+    inline K get_depth(const T world, const T size) const
+    {
+        // Calculate 2^n, (28.284/8.48) == 4, 2^4 = 16
+        const T ratio = std::max(std::log2(world / size), static_cast<T>(0.0));
+        return static_cast<K>(std::ceil(ratio));
+    }
+    template <typename F>
+    inline void get_pairs(const K a, F &f) const
+    {
+        const shape<T, vec> &a_shape = _shapes[a];
+        const vec<T> min = clamp_bounds(a_shape.get_min());
+        const vec<T> max = clamp_bounds(a_shape.get_max());
+
+        // Test shapes on the same level with a higher index
+        const K level = _level[a];
+        const size_t owner = _owner[a];
+        const auto same = [this, a, &a_shape, level, owner, &f](const size_t key) {
+            const size_t begin = this->_offsets[this->_base[level] + key];
+            const size_t end = this->_offsets[this->_base[level] + key + 1];
+            for (size_t i = begin; i < end; i++)
+            {
+                // Only the lowest cell shared by both shapes reports the pair
+                const K b = this->_keys[i];
+                if (b > a && vec<T>::grid_owner(owner, this->_owner[b], this->_scales[level]) == key)
+                {
+                    if (intersect(a_shape, this->_shapes[b]))
+                    {
+                        f(a, b);
+                    }
+                }
+            }
+        };
+        vec<T>::grid_range(_root.get_min(), _extents[level], _scales[level], min, max, same);
+
+        // Walk up the levels to test against all larger shapes
+        const size_t levels = _scales.size();
+        for (size_t l = level + 1; l < levels; l++)
+        {
+            // Skip empty levels
+            if (_counts[l] == 0)
+            {
+                continue;
+            }
+
+            // Callback function
+            size_t up = 0;
+            bool first = true;
+            const auto cross = [this, a, &a_shape, l, &up, &first, &f](const size_t key) {
+                // The first cell in range is the lowest corner of the cell range on this level
+                if (first)
+                {
+                    up = key;
+                    first = false;
+                }
+
+                const size_t begin = this->_offsets[this->_base[l] + key];
+                const size_t end = this->_offsets[this->_base[l] + key + 1];
+                for (size_t i = begin; i < end; i++)
+                {
+                    // Only the lowest cell shared by both shapes reports the pair
+                    const K b = this->_keys[i];
+                    if (vec<T>::grid_owner(up, this->_owner[b], this->_scales[l]) == key)
+                    {
+                        if (intersect(a_shape, this->_shapes[b]))
+                        {
+                            // Prefer a < b
+                            f(std::min(a, b), std::max(a, b));
+                        }
+                    }
+                }
+            };
+
+            // Do callback on range of cells the shape overlaps on this level
+            vec<T>::grid_range(_root.get_min(), _extents[l], _scales[l], min, max, cross);
+        }
+    }
+    inline void get_ray_intersect(const size_t level, const size_t key, const ray<T, vec> &r) const
+    {
+        // Perform an N intersection test for all shapes in this cell against the ray
+        const size_t begin = _offsets[_base[level] + key];
+        const size_t end = _offsets[_base[level] + key + 1];
+        vec<T> point;
+        for (size_t i = begin; i < end; i++)
+        {
+            const K k = _keys[i];
+            const shape<T, vec> &s = _shapes[k];
+            if (intersect(s, r, point))
+            {
+                _ray_hits.emplace_back(k, point);
+            }
+        }
+    }
+    inline void set_levels(const std::vector<shape<T, vec>> &shapes, const K depth)
+    {
+        // Calculate the world cell extent
+        const T world = std::sqrt(_root.square_size());
+
+        // Each shape goes on the level where cells are the size of the shape
+        const K size = shapes.size();
+        K top = 0;
+        _level.resize(size);
+        for (K i = 0; i < size; i++)
+        {
+            const T extent = std::sqrt(shapes[i].square_size());
+            const K level = depth - std::min(depth, get_depth(world, extent));
+            _level[i] = level;
+            top = std::max(top, level);
+        }
+
+        // Set the scale and cell extent of each level, level 0 has the finest cells
+        _scales.resize(top + 1);
+        _extents.resize(top + 1);
+        _counts.assign(top + 1, 0);
+        for (K l = 0; l <= top; l++)
+        {
+            _scales[l] = static_cast<size_t>(1) << (depth - l);
+            _extents[l] = _root.get_extent() / static_cast<T>(_scales[l]);
+        }
+
+        // Count the shapes on each level
+        for (K i = 0; i < size; i++)
+        {
+            _counts[_level[i]]++;
+        }
+    }
+    inline void scale(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Find the smallest object in the collection
+        // Square distance across the extent
+        T min = shapes[0].square_size();
+
+        // Calculate the minimum square distance across each extent
+        const K size = shapes.size();
+        for (K i = 1; i < size; i++)
+        {
+            // Update the minimum
+            const T d2 = shapes[i].square_size();
+            if (d2 < min)
+            {
+                min = d2;
+            }
+        }
+
+        // Finest level depth is set by the smallest object
+        const T world = std::sqrt(_root.square_size());
+        K depth = get_depth(world, std::sqrt(min));
+
+        // Optimize the finest level if there are too many items, like grid caps its scale
+        const size_t cap = static_cast<size_t>(std::ceil(std::cbrt(size)));
+        K bits = 0;
+        while ((static_cast<size_t>(1) << bits) < cap)
+        {
+            bits++;
+        }
+
+        // Set the levels from depth
+        set_levels(shapes, std::min(depth, bits));
+    }
+    inline void sort(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Create index vector to sort 0 to N
+        const K size = shapes.size();
+        _index_map.resize(size);
+        std::iota(_index_map.begin(), _index_map.end(), 0);
+
+        // Cache key calculation for sorting speed up, sort by the finest level cells
+        _key_cache.resize(size);
+        for (K i = 0; i < size; i++)
+        {
+            _key_cache[i] = vec<T>::grid_key(_root.get_min(), _extents[0], _scales[0], clamp_bounds(shapes[i].get_center()));
+        }
+
+        // use uint radix sort for sorting keys
+        // lambda function to create sorted array indices based on grid key
+        uint_sort<K>(_index_map, _sort_copy, [this](const K a) {
+            return this->_key_cache[a];
+        });
+
+        // Iterate over sorted indices and store sorted shapes and levels
+        _shapes.clear();
+        _shapes.reserve(size);
+        for (const K i : _index_map)
+        {
+            _shapes.emplace_back(shapes[i]);
+        }
+        _sort_copy.resize(size);
+        for (K i = 0; i < size; i++)
+        {
+            _sort_copy[i] = _level[_index_map[i]];
+        }
+        _level.swap(_sort_copy);
+    }
+
+  public:
+    multi_grid(const cell<T, vec> &c)
+        : _root(c),
+          _lower_bound(_root.get_min() + var<T>::TOL_PHYS_EDGE),
+          _upper_bound(_root.get_max() - var<T>::TOL_PHYS_EDGE) {}
+
+    inline void check_size(const std::vector<shape<T, vec>> &shapes) const
+    {
+        // Check size of the number of objects to insert into grid
+        if (shapes.size() > std::numeric_limits<K>::max() - 1)
+        {
+            throw std::runtime_error("multi_grid: too many objects to insert, max supported is " + std::to_string(std::numeric_limits<K>::max()));
+        }
+    }
+    inline vec<T> clamp_bounds(const vec<T> &point) const
+    {
+        return vec<T>(point).clamp(_lower_bound, _upper_bound);
+    }
+    template <typename F>
+    inline void for_each_collision(F &&f) const
+    {
+        // Call f(a, b) with a < b for every intersecting pair, each pair is reported once
+        const K size = _shapes.size();
+        for (K i = 0; i < size; i++)
+        {
+            get_pairs(i, f);
+        }
+    }
+    template <typename F>
+    inline void for_each_overlap(const shape<T, vec> &overlap, F &&f) const
+    {
+        // Check if grid is not built yet
+        if (_offsets.size() == 0)
+        {
+            return;
+        }
+
+        // Clamp overlap min and max to world edges
+        const vec<T> min = clamp_bounds(overlap.get_min());
+        const vec<T> max = clamp_bounds(overlap.get_max());
+
+        // Visit the overlapping cells on every level
+        const size_t levels = _scales.size();
+        for (size_t l = 0; l < levels; l++)
+        {
+            // Skip empty levels
+            if (_counts[l] == 0)
+            {
+                continue;
+            }
+
+            // Callback function
+            size_t min_key = 0;
+            bool first = true;
+            const auto g = [this, l, &min_key, &first, &f](const size_t key) {
+                // The first cell in range is the lowest corner of the overlap range
+                if (first)
+                {
+                    min_key = key;
+                    first = false;
+                }
+
+                const size_t begin = this->_offsets[this->_base[l] + key];
+                const size_t end = this->_offsets[this->_base[l] + key + 1];
+                for (size_t i = begin; i < end; i++)
+                {
+                    // Only the lowest cell shared with the overlap range reports this shape
+                    const K k = this->_keys[i];
+                    if (vec<T>::grid_owner(this->_owner[k], min_key, this->_scales[l]) == key)
+                    {
+                        f(k);
+                    }
+                }
+            };
+
+            // Do callback on range of cells in overlapping region
+            vec<T>::grid_range(_root.get_min(), _extents[l], _scales[l], min, max, g);
+        }
+    }
+    inline const std::vector<std::pair<K, K>> &get_collisions() const
+    {
+        // Output vector
+        _hits.clear();
+        _hits.reserve(_shapes.size());
+
+        // Calculate the intersection pairs for every shape against its own and larger levels
+        for_each_collision([this](const K a, const K b) {
+            this->_hits.emplace_back(a, b);
+        });
+
+        // Return the collision list
+        return _hits;
+    }
+    inline const std::vector<std::pair<K, K>> &get_collisions(thread_pool &pool) const
+    {
+        // Output vector
+        _hits.clear();
+
+        // Check if grid is not built yet
+        const size_t size = _shapes.size();
+        if (_offsets.size() == 0 || size == 0)
+        {
+            return _hits;
+        }
+
+        // Split the shapes into more blocks than threads to balance uneven cells
+        const size_t blocks = std::min(pool.get_thread_count() * 8, size);
+        if (_block_hits.size() < blocks)
+        {
+            _block_hits.resize(blocks);
+        }
+
+        // Calculate the intersection pairs for every shape, each block has its own hit buffer
+        const auto pairs = [this, size, blocks](std::mt19937 &gen, const size_t b) {
+            const size_t begin = (b * size) / blocks;
+            const size_t end = ((b + 1) * size) / blocks;
+            std::vector<std::pair<K, K>> &out = this->_block_hits[b];
+            out.clear();
+            const auto f = [&out](const K a, const K b) {
+                out.emplace_back(a, b);
+            };
+            for (size_t i = begin; i < end; i++)
+            {
+                this->get_pairs(static_cast<K>(i), f);
+            }
+        };
+        pool.run(std::cref(pairs), 0, blocks);
+
+        // Concatenate the hits in block order so the output is the same for any thread count
+        size_t hits = 0;
+        for (size_t b = 0; b < blocks; b++)
+        {
+            hits += _block_hits[b].size();
+        }
+        _hits.reserve(hits);
+        for (size_t b = 0; b < blocks; b++)
+        {
+            _hits.insert(_hits.end(), _block_hits[b].begin(), _block_hits[b].end());
+        }
+
+        // Return the collision list
+        return _hits;
+    }
+    inline const std::vector<std::pair<K, K>> &get_collisions(const vec<T> &point) const
+    {
+        // Output vector
+        _hits.clear();
+
+        // Get the shapes in the cell on every level that holds the point
+        const std::vector<K> &keys = point_inside(point);
+
+        // Perform an N^2-N intersection test for all shapes in these cells
+        const size_t size = keys.size();
+        for (size_t i = 0; i < size; i++)
+        {
+            for (size_t j = i + 1; j < size; j++)
+            {
+                // Prefer a < b
+                const K a = std::min(keys[i], keys[j]);
+                const K b = std::max(keys[i], keys[j]);
+                if (intersect(_shapes[a], _shapes[b]))
+                {
+                    _hits.emplace_back(a, b);
+                }
+            }
+        }
+
+        // Return the collision list
+        return _hits;
+    }
+    inline const std::vector<std::pair<K, vec<T>>> &get_collisions(const ray<T, vec> &r) const
+    {
+        // Output vector
+        _ray_hits.clear();
+
+        // Check if grid is not built yet
+        if (_offsets.size() == 0)
+        {
+            return _ray_hits;
+        }
+
+        // March the ray on every level until it hits a cell with shapes
+        const vec<T> origin = clamp_bounds(r.get_origin());
+        const size_t levels = _scales.size();
+        for (size_t l = 0; l < levels; l++)
+        {
+            // Skip empty levels
+            if (_counts[l] == 0)
+            {
+                continue;
+            }
+
+            // Get the cell from the ray origin
+            const size_t hits = _ray_hits.size();
+            get_ray_intersect(l, vec<T>::grid_key(_root.get_min(), _extents[l], _scales[l], origin), r);
+
+            // This function computes the ray lengths along the grid cell
+            auto grid_ray = vec<T>::grid_ray(_root.get_min(), _extents[l], origin, r.get_direction(), r.get_inverse());
+
+            // Get the grid cell of ray origin
+            auto grid_index = vec<T>::grid_index(_root.get_min(), _extents[l], origin);
+
+            // While we didn't hit anything on this level
+            bool bad_flag = false;
+            while (_ray_hits.size() == hits && !bad_flag)
+            {
+                // Find the next cell along the ray to test, bad flag signals that we have hit the last valid cell
+                const size_t next = vec<T>::grid_ray_next(grid_index, grid_ray, bad_flag, _scales[l]);
+                if (!bad_flag)
+                {
+                    get_ray_intersect(l, next, r);
+                }
+            }
+        }
+
+        // Return the collision list
+        return _ray_hits;
+    }
+    inline const std::vector<K> &get_index_map() const
+    {
+        return _index_map;
+    }
+    inline size_t get_levels() const
+    {
+        return _scales.size();
+    }
+    inline const vec<T> &get_lower_bound() const
+    {
+        return _lower_bound;
+    }
+    inline const vec<T> &get_upper_bound() const
+    {
+        return _upper_bound;
+    }
+    inline K get_scale() const
+    {
+        // Scale of the finest level
+        return (_scales.size() > 0) ? static_cast<K>(_scales[0]) : 0;
+    }
+    inline const std::vector<std::pair<K, K>> &get_overlap(const shape<T, vec> &overlap) const
+    {
+        // Output vector
+        _hits.clear();
+
+        // Get the overlapping shapes on every level
+        for_each_overlap(overlap, [this](const K key) {
+            this->_hits.emplace_back(key, 0);
+        });
+
+        // Return the overlap list
+        return _hits;
+    }
+    inline const std::vector<shape<T, vec>> &get_shapes()
+    {
+        return _shapes;
+    }
+    inline bool inside(const vec<T> &point) const
+    {
+        return _root.point_inside(point);
+    }
+    inline void insert(const std::vector<shape<T, vec>> &shapes)
+    {
+        if (shapes.size() > 0)
+        {
+            // Set the grid levels
+            scale(shapes);
+
+            // Sort the shape array and store copy
+            sort(shapes);
+
+            // Rebuild the grid after changing the contents
+            build();
+        }
+    }
+    inline void insert(thread_pool &pool, const std::vector<shape<T, vec>> &shapes)
+    {
+        // Level assignment is cheap, build is serial
+        insert(shapes);
+    }
+    inline void insert(const std::vector<shape<T, vec>> &shapes, const K depth)
+    {
+        if (shapes.size() > 0)
+        {
+            // Set the grid levels from the finest depth
+            set_levels(shapes, depth);
+
+            // Sort the shape array and store copy
+            sort(shapes);
+
+            // Rebuild the grid after changing the contents
+            build();
+        }
+    }
+    inline void insert_no_sort(const std::vector<shape<T, vec>> &shapes)
+    {
+        if (shapes.size() > 0)
+        {
+            // Set the grid levels
+            scale(shapes);
+
+            // Insert shapes without sorting
+            _shapes.clear();
+            _shapes.insert(_shapes.end(), shapes.begin(), shapes.end());
+
+            // Rebuild the grid after changing the contents
+            build();
+        }
+    }
+    inline const std::vector<K> &point_inside(const vec<T> &point) const
+    {
+        // Output vector
+        _point_keys.clear();
+
+        // Check if grid is not built yet
+        if (_offsets.size() == 0)
+        {
+            return _point_keys;
+        }
+
+        // Copy the keys of the cell holding the point on every level
+        const vec<T> p = clamp_bounds(point);
+        const size_t levels = _scales.size();
+        for (size_t l = 0; l < levels; l++)
+        {
+            if (_counts[l] > 0)
+            {
+                const size_t n = _base[l] + vec<T>::grid_key(_root.get_min(), _extents[l], _scales[l], p);
+                _point_keys.insert(_point_keys.end(), _keys.begin() + _offsets[n], _keys.begin() + _offsets[n + 1]);
+            }
+        }
+
+        return _point_keys;
+    }
+    inline void resize(const cell<T, vec> &c)
+    {
+        _root = c;
+        _lower_bound = _root.get_min() + var<T>::TOL_PHYS_EDGE;
+        _upper_bound = _root.get_max() - var<T>::TOL_PHYS_EDGE;
+    }
+    inline void update(const std::vector<shape<T, vec>> &shapes, const std::vector<K> &moved)
+    {
+        // Levels depend on shape size, rebuild from scratch
+        insert(shapes);
+    }
+};
+}
+
+#endif
@@ -41,6 +41,7 @@ limitations under the License.
 #include <functional>
 #include <min/intersect.h>
 #include <min/template_math.h>
+#include <min/thread_pool.h>
 #include <stdexcept>
 #include <vector>
 
@@ -400,9 +401,11 @@ class physics
     std::vector<shape<T, vec>> _shapes;
     std::vector<body<T, vec>> _bodies;
     std::vector<size_t> _dead;
+    std::vector<K> _moved;
     vec<T> _gravity;
     T _elasticity;
     bool _clean;
+    bool _rebuild;
 
     static constexpr T _collision_tolerance = 1E-4;
 
@@ -706,10 +709,54 @@ class physics
 
         // Update the shapes position
         shape<T, vec> &s = _shapes[index];
+        const vec<T> min = s.get_min();
+        const vec<T> max = s.get_max();
         s.set_position(b.get_position());
 
         // Rotate the shapes by the relative rotation
         rotate<T>(s, abs_rotation);
+
+        // Record shapes whose bounds changed for the next spatial update
+        const vec<T> &s_min = s.get_min();
+        const vec<T> &s_max = s.get_max();
+        if (!(min <= s_min && min >= s_min && max <= s_max && max >= s_max))
+        {
+            _moved.push_back(index);
+        }
+    }
+    inline void update_spatial()
+    {
+        // Rebuild the spatial structure if bodies were added or removed, or many bodies moved
+        if (_rebuild || _moved.size() * 4 > _shapes.size())
+        {
+            _spatial.insert(_shapes);
+        }
+        else
+        {
+            // Move only the shapes that changed bounds
+            _spatial.update(_shapes, _moved);
+        }
+
+        // Reset the moved bodies
+        _moved.clear();
+        _rebuild = false;
+    }
+    inline void update_spatial(thread_pool &pool)
+    {
+        // Rebuild the spatial structure in parallel if bodies were added or removed, or many bodies moved
+        if (_rebuild || _moved.size() * 4 > _shapes.size())
+        {
+            _spatial.insert(pool, _shapes);
+        }
+        else
+        {
+            // Move only the shapes that changed bounds
+            _spatial.update(_shapes, _moved);
+        }
+
+        // Reset the moved bodies
+        _moved.clear();
+        _rebuild = false;
     }
     inline void solve_integrals(const T dt, const T damping)
     {
@@ -724,7 +771,7 @@ class physics
   public:
     physics(const cell<T, vec> &world, const vec<T> &gravity)
         : _spatial(world),
-          _gravity(gravity), _elasticity(1.0f), _clean(true) {}
+          _gravity(gravity), _elasticity(1.0f), _clean(true), _rebuild(true) {}
 
     inline size_t add_body(const shape<T, vec> &s, const T mass, const size_t id = 0, const body_data data = nullptr)
     {
@@ -735,6 +782,9 @@ class physics
         shape<T, vec> in_s(s);
         in_s.set_position(center);
 
+        // Adding a body changes the shape set, rebuild the spatial structure
+        _rebuild = true;
+
         // If bodies can be recycled
         if (_dead.size() > 0)
         {
@@ -795,12 +845,18 @@ class physics
 
         // Clean the simulation
         _clean = true;
+        _rebuild = true;
     }
     inline bool collide(const size_t index, const shape<T, vec> &s)
     {
         // return whether we collided or not
         return collide_static(index, s);
     }
+    template <typename F>
+    inline void for_each_overlap(const shape<T, vec> &overlap, F &&f) const
+    {
+        _spatial.for_each_overlap(overlap, f);
+    }
     inline const body<T, vec> &get_body(const size_t index) const
     {
         return _bodies[index];
@@ -821,6 +877,14 @@ class physics
     {
         return _spatial.get_collisions(r);
     }
+    inline bool get_closest_hit(const ray<T, vec> &r, const T t_max, K &key, vec<T> &point) const
+    {
+        return _spatial.get_closest_hit(r, t_max, key, point);
+    }
+    inline const std::vector<std::pair<K, vec<T>>> &get_closest_hits(thread_pool &pool, const std::vector<ray<T, vec>> &rays, const T t_max) const
+    {
+        return _spatial.get_closest_hits(pool, rays, t_max);
+    }
     inline const vec<T> &get_gravity() const
     {
         return _gravity;
@@ -873,6 +937,7 @@ class physics
 
         // Flag that we cleaned up
         _clean = true;
+        _rebuild = true;
     }
     inline void register_callback(const size_t index, const std::function<void(body<T, vec> &, body<T, vec> &)> &f)
     {
@@ -889,15 +954,35 @@ class physics
     {
         if (_shapes.size() > 0)
         {
-            // Create the spatial partitioning structure based off rigid bodies
+            // Update the spatial partitioning structure based off rigid bodies
             // This reorders the shapes vector so we need to reorganize the shape and body data to reflect this!
-            _spatial.insert(_shapes);
+            update_spatial();
+
+            // Get the index map for reordering
+            const std::vector<K> &map = _spatial.get_index_map();
+
+            // Handle all collisions between objects as the intersecting shapes are found
+            _spatial.for_each_collision([this, &map](const K a, const K b) {
+                this->collide(map[a], map[b]);
+            });
+
+            // Solve the simulation
+            solve_integrals(dt, damping);
+        }
+    }
+    inline void solve(thread_pool &pool, const T dt, const T damping)
+    {
+        if (_shapes.size() > 0)
+        {
+            // Update the spatial partitioning structure in parallel
+            // This reorders the shapes vector so we need to reorganize the shape and body data to reflect this!
+            update_spatial(pool);
 
             // Get the index map for reordering
             const std::vector<K> &map = _spatial.get_index_map();
 
-            // Determine intersecting shapes for contact resolution
-            const std::vector<std::pair<K, K>> &collisions = _spatial.get_collisions();
+            // Determine intersecting shapes in parallel, the pair order doesn't depend on thread count
+            const std::vector<std::pair<K, K>> &collisions = _spatial.get_collisions(pool);
 
             // Handle all collisions between objects
             for (const auto &c : collisions)
@@ -913,6 +998,10 @@ class physics
     {
         // Solve the simulation
         solve_integrals(dt, damping);
+
+        // Moved bodies aren't tracked without collisions, rebuild next solve
+        _moved.clear();
+        _rebuild = true;
     }
     inline void solve_no_sort(const T dt, const T damping)
     {
@@ -922,14 +1011,14 @@ class physics
             // This doesn't reorder the shapes vector
             _spatial.insert_no_sort(_shapes);
 
-            // Determine intersecting shapes for contact resolution
-            const std::vector<std::pair<K, K>> &collisions = _spatial.get_collisions();
+            // The unsorted structure can't be updated, rebuild next solve
+            _moved.clear();
+            _rebuild = true;
 
-            // Handle all collisions between objects
-            for (const auto &c : collisions)
-            {
-                collide(c.first, c.second);
-            }
+            // Handle all collisions between objects as the intersecting shapes are found
+            _spatial.for_each_collision([this](const K a, const K b) {
+                this->collide(a, b);
+            });
 
             // Solve the simulation
             solve_integrals(dt, damping);
@@ -959,6 +1048,31 @@ class physics
 
         return 0.5f * KE2 + PE + AE;
     }
+    inline T get_total_energy(thread_pool &pool) const
+    {
+        // Calculate the energy of a single body
+        const auto energy = [this](std::mt19937 &gen, const size_t i) -> T {
+            const body<T, vec> &b = this->_bodies[i];
+
+            // Calculate kinetic energy = 0.5*mv^2
+            const vec<T> &v = b.get_linear_velocity();
+            const T m = b.get_mass();
+            const T KE = 0.5f * m * v.dot(v);
+
+            // Calculate the potential energy = -mgh
+            const T PE = m * this->_gravity.dot(this->_spatial.get_lower_bound() - b.get_position());
+
+            // Calculate the rotational energy
+            const auto I = b.get_inertia();
+            const auto w = b.get_angular_velocity();
+            const T AE = dot<T>(I * w, w);
+
+            return KE + PE + AE;
+        };
+
+        // Sum the energy of all bodies in parallel
+        return pool.parallel_reduce(energy, [](const T a, const T b) { return a + b; }, static_cast<T>(0.0), 0, _bodies.size());
+    }
     inline void set_elasticity(const T e)
     {
         _elasticity = e;
@@ -41,6 +41,7 @@ limitations under the License.
 #include <functional>
 #include <min/intersect.h>
 #include <min/template_math.h>
+#include <min/thread_pool.h>
 #include <stdexcept>
 #include <vector>
 
@@ -670,6 +671,11 @@ class physics
         // return whether we collided or not
         return collide_static(index, s);
     }
+    template <typename F>
+    inline void for_each_overlap(const shape<T, vec> &overlap, F &&f) const
+    {
+        _spatial.for_each_overlap(overlap, f);
+    }
     inline const body<T, vec> &get_body(const size_t index) const
     {
         return _bodies[index];
@@ -765,14 +771,10 @@ class physics
             // Get the index map for reordering
             const std::vector<K> &map = _spatial.get_index_map();
 
-            // Determine intersecting shapes for contact resolution
-            const std::vector<std::pair<K, K>> &collisions = _spatial.get_collisions();
-
-            // Handle all collisions between objects
-            for (const auto &c : collisions)
-            {
-                collide(map[c.first], map[c.second]);
-            }
+            // Handle all collisions between objects as the intersecting shapes are found
+            _spatial.for_each_collision([this, &map](const K a, const K b) {
+                this->collide(map[a], map[b]);
+            });
 
             // Solve the simulation
             solve_integrals(dt, damping);
@@ -791,14 +793,10 @@ class physics
             // This doesn't reorder the shapes vector
             _spatial.insert_no_sort(_shapes);
 
-            // Determine intersecting shapes for contact resolution
-            const std::vector<std::pair<K, K>> &collisions = _spatial.get_collisions();
-
-            // Handle all collisions between objects
-            for (const auto &c : collisions)
-            {
-                collide(c.first, c.second);
-            }
+            // Handle all collisions between objects as the intersecting shapes are found
+            _spatial.for_each_collision([this](const K a, const K b) {
+                this->collide(a, b);
+            });
 
             // Solve the simulation
             solve_integrals(dt, damping);
@@ -822,6 +820,26 @@ class physics
 
         return 0.5 * KE2 + PE;
     }
+    inline T get_total_energy(thread_pool &pool) const
+    {
+        // Calculate the energy of a single body
+        const auto energy = [this](std::mt19937 &gen, const size_t i) -> T {
+            const body<T, vec> &b = this->_bodies[i];
+
+            // Calculate kinetic energy = 0.5*mv^2
+            const vec<T> &v = b.get_linear_velocity();
+            const T m = b.get_mass();
+            const T KE = 0.5 * m * v.dot(v);
+
+            // Calculate the potential energy = -mgh
+            const T PE = m * this->_gravity.dot(this->_spatial.get_lower_bound() - b.get_position());
+
+            return KE + PE;
+        };
+
+        // Sum the energy of all bodies in parallel
+        return pool.parallel_reduce(energy, [](const T a, const T b) { return a + b; }, static_cast<T>(0.0), 0, _bodies.size());
+    }
     inline void set_elasticity(const T e)
     {
         _elasticity = e;
@@ -0,0 +1,597 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_SWEEP_PRUNE_MGL_
+#define _MGL_SWEEP_PRUNE_MGL_
+
+#include <algorithm>
+#include <limits>
+#include <min/intersect.h>
+#include <min/oobbox.h>
+#include <min/ray.h>
+#include <min/utility.h>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The shape class must fulfill the following interface to be inserted into the spatial structure
+// shape.get_center()
+// shape.get_min()
+// shape.get_max()
+// intersect(shape, shape)
+
+// A sort and sweep broadphase that keeps the sorted bounds of every axis between updates
+// Bounds that move a little are resorted with an insertion sort, every swap of a min and max point starts or ends an overlap
+// The overlapping pairs are kept between updates, with the pairs added and removed by the last update
+
+namespace min
+{
+
+template <typename T, template <typename> class vec, template <typename, template <typename> class> class shape>
+class sweep_bounds
+{
+  public:
+    inline static vec<T> get_min(const shape<T, vec> &s)
+    {
+        return s.get_min();
+    }
+    inline static vec<T> get_max(const shape<T, vec> &s)
+    {
+        return s.get_max();
+    }
+};
+template <typename T, template <typename> class vec>
+class sweep_bounds<T, vec, oobbox>
+{
+  public:
+    // The oriented box bounds ignore rotation, sweep the bounds of the sphere holding the box in any rotation
+    inline static vec<T> get_min(const oobbox<T, vec> &s)
+    {
+        return s.get_center() - s.get_half_extent().magnitude();
+    }
+    inline static vec<T> get_max(const oobbox<T, vec> &s)
+    {
+        return s.get_center() + s.get_half_extent().magnitude();
+    }
+};
+
+template <typename T, typename K>
+class sweep_point
+{
+  private:
+    T _value;
+    K _key;
+    bool _max;
+
+  public:
+    sweep_point(const T value, const K key, const bool max) : _value(value), _key(key), _max(max) {}
+    inline bool before(const sweep_point<T, K> &p) const
+    {
+        // Min points come before max points of the same value, so touching bounds overlap
+        return _value < p._value || (_value == p._value && !_max && p._max);
+    }
+    inline K get_key() const
+    {
+        return _key;
+    }
+    inline T get_value() const
+    {
+        return _value;
+    }
+    inline bool is_max() const
+    {
+        return _max;
+    }
+    inline void set_value(const T value)
+    {
+        _value = value;
+    }
+};
+
+template <typename T, typename K, typename L, template <typename> class vec, template <typename, template <typename> class> class cell, template <typename, template <typename> class> class shape>
+class sweep_prune
+{
+  private:
+    std::vector<shape<T, vec>> _shapes;
+    std::vector<K> _index_map;
+    std::vector<vec<T>> _min_cache;
+    std::vector<vec<T>> _max_cache;
+    std::vector<T> _lows;
+    std::vector<T> _highs;
+    std::vector<sweep_point<T, K>> _points;
+    std::vector<std::pair<K, K>> _pairs;
+    std::unordered_map<L, size_t> _pair_index;
+    std::vector<std::pair<K, K>> _added;
+    std::vector<std::pair<K, K>> _removed;
+    std::vector<K> _active;
+    std::vector<size_t> _active_index;
+    mutable std::vector<std::pair<K, K>> _hits;
+    mutable std::vector<std::pair<K, vec<T>>> _ray_hits;
+    mutable std::vector<K> _point_keys;
+    cell<T, vec> _root;
+    vec<T> _lower_bound;
+    vec<T> _upper_bound;
+
+    inline L pair_id(const K a, const K b) const
+    {
+        return static_cast<L>(a) * _shapes.size() + b;
+    }
+    inline bool overlap(const K a, const K b) const
+    {
+        return _min_cache[a] <= _max_cache[b] && _max_cache[a] >= _min_cache[b];
+    }
+    inline void add_pair(K a, K b)
+    {
+        // Prefer a < b
+        if (a > b)
+        {
+            std::swap(a, b);
+        }
+
+        // Add the pair if it isn't already overlapping on another axis
+        const auto result = _pair_index.emplace(pair_id(a, b), _pairs.size());
+        if (result.second)
+        {
+            _pairs.emplace_back(a, b);
+            _added.emplace_back(a, b);
+        }
+    }
+    inline void remove_pair(K a, K b)
+    {
+        // Prefer a < b
+        if (a > b)
+        {
+            std::swap(a, b);
+        }
+
+        // Remove the pair if it was overlapping
+        const auto it = _pair_index.find(pair_id(a, b));
+        if (it != _pair_index.end())
+        {
+            // Move the last pair into the removed slot
+            const size_t i = it->second;
+            _pair_index.erase(it);
+            if (i + 1 < _pairs.size())
+            {
+                _pairs[i] = _pairs.back();
+                _pair_index[pair_id(_pairs[i].first, _pairs[i].second)] = i;
+            }
+            _pairs.pop_back();
+            _removed.emplace_back(a, b);
+        }
+    }
+    inline void cache_bounds(const std::vector<shape<T, vec>> &shapes, const K key)
+    {
+        // Cache the bounds and each axis of the bounds
+        const size_t size = shapes.size();
+        _min_cache[key] = sweep_bounds<T, vec, shape>::get_min(shapes[key]);
+        _max_cache[key] = sweep_bounds<T, vec, shape>::get_max(shapes[key]);
+        _min_cache[key].soa_store(&_lows[key], size);
+        _max_cache[key].soa_store(&_highs[key], size);
+    }
+    inline void sort_axis(const size_t axis)
+    {
+        // Get the sorted points of this axis
+        const size_t size = _shapes.size();
+        sweep_point<T, K> *const points = &_points[axis * 2 * size];
+        const T *const lows = &_lows[axis * size];
+        const T *const highs = &_highs[axis * size];
+
+        // Load the new bounds
+        const size_t end = 2 * size;
+        for (size_t i = 0; i < end; i++)
+        {
+            sweep_point<T, K> &p = points[i];
+            const K key = p.get_key();
+            p.set_value(p.is_max() ? highs[key] : lows[key]);
+        }
+
+        // Insertion sort, near linear when the bounds barely moved
+        for (size_t i = 1; i < end; i++)
+        {
+            const sweep_point<T, K> p = points[i];
+            size_t j = i;
+            for (; j > 0 && p.before(points[j - 1]); j--)
+            {
+                // A min point moving below a max point starts an overlap on this axis
+                // A max point moving below a min point ends an overlap on this axis
+                const sweep_point<T, K> &q = points[j - 1];
+                if (!p.is_max() && q.is_max())
+                {
+                    if (overlap(p.get_key(), q.get_key()))
+                    {
+                        add_pair(p.get_key(), q.get_key());
+                    }
+                }
+                else if (p.is_max() && !q.is_max())
+                {
+                    remove_pair(p.get_key(), q.get_key());
+                }
+
+                // Shift the point up
+                points[j] = q;
+            }
+            points[j] = p;
+        }
+    }
+    inline void rebuild(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Every old pair is removed
+        _removed = _pairs;
+        _pairs.clear();
+        _pair_index.clear();
+
+        // Copy the shapes, they are never reordered
+        const size_t size = shapes.size();
+        _shapes = shapes;
+        _index_map.resize(size);
+        std::iota(_index_map.begin(), _index_map.end(), 0);
+
+        // Cache the bounds of every shape
+        _min_cache.resize(size);
+        _max_cache.resize(size);
+        _lows.resize(size * vec<T>::soa_size());
+        _highs.resize(size * vec<T>::soa_size());
+        for (size_t i = 0; i < size; i++)
+        {
+            cache_bounds(shapes, i);
+        }
+
+        // Sort the points of every axis
+        _points.clear();
+        _points.reserve(2 * size * vec<T>::soa_size());
+        for (size_t a = 0; a < vec<T>::soa_size(); a++)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                _points.emplace_back(_lows[a * size + i], i, false);
+                _points.emplace_back(_highs[a * size + i], i, true);
+            }
+            std::sort(_points.end() - 2 * size, _points.end(), [](const sweep_point<T, K> &a, const sweep_point<T, K> &b) {
+                return a.before(b);
+            });
+        }
+
+        // Sweep the first axis, every open shape overlaps the next min point on this axis
+        _active.clear();
+        _active_index.resize(size);
+        const size_t end = 2 * size;
+        for (size_t i = 0; i < end; i++)
+        {
+            const sweep_point<T, K> &p = _points[i];
+            const K key = p.get_key();
+            if (p.is_max())
+            {
+                // Close the shape, move the last open shape into its slot
+                const size_t slot = _active_index[key];
+                _active[slot] = _active.back();
+                _active_index[_active[slot]] = slot;
+                _active.pop_back();
+            }
+            else
+            {
+                // Test the shape against every open shape
+                for (const K k : _active)
+                {
+                    if (overlap(key, k))
+                    {
+                        add_pair(key, k);
+                    }
+                }
+
+                // Open the shape
+                _active_index[key] = _active.size();
+                _active.push_back(key);
+            }
+        }
+    }
+    template <typename F>
+    inline void get_overlap(const vec<T> &min, const vec<T> &max, F &f) const
+    {
+        // Get the last value on the first axis
+        T last[vec<T>::soa_size()];
+        max.soa_store(last, 1);
+
+        // Call f(key) for every shape with bounds overlapping the box, shapes starting past the box end the sweep
+        const size_t end = 2 * _shapes.size();
+        for (size_t i = 0; i < end && _points[i].get_value() <= last[0]; i++)
+        {
+            const sweep_point<T, K> &p = _points[i];
+            const K key = p.get_key();
+            if (!p.is_max() && _min_cache[key] <= max && _max_cache[key] >= min)
+            {
+                f(key);
+            }
+        }
+    }
+    inline void resort()
+    {
+        // Resort every axis, swaps update the overlapping pairs
+        for (size_t a = 0; a < vec<T>::soa_size(); a++)
+        {
+            sort_axis(a);
+        }
+    }
+
+  public:
+    sweep_prune(const cell<T, vec> &c)
+        : _root(c),
+          _lower_bound(_root.get_min() + var<T>::TOL_PHYS_EDGE),
+          _upper_bound(_root.get_max() - var<T>::TOL_PHYS_EDGE) {}
+    inline void resize(const cell<T, vec> &c)
+    {
+        _root = c;
+        _lower_bound = _root.get_min() + var<T>::TOL_PHYS_EDGE;
+        _upper_bound = _root.get_max() - var<T>::TOL_PHYS_EDGE;
+    }
+    inline void check_size(const std::vector<shape<T, vec>> &shapes) const
+    {
+        // Check size of the number of objects to insert into the sweep
+        if (shapes.size() > std::numeric_limits<K>::max() - 1)
+        {
+            throw std::runtime_error("sweep_prune(): too many objects to insert, max supported is " + std::to_string(std::numeric_limits<K>::max()));
+        }
+    }
+    inline vec<T> clamp_bounds(const vec<T> &point) const
+    {
+        return vec<T>(point).clamp(_lower_bound, _upper_bound);
+    }
+    template <typename F>
+    inline void for_each_collision(F &&f) const
+    {
+        // Call f(a, b) with a < b for every intersecting pair, only overlapping bounds are tested
+        for (const auto &p : _pairs)
+        {
+            if (intersect(_shapes[p.first], _shapes[p.second]))
+            {
+                f(p.first, p.second);
+            }
+        }
+    }
+    template <typename F>
+    inline void for_each_overlap(const shape<T, vec> &overlap, F &&f) const
+    {
+        // Call f(key) for every shape with bounds overlapping the shape
+        get_overlap(sweep_bounds<T, vec, shape>::get_min(overlap), sweep_bounds<T, vec, shape>::get_max(overlap), f);
+    }
+    inline const std::vector<std::pair<K, K>> &get_added_pairs() const
+    {
+        // Pairs with bounds that started overlapping in the last update
+        return _added;
+    }
+    inline const std::vector<std::pair<K, K>> &get_collisions() const
+    {
+        // Clear out the old collision vector
+        _hits.clear();
+        _hits.reserve(_pairs.size());
+
+        // get all intersecting pairs
+        for_each_collision([this](const K a, const K b) {
+            this->_hits.emplace_back(a, b);
+        });
+
+        // Return the list
+        return _hits;
+    }
+    inline const std::vector<std::pair<K, K>> &get_collisions(const vec<T> &point) const
+    {
+        // Clear out the old collision vector
+        _hits.clear();
+
+        // Perform an N^2-N intersection test for all shapes holding the point
+        const std::vector<K> &keys = point_inside(point);
+        const size_t size = keys.size();
+        for (size_t i = 0; i < size; i++)
+        {
+            for (size_t j = i + 1; j < size; j++)
+            {
+                // Prefer a < b
+                K a = keys[i];
+                K b = keys[j];
+                if (a > b)
+                {
+                    a = keys[j];
+                    b = keys[i];
+                }
+
+                // Get the two shapes
+                if (intersect(_shapes[a], _shapes[b]))
+                {
+                    _hits.emplace_back(a, b);
+                }
+            }
+        }
+
+        // Return the list
+        return _hits;
+    }
+    inline const std::vector<std::pair<K, vec<T>>> &get_collisions(const ray<T, vec> &r) const
+    {
+        // Output vector
+        _ray_hits.clear();
+
+        // The sweep has no ray acceleration, test every shape against the ray
+        vec<T> p;
+        const size_t size = _shapes.size();
+        for (size_t i = 0; i < size; i++)
+        {
+            if (intersect(_shapes[i], r, p))
+            {
+                _ray_hits.emplace_back(i, p);
+            }
+        }
+
+        // Return the collision list
+        return _ray_hits;
+    }
+    inline bool get_closest_hit(const ray<T, vec> &r, const T t_max, K &key, vec<T> &point) const
+    {
+        // The sweep has no ray acceleration, test every shape against the ray keeping the nearest hit
+        T best = t_max;
+        bool found = false;
+        vec<T> p;
+        const size_t size = _shapes.size();
+        for (size_t i = 0; i < size; i++)
+        {
+            if (intersect(_shapes[i], r, p))
+            {
+                // Distance along the ray to the hit
+                const T d = (p - r.get_origin()).dot(r.get_direction());
+                if (d <= best)
+                {
+                    best = d;
+                    found = true;
+                    key = i;
+                    point = p;
+                }
+            }
+        }
+
+        return found;
+    }
+    inline const std::vector<K> &get_index_map() const
+    {
+        return _index_map;
+    }
+    inline const std::vector<std::pair<K, K>> &get_overlap(const shape<T, vec> &overlap) const
+    {
+        // Clear out the old collision vector
+        _hits.clear();
+
+        // Get the overlapping shapes
+        for_each_overlap(overlap, [this](const K key) {
+            this->_hits.emplace_back(key, 0);
+        });
+
+        // Return the list
+        return _hits;
+    }
+    inline const std::vector<std::pair<K, K>> &get_pairs() const
+    {
+        // Every pair with overlapping bounds, a < b
+        return _pairs;
+    }
+    inline const std::vector<std::pair<K, K>> &get_removed_pairs() const
+    {
+        // Pairs with bounds that stopped overlapping in the last update, or every old pair after a rebuild
+        return _removed;
+    }
+    inline const vec<T> &get_lower_bound() const
+    {
+        return _lower_bound;
+    }
+    inline const vec<T> &get_upper_bound() const
+    {
+        return _upper_bound;
+    }
+    inline K get_scale() const
+    {
+        // Number of sorted axes
+        return vec<T>::soa_size();
+    }
+    inline const std::vector<shape<T, vec>> &get_shapes()
+    {
+        return _shapes;
+    }
+    inline bool inside(const vec<T> &point) const
+    {
+        return _root.point_inside(point);
+    }
+    inline void insert(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Clear the last changes
+        _added.clear();
+        _removed.clear();
+
+        // Rebuild if the number of shapes changed
+        const size_t size = shapes.size();
+        if (size != _shapes.size() || _points.size() != 2 * size * vec<T>::soa_size())
+        {
+            rebuild(shapes);
+            return;
+        }
+
+        // Keys are stable, resort the new bounds of every shape
+        _shapes = shapes;
+        for (size_t i = 0; i < size; i++)
+        {
+            cache_bounds(shapes, i);
+        }
+        resort();
+    }
+    inline void insert_no_sort(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Shapes are never reordered
+        insert(shapes);
+    }
+    inline void radius_query(const vec<T> &point, const T radius, std::vector<K> &out) const
+    {
+        // Output vector
+        out.clear();
+
+        // Get the shapes with centers inside the sphere
+        const T r2 = radius * radius;
+        const auto f = [this, &point, r2, &out](const K key) {
+            const vec<T> d = this->_shapes[key].get_center() - point;
+            if (d.dot(d) <= r2)
+            {
+                out.push_back(key);
+            }
+        };
+        get_overlap(point - radius, point + radius, f);
+    }
+    inline void update(const std::vector<shape<T, vec>> &shapes, const std::vector<K> &moved)
+    {
+        // Clear the last changes
+        _added.clear();
+        _removed.clear();
+
+        // Rebuild if the number of shapes changed
+        const size_t size = shapes.size();
+        if (size != _shapes.size() || _points.size() != 2 * size * vec<T>::soa_size())
+        {
+            rebuild(shapes);
+            return;
+        }
+
+        // Copy every shape, a shape can rotate without changing its bounds
+        _shapes = shapes;
+
+        // Only moved shapes have new bounds
+        for (const K key : moved)
+        {
+            cache_bounds(shapes, key);
+        }
+        resort();
+    }
+    inline const std::vector<K> &point_inside(const vec<T> &point) const
+    {
+        // Output vector
+        _point_keys.clear();
+
+        // Get the keys of every shape with bounds holding the point
+        const vec<T> clamped = clamp_bounds(point);
+        const auto f = [this](const K key) {
+            this->_point_keys.push_back(key);
+        };
+        get_overlap(clamped, clamped, f);
+
+        return _point_keys;
+    }
+};
+}
+
+#endif
@@ -17,9 +17,9 @@ limitations under the License.
 
 #include <algorithm>
 #include <cmath>
-#include <min/bit_flag.h>
 #include <min/intersect.h>
 #include <min/sort.h>
+#include <min/thread_pool.h>
 #include <min/utility.h>
 #include <numeric>
 #include <stdexcept>
@@ -103,15 +103,24 @@ class tree
     std::vector<shape<T, vec>> _shapes;
     std::vector<K> _index_map;
     std::vector<size_t> _key_cache;
+    std::vector<std::pair<tree_node<T, K, L, vec, cell, shape> *, K>> _subtrees;
     mutable std::vector<std::pair<K, K>> _hits;
+    mutable std::vector<std::vector<std::pair<K, K>>> _block_hits;
+    mutable std::vector<std::vector<K>> _block_keys;
+    mutable std::vector<std::pair<const tree_node<T, K, L, vec, cell, shape> *, vec<T>>> _pair_roots;
     mutable std::vector<std::pair<K, vec<T>>> _ray_hits;
-    mutable bit_flag<K, L> _flags;
+    mutable std::vector<std::pair<K, vec<T>>> _closest;
+    mutable std::vector<size_t> _ray_index;
+    mutable std::vector<size_t> _ray_copy;
+    mutable std::vector<size_t> _ray_keys;
     tree_node<T, K, L, vec, cell, shape> _root;
     vec<T> _cell_extent;
     vec<T> _lower_bound;
     vec<T> _upper_bound;
     K _depth;
     K _scale;
+    K _parallel_depth;
+    bool _sorted;
 
     inline void build(tree_node<T, K, L, vec, cell, shape> &node, const K depth)
     {
@@ -126,6 +135,68 @@ class tree
         node.get_cell().subdivide(children);
 
         // Calculate intersections of sub cell with list of shapes
+        split(node);
+
+        // Recurse into children
+        for (auto &child : children)
+        {
+            // Skip over sub cells without any possible intersections
+            if (child.size() > 1)
+            {
+                // Build all sub cells recursively
+                build(child, depth - 1);
+            }
+        }
+    }
+    inline void build_top(tree_node<T, K, L, vec, cell, shape> &node, const K depth, const K levels)
+    {
+        // We are at a leaf node and we have hit the stopping criteria
+        if (depth == 0)
+        {
+            return;
+        }
+
+        // Below the top levels the subtree is built by a task
+        if (levels == 0)
+        {
+            _subtrees.emplace_back(&node, depth);
+            return;
+        }
+
+        // Calculate sub cell regions in this node, and set the node children cells
+        auto &children = node.get_children();
+        node.get_cell().subdivide(children);
+
+        // Calculate intersections of sub cell with list of shapes
+        split(node);
+
+        // Recurse into children
+        for (auto &child : children)
+        {
+            // Skip over sub cells without any possible intersections
+            if (child.size() > 1)
+            {
+                // Split the top levels serially
+                build_top(child, depth - 1, levels - 1);
+            }
+        }
+    }
+    inline void build(thread_pool &pool)
+    {
+        // Split the top levels and collect the independent subtrees below them
+        _subtrees.clear();
+        build_top(_root, _depth, _parallel_depth);
+
+        // Build the subtrees in parallel, each task only writes inside its own subtree
+        const auto subtree = [this](std::mt19937 &gen, const size_t i) {
+            this->build(*this->_subtrees[i].first, this->_subtrees[i].second);
+        };
+        pool.run(std::cref(subtree), 0, _subtrees.size());
+    }
+    inline void split(tree_node<T, K, L, vec, cell, shape> &node)
+    {
+        // Calculate intersections of sub cell with list of shapes
+        auto &children = node.get_children();
         const vec<T> &center = node.get_cell().get_center();
         const std::vector<K> &keys = node.get_keys();
         for (const auto key : keys)
@@ -143,6 +214,24 @@ class tree
                 children[sub].add_key(key);
             }
         }
+    }
+    inline void refit(tree_node<T, K, L, vec, cell, shape> &node, const K depth)
+    {
+        // We are at a leaf node and we have hit the stopping criteria
+        if (depth == 0)
+        {
+            return;
+        }
+
+        // Reuse the sub cells of the last build, their keys were cleared
+        auto &children = node.get_children();
+        if (children.size() == 0)
+        {
+            node.get_cell().subdivide(children);
+        }
+
+        // Calculate intersections of sub cell with list of shapes
+        split(node);
 
         // Recurse into children
         for (auto &child : children)
@@ -150,8 +239,13 @@ class tree
             // Skip over sub cells without any possible intersections
             if (child.size() > 1)
             {
-                // Build all sub cells recursively
-                build(child, depth - 1);
+                // Refit all sub cells recursively
+                refit(child, depth - 1);
+            }
+            else
+            {
+                // Queries stop at nodes without children, drop the stale sub cells
+                child.get_children().clear();
             }
         }
     }
@@ -178,34 +272,23 @@ class tree
             }
         }
     }
-    inline void reserve(const K size)
-    {
-        // Create flags index
-        if (size > _flags.col())
-        {
-            // Resize the flag buffer
-            _flags.resize(size, size);
-        }
-        else
-        {
-            // Clear the flag buffer
-            _flags.clear();
-        }
-    }
-    inline void get_overlap(const tree_node<T, K, L, vec, cell, shape> &node) const
+    template <typename F>
+    inline void get_overlap(const tree_node<T, K, L, vec, cell, shape> &node, const vec<T> &min, const vec<T> &lower, F &f) const
     {
         // Get all keys in this cell
         const std::vector<K> &keys = node.get_keys();
         const K size = keys.size();
         for (K i = 0; i < size; i++)
         {
-            if (!_flags.get_set_on(keys[i], 0))
+            // Only the lowest sub cell shared with the overlap shape reports this shape
+            if (vec<T>::subdivide_owner(_shapes[keys[i]].get_min(), min, lower))
             {
-                _hits.emplace_back(keys[i], 0);
+                f(keys[i]);
             }
         }
     }
-    inline void get_overlap(const tree_node<T, K, L, vec, cell, shape> &node, const vec<T> &min, const vec<T> &max, const K depth) const
+    template <typename F>
+    inline void get_overlap(const tree_node<T, K, L, vec, cell, shape> &node, const vec<T> &min, const vec<T> &max, const vec<T> &lower, const K depth, F &f) const
     {
         // Returns all overlapping keys
         // We are at a leaf node and we have hit the stopping criteria
@@ -213,38 +296,71 @@ class tree
         if (children.size() == 0)
         {
             // Get the overlapping keys in this cell
-            get_overlap(node);
+            get_overlap(node, min, lower, f);
 
             // Early return
             return;
         }
 
-        // For all child nodes of this node check overlap
+        // Calculate intersection between overlap shape and the node sub cells
         const vec<T> &center = node.get_cell().get_center();
-        for (const auto &child : children)
+        const auto subs = vec<T>::subdivide_overlap(min, max, center);
+        for (const uint_fast8_t sub : subs)
         {
-            // Recursively search for overlap in all children
+            // Recursively search for overlap in all non empty children
+            const auto &child = children[sub];
             if (child.size() > 0)
             {
-                // Calculate intersection between overlap shape and the node sub cells
-                const auto subs = vec<T>::subdivide_overlap(min, max, center);
-                for (const uint_fast8_t sub : subs)
+                get_overlap(child, min, max, vec<T>::subdivide_lower(lower, center, sub), depth - 1, f);
+            }
+        }
+    }
+    inline void get_pairs(const tree_node<T, K, L, vec, cell, shape> &node) const
+    {
+        // Perform an N^2-N intersection test for all shapes in this cell
+        const std::vector<K> &keys = node.get_keys();
+        const K size = keys.size();
+        for (K i = 0; i < size; i++)
+        {
+            for (K j = i + 1; j < size; j++)
+            {
+                // Prefer a < b
+                K a = keys[i];
+                K b = keys[j];
+                if (a > b)
                 {
-                    get_overlap(children[sub], min, max, depth - 1);
+                    a = keys[j];
+                    b = keys[i];
+                }
+
+                // Get the two cells
+                const shape<T, vec> &a_shape = _shapes[a];
+                const shape<T, vec> &b_shape = _shapes[b];
+                if (intersect(a_shape, b_shape))
+                {
+                    _hits.emplace_back(a, b);
                 }
             }
         }
     }
-    inline void get_pairs(const tree_node<T, K, L, vec, cell, shape> &node) const
+    template <typename F>
+    inline void get_owned_pairs(const tree_node<T, K, L, vec, cell, shape> &node, const vec<T> &lower, F &f) const
     {
         // Perform an N^2-N intersection test for all shapes in this cell
         const std::vector<K> &keys = node.get_keys();
         const K size = keys.size();
         for (K i = 0; i < size; i++)
         {
+            const vec<T> &a_min = _shapes[keys[i]].get_min();
             for (K j = i + 1; j < size; j++)
             {
-                // See if this collision has already been found; prefer a < b
+                // Only the lowest sub cell shared by both shapes reports the pair
+                if (!vec<T>::subdivide_owner(a_min, _shapes[keys[j]].get_min(), lower))
+                {
+                    continue;
+                }
+
+                // Prefer a < b
                 K a = keys[i];
                 K b = keys[j];
                 if (a > b)
@@ -253,21 +369,18 @@ class tree
                     b = keys[i];
                 }
 
-                // Add the test to flags to avoid retesting
-                if (!_flags.get_set_on(a, b))
+                // Get the two cells
+                const shape<T, vec> &a_shape = _shapes[a];
+                const shape<T, vec> &b_shape = _shapes[b];
+                if (intersect(a_shape, b_shape))
                 {
-                    // Get the two cells
-                    const shape<T, vec> &a_shape = _shapes[a];
-                    const shape<T, vec> &b_shape = _shapes[b];
-                    if (intersect(a_shape, b_shape))
-                    {
-                        _hits.emplace_back(a, b);
-                    }
+                    f(a, b);
                 }
             }
         }
     }
-    inline void get_pairs(const tree_node<T, K, L, vec, cell, shape> &node, const K depth) const
+    template <typename F>
+    inline void get_pairs(const tree_node<T, K, L, vec, cell, shape> &node, const vec<T> &lower, const K depth, F &f) const
     {
         // Returns all intersecting key pairs
         // We are at a leaf node and we have hit the stopping criteria
@@ -275,28 +388,330 @@ class tree
         if (children.size() == 0)
         {
             // Get the intersecting pairs in this cell
-            get_pairs(node);
+            get_owned_pairs(node, lower, f);
 
             // Early return
             return;
         }
 
         // For all child nodes of this node check intersection
-        for (const auto &child : children)
+        const vec<T> &center = node.get_cell().get_center();
+        const size_t size = children.size();
+        for (size_t i = 0; i < size; i++)
+        {
+            // Must have more than one object to be intersecting
+            const auto &child = children[i];
+            if (child.size() > 1)
+            {
+                // Lower bound of the child cell along the owner path
+                const vec<T> child_lower = vec<T>::subdivide_lower(lower, center, i);
+
+                // Terminate recursion and test pair
+                if (child.size() == 2)
+                {
+                    get_owned_pairs(child, child_lower, f);
+                }
+                else
+                {
+                    // Recursively search for intersections in all children
+                    get_pairs(child, child_lower, depth - 1, f);
+                }
+            }
+        }
+    }
+    inline void get_pair_roots(const tree_node<T, K, L, vec, cell, shape> &node, const vec<T> &lower, const K levels) const
+    {
+        // Leaves are walked by a task
+        const auto &children = node.get_children();
+        if (children.size() == 0)
         {
-            // Terminate recursion and test pair
-            if (child.size() == 2)
+            _pair_roots.emplace_back(&node, lower);
+            return;
+        }
+
+        // Collect the children that may hold a pair in the same order as get_pairs
+        const vec<T> &center = node.get_cell().get_center();
+        const size_t size = children.size();
+        for (size_t i = 0; i < size; i++)
+        {
+            const auto &child = children[i];
+            if (child.size() > 1)
             {
-                get_pairs(child);
+                // Children with two keys and children below the top levels are walked by a task
+                const vec<T> child_lower = vec<T>::subdivide_lower(lower, center, i);
+                if (child.size() == 2 || levels == 1)
+                {
+                    _pair_roots.emplace_back(&child, child_lower);
+                }
+                else
+                {
+                    get_pair_roots(child, child_lower, levels - 1);
+                }
             }
-            // Must have more than one object to be intersecting
-            else if (child.size() > 1)
+        }
+    }
+    inline void get_closest_hit(const tree_node<T, K, L, vec, cell, shape> &node, const ray<T, vec> &r, T &best, bool &found, K &key, vec<T> &point) const
+    {
+        // We are at a leaf node and we have hit the stopping criteria
+        const auto &children = node.get_children();
+        if (children.size() == 0)
+        {
+            // Perform an N intersection test for all shapes in this cell against the ray, keeping the nearest hit
+            const std::vector<K> &keys = node.get_keys();
+            const K size = keys.size();
+            vec<T> p;
+            for (K i = 0; i < size; i++)
+            {
+                const K k = keys[i];
+                const shape<T, vec> &s = _shapes[k];
+                if (intersect(s, r, p))
+                {
+                    // Distance along the ray to the hit
+                    const T t = (p - r.get_origin()).dot(r.get_direction());
+                    if (t <= best)
+                    {
+                        best = t;
+                        found = true;
+                        key = k;
+                        point = p;
+                    }
+                }
+            }
+
+            // Early return
+            return;
+        }
+
+        // For all child nodes intersecting ray, front to back
+        const cell<T, vec> &c = node.get_cell();
+        const auto subs = vec<T>::subdivide_ray(c.get_min(), c.get_max(), r.get_origin(), r.get_direction(), r.get_inverse());
+        for (const uint_fast8_t sub : subs)
+        {
+            // Shapes are in every cell they overlap, so skip cells the ray enters past the nearest hit
+            const cell<T, vec> &child = children[sub].get_cell();
+            T t;
+            if (ray_entry(child.get_min(), child.get_max(), r, t) && t <= best)
+            {
+                get_closest_hit(children[sub], r, best, found, key, point);
+            }
+        }
+    }
+    inline static constexpr size_t packet_size()
+    {
+        return 8;
+    }
+    inline void get_closest_hits(const tree_node<T, K, L, vec, cell, shape> &node, const std::vector<ray<T, vec>> &rays, const size_t *const packet, const size_t size, T *const best, const uint_fast8_t active) const
+    {
+        // We are at a leaf node and we have hit the stopping criteria
+        const auto &children = node.get_children();
+        if (children.size() == 0)
+        {
+            // Load each shape once and test it against every active ray in the packet, keeping the nearest hit
+            const std::vector<K> &keys = node.get_keys();
+            const K keys_size = keys.size();
+            vec<T> p;
+            for (K i = 0; i < keys_size; i++)
+            {
+                const K k = keys[i];
+                const shape<T, vec> &s = _shapes[k];
+                for (size_t j = 0; j < size; j++)
+                {
+                    const ray<T, vec> &r = rays[packet[j]];
+                    if ((active & (0x1 << j)) && intersect(s, r, p))
+                    {
+                        // Distance along the ray to the hit
+                        const T t = (p - r.get_origin()).dot(r.get_direction());
+                        if (t <= best[j])
+                        {
+                            best[j] = t;
+                            _closest[packet[j]] = std::make_pair(k, p);
+                        }
+                    }
+                }
+            }
+
+            // Early return
+            return;
+        }
+
+        // Calculate which rays in the packet enter each child before their nearest hit
+        const size_t subs = children.size();
+        T entry[vec<T>::sub_size()][packet_size()];
+        T nearest[vec<T>::sub_size()];
+        uint_fast8_t masks[vec<T>::sub_size()];
+        uint_fast8_t order[vec<T>::sub_size()];
+        for (size_t i = 0; i < subs; i++)
+        {
+            const cell<T, vec> &child = children[i].get_cell();
+            nearest[i] = std::numeric_limits<T>::max();
+            masks[i] = 0;
+            order[i] = i;
+            for (size_t j = 0; j < size; j++)
+            {
+                T &t = entry[i][j];
+                if ((active & (0x1 << j)) && ray_entry(child.get_min(), child.get_max(), rays[packet[j]], t) && t <= best[j])
+                {
+                    masks[i] |= (0x1 << j);
+                    nearest[i] = std::min(nearest[i], t);
+                }
+            }
+        }
+
+        // Visit the children front to back by the nearest ray entry of the packet
+        for (size_t i = 1; i < subs; i++)
+        {
+            const uint_fast8_t sub = order[i];
+            size_t j = i;
+            for (; j > 0 && nearest[sub] < nearest[order[j - 1]]; j--)
+            {
+                order[j] = order[j - 1];
+            }
+            order[j] = sub;
+        }
+        for (size_t i = 0; i < subs && masks[order[i]] != 0; i++)
+        {
+            // Shapes are in every cell they overlap, so drop rays that enter past their nearest hit
+            const uint_fast8_t sub = order[i];
+            uint_fast8_t mask = masks[sub];
+            for (size_t j = 0; j < size; j++)
+            {
+                if ((mask & (0x1 << j)) && entry[sub][j] > best[j])
+                {
+                    mask &= ~(0x1 << j);
+                }
+            }
+
+            // Recurse if any ray in the packet is still active
+            if (mask != 0)
+            {
+                get_closest_hits(children[sub], rays, packet, size, best, mask);
+            }
+        }
+    }
+    template <typename F>
+    inline void get_radius(const vec<T> &point, const T radius, F &f) const
+    {
+        // Visit the shapes overlapping the box around the sphere
+        const T r2 = radius * radius;
+        const auto g = [this, &point, r2, &f](const K key) {
+            // Call f(key) if the shape center is inside the sphere
+            const vec<T> d = this->_shapes[key].get_center() - point;
+            if (d.dot(d) <= r2)
+            {
+                f(key);
+            }
+        };
+        get_overlap(_root, point - radius, point + radius, vec<T>::lowest(), _depth, g);
+    }
+    inline static bool nearer(const std::pair<K, T> &a, const std::pair<K, T> &b)
+    {
+        // Order by distance, then by key to break ties
+        return (a.second < b.second) || (a.second == b.second && a.first < b.first);
+    }
+    inline static void push_nearest(std::pair<K, T> *const heap, size_t &size, const size_t k, const K key, const T d2)
+    {
+        // Skip shapes farther than the k nearest
+        const std::pair<K, T> p(key, d2);
+        if (size == k && !nearer(p, heap[0]))
+        {
+            return;
+        }
+
+        // Shapes are in every leaf they overlap, skip shapes already in the heap
+        for (size_t i = 0; i < size; i++)
+        {
+            if (heap[i].first == key)
+            {
+                return;
+            }
+        }
+
+        // Bounded max heap, the farthest of the k nearest shapes is on top
+        if (size < k)
+        {
+            heap[size++] = p;
+            std::push_heap(heap, heap + size, nearer);
+        }
+        else
+        {
+            std::pop_heap(heap, heap + size, nearer);
+            heap[size - 1] = p;
+            std::push_heap(heap, heap + size, nearer);
+        }
+    }
+    inline void knn(const tree_node<T, K, L, vec, cell, shape> &node, const vec<T> &point, const size_t k, std::pair<K, T> *const heap, size_t &size) const
+    {
+        // We are at a leaf node and we have hit the stopping criteria
+        const auto &children = node.get_children();
+        if (children.size() == 0)
+        {
+            // Keep the k nearest shapes in this cell
+            for (const K key : node.get_keys())
+            {
+                const vec<T> d = _shapes[key].get_center() - point;
+                push_nearest(heap, size, k, key, d.dot(d));
+            }
+
+            // Early return
+            return;
+        }
+
+        // Calculate the square distance from the point to each child cell
+        const size_t subs = children.size();
+        T dist[vec<T>::sub_size()];
+        uint_fast8_t order[vec<T>::sub_size()];
+        for (size_t i = 0; i < subs; i++)
+        {
+            const cell<T, vec> &child = children[i].get_cell();
+            const vec<T> d = vec<T>(point).clamp(child.get_min(), child.get_max()) - point;
+            dist[i] = d.dot(d);
+            order[i] = i;
+        }
+
+        // Visit the children nearest first
+        for (size_t i = 1; i < subs; i++)
+        {
+            const uint_fast8_t sub = order[i];
+            size_t j = i;
+            for (; j > 0 && dist[sub] < dist[order[j - 1]]; j--)
+            {
+                order[j] = order[j - 1];
+            }
+            order[j] = sub;
+        }
+        for (size_t i = 0; i < subs; i++)
+        {
+            // Every shape is in the leaf holding its center, so stop at cells past the k nearest
+            const uint_fast8_t sub = order[i];
+            if (size == k && dist[sub] > heap[0].second)
+            {
+                break;
+            }
+
+            // Recurse into non empty children
+            if (children[sub].size() > 0)
             {
-                // Recursively search for intersections in all children
-                get_pairs(child, depth - 1);
+                knn(children[sub], point, k, heap, size);
             }
         }
     }
+    inline size_t knn(const vec<T> &point, const size_t k, std::pair<K, T> *const heap) const
+    {
+        // Check if tree is not built yet
+        size_t size = 0;
+        if (_root.get_children().size() == 0 || k == 0)
+        {
+            return size;
+        }
+
+        // Search the tree nearest cells first
+        knn(_root, point, k, heap, size);
+
+        // Sort the heap nearest first
+        std::sort_heap(heap, heap + size, nearer);
+
+        return size;
+    }
     inline void get_ray_intersect(const tree_node<T, K, L, vec, cell, shape> &node, const ray<T, vec> &r, const K depth) const
     {
         // We are at a leaf node and we have hit the stopping criteria
@@ -339,6 +754,31 @@ class tree
         // Use grid to sort all shapes in tree since it is a global identifier
         return vec<T>::grid_key(_root.get_cell().get_min(), _cell_extent, _scale, point);
     }
+    inline void sort_rays(const std::vector<ray<T, vec>> &rays) const
+    {
+        // Direction bins span the unit cube in 4 steps per axis
+        const vec<T> dir_min = vec<T>().set_all(-1.0);
+        const vec<T> dir_max = vec<T>().set_all(0.999);
+        const vec<T> dir_extent = vec<T>().set_all(0.5);
+        const size_t dir_bins = vec<T>::grid_key(dir_min, dir_extent, 4, dir_max) + 1;
+
+        // Cache key of the origin cell and direction bin of each ray
+        const size_t size = rays.size();
+        _ray_keys.resize(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            const vec<T> dir = vec<T>(rays[i].get_direction()).clamp(dir_min, dir_max);
+            const size_t dir_key = vec<T>::grid_key(dir_min, dir_extent, 4, dir);
+            _ray_keys[i] = get_sorting_key(clamp_bounds(rays[i].get_origin())) * dir_bins + dir_key;
+        }
+
+        // Sort ray indices so rays starting in the same cell heading the same way share a packet
+        _ray_index.resize(size);
+        std::iota(_ray_index.begin(), _ray_index.end(), 0);
+        uint_sort<size_t>(_ray_index, _ray_copy, [this](const size_t a) {
+            return this->_ray_keys[a];
+        });
+    }
     inline void set_scale(const K depth)
     {
         // Set the tree cell scale 2^depth
@@ -349,7 +789,7 @@ class tree
         _scale = static_cast<K>(0x1 << _depth);
         _cell_extent = _root.get_cell().get_extent() / static_cast<T>(_scale);
     }
-    inline void scale(const std::vector<shape<T, vec>> &shapes)
+    inline K get_fit_depth(const std::vector<shape<T, vec>> &shapes) const
     {
         // square distance across the extent
         T max = shapes[0].square_size();
@@ -371,10 +811,15 @@ class tree
         max = std::sqrt(max);
 
         // Calculate the depth of the tree
+        const K bits = std::numeric_limits<K>::digits - 1;
         const K depth = static_cast<K>(std::ceil(std::log2(d2 / max)));
 
-        // Set the scale from depth
-        set_scale(depth);
+        return std::min(bits, depth);
+    }
+    inline void scale(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Set the scale from the depth fitting the largest shape
+        set_scale(get_fit_depth(shapes));
     }
     inline void sort(const std::vector<shape<T, vec>> &shapes)
     {
@@ -411,6 +856,7 @@ class tree
         {
             _shapes.emplace_back(shapes[i]);
         }
+        _sorted = true;
     }
     inline void no_sort(const std::vector<shape<T, vec>> &shapes)
     {
@@ -427,6 +873,7 @@ class tree
         _shapes.clear();
         _shapes.reserve(size);
         _shapes.insert(_shapes.end(), shapes.begin(), shapes.end());
+        _sorted = false;
     }
 
   public:
@@ -434,7 +881,7 @@ class tree
         : _root(c),
           _lower_bound(_root.get_cell().get_min() + var<T>::TOL_PHYS_EDGE),
           _upper_bound(_root.get_cell().get_max() - var<T>::TOL_PHYS_EDGE),
-          _depth(0), _scale(0) {}
+          _depth(0), _scale(0), _parallel_depth(2), _sorted(true) {}
     inline void resize(const cell<T, vec> &c)
     {
         _root = c;
@@ -453,6 +900,30 @@ class tree
     {
         return vec<T>(point).clamp(_lower_bound, _upper_bound);
     }
+    template <typename F>
+    inline void for_each_collision(F &&f) const
+    {
+        // Check if tree is not built yet
+        if (_root.get_children().size() == 0)
+        {
+            return;
+        }
+
+        // Call f(a, b) with a < b for every intersecting pair, each pair is reported once
+        get_pairs(_root, vec<T>::lowest(), _depth, f);
+    }
+    template <typename F>
+    inline void for_each_overlap(const shape<T, vec> &overlap, F &&f) const
+    {
+        // Check if tree is not built yet
+        if (_root.get_children().size() == 0)
+        {
+            return;
+        }
+
+        // Call f(key) for every shape overlapping the shape
+        get_overlap(_root, overlap.get_min(), overlap.get_max(), vec<T>::lowest(), _depth, f);
+    }
     inline const std::vector<std::pair<K, K>> &get_collisions() const
     {
         // Check if tree is not built yet
@@ -461,17 +932,73 @@ class tree
             return _hits;
         }
 
-        // Clear out the old collision sets and vectors
-        _flags.clear();
+        // Clear out the old collision vector
         _hits.clear();
         _hits.reserve(_shapes.size());
 
         // get all intersecting pairs
-        get_pairs(_root, _depth);
+        for_each_collision([this](const K a, const K b) {
+            this->_hits.emplace_back(a, b);
+        });
 
         // Return the list
         return _hits;
     }
+    inline const std::vector<std::pair<K, K>> &get_collisions(thread_pool &pool) const
+    {
+        // Check if tree is not built yet
+        if (_root.get_children().size() == 0)
+        {
+            return _hits;
+        }
+
+        // Collect the subtrees below the top levels
+        _pair_roots.clear();
+        get_pair_roots(_root, vec<T>::lowest(), std::max(_parallel_depth, static_cast<K>(1)));
+        const size_t roots = _pair_roots.size();
+        if (_block_hits.size() < roots)
+        {
+            _block_hits.resize(roots);
+        }
+
+        // Calculate the intersection pairs in every subtree, each subtree has its own hit buffer
+        const auto pairs = [this](std::mt19937 &gen, const size_t i) {
+            std::vector<std::pair<K, K>> &out = this->_block_hits[i];
+            out.clear();
+            const auto f = [&out](const K a, const K b) {
+                out.emplace_back(a, b);
+            };
+
+            // Pairs of the shapes in leaves or nodes with two keys are owned by the node, as in get_pairs
+            const tree_node<T, K, L, vec, cell, shape> &node = *this->_pair_roots[i].first;
+            const vec<T> &lower = this->_pair_roots[i].second;
+            if (node.get_children().size() == 0 || node.size() == 2)
+            {
+                this->get_owned_pairs(node, lower, f);
+            }
+            else
+            {
+                this->get_pairs(node, lower, this->_depth, f);
+            }
+        };
+        pool.run(std::cref(pairs), 0, roots);
+
+        // Concatenate the hits in depth first order so the output is the same as get_collisions()
+        size_t size = 0;
+        for (size_t i = 0; i < roots; i++)
+        {
+            size += _block_hits[i].size();
+        }
+        _hits.clear();
+        _hits.reserve(size);
+        for (size_t i = 0; i < roots; i++)
+        {
+            _hits.insert(_hits.end(), _block_hits[i].begin(), _block_hits[i].end());
+        }
+
+        // Return the collision list
+        return _hits;
+    }
     inline const std::vector<std::pair<K, K>> &get_collisions(const vec<T> &point) const
     {
         // Check if tree is not built yet
@@ -480,8 +1007,7 @@ class tree
             return _hits;
         }
 
-        // Clear out the old collision sets and vectors
-        _flags.clear();
+        // Clear out the old collision vector
         _hits.clear();
         _hits.reserve(_shapes.size());
 
@@ -515,6 +1041,62 @@ class tree
         // Return the collision list
         return _ray_hits;
     }
+    inline bool get_closest_hit(const ray<T, vec> &r, const T t_max, K &key, vec<T> &point) const
+    {
+        // Check if tree is not built yet
+        if (_root.get_children().size() == 0)
+        {
+            return false;
+        }
+
+        // Get the nearest shape intersecting ray, pruning cells past the nearest hit
+        T best = t_max;
+        bool found = false;
+        get_closest_hit(_root, r, best, found, key, point);
+
+        return found;
+    }
+    inline const std::vector<std::pair<K, vec<T>>> &get_closest_hits(thread_pool &pool, const std::vector<ray<T, vec>> &rays, const T t_max) const
+    {
+        // Every ray starts as a miss, marked with the max key since check_size never allows it
+        const size_t size = rays.size();
+        _closest.assign(size, std::make_pair(std::numeric_limits<K>::max(), vec<T>()));
+
+        // Check if tree is not built yet
+        if (_root.get_children().size() == 0 || size == 0)
+        {
+            return _closest;
+        }
+
+        // Group coherent rays into packets that share the cell traversal and shape loads
+        sort_rays(rays);
+        const size_t packets = (size + packet_size() - 1) / packet_size();
+
+        // Split the packets into more blocks than threads to balance uneven packets
+        const size_t blocks = std::min(pool.get_thread_count() * 8, packets);
+
+        // Find the closest hit for each ray, results are stored at the ray index so blocks never share an entry
+        const auto closest = [this, &rays, t_max, size, packets, blocks](std::mt19937 &gen, const size_t b) {
+            const size_t begin = (b * packets) / blocks;
+            const size_t end = ((b + 1) * packets) / blocks;
+            for (size_t i = begin; i < end; i++)
+            {
+                // Each ray in the packet tracks its own nearest hit
+                const size_t offset = i * packet_size();
+                const size_t count = std::min(packet_size(), size - offset);
+                T best[packet_size()];
+                std::fill(best, best + count, t_max);
+
+                // Traverse the tree with all rays in the packet active
+                const uint_fast8_t active = static_cast<uint_fast8_t>((0x1 << count) - 1);
+                this->get_closest_hits(this->_root, rays, this->_ray_index.data() + offset, count, best, active);
+            }
+        };
+        pool.run(std::cref(closest), 0, blocks);
+
+        // Return the closest hit of each ray
+        return _closest;
+    }
     inline K get_depth() const
     {
         return _depth;
@@ -568,13 +1150,14 @@ class tree
             return _hits;
         }
 
-        // Clear out the old collision sets and vectors
-        _flags.clear();
+        // Clear out the old collision vector
         _hits.clear();
         _hits.reserve(_shapes.size());
 
         // Get the overlapping shapes in this cell
-        get_overlap(_root, overlap.get_min(), overlap.get_max(), _depth);
+        for_each_overlap(overlap, [this](const K key) {
+            this->_hits.emplace_back(key, 0);
+        });
 
         // Return the list
         return _hits;
@@ -610,13 +1193,25 @@ class tree
             // Process and sort shapes by grid key id
             sort(shapes);
 
-            // Reserve memory
-            reserve(size);
-
             // Rebuild the tree after changing the contents
             build(_root, _depth);
         }
     }
+    inline void insert(thread_pool &pool, const std::vector<shape<T, vec>> &shapes)
+    {
+        const size_t size = shapes.size();
+        if (size > 0)
+        {
+            // Set the tree depth
+            scale(shapes);
+
+            // Process and sort shapes by grid key id
+            sort(shapes);
+
+            // Rebuild the tree in parallel after changing the contents
+            build(pool);
+        }
+    }
     inline void insert(const std::vector<shape<T, vec>> &shapes, const K depth)
     {
         const size_t size = shapes.size();
@@ -628,9 +1223,6 @@ class tree
             // Process and sort shapes by grid key id
             sort(shapes);
 
-            // Reserve memory
-            reserve(size);
-
             // Rebuild the tree after changing the contents
             build(_root, _depth);
         }
@@ -646,13 +1238,158 @@ class tree
             // Process but do not sort shapes
             no_sort(shapes);
 
-            // Reserve memory
-            reserve(size);
-
             // Rebuild the tree after changing the contents
             build(_root, _depth);
         }
     }
+    inline void knn(const vec<T> &point, const size_t k, std::vector<std::pair<K, T>> &out) const
+    {
+        // Get the k shapes with nearest centers and their square distance, nearest first
+        out.resize(k);
+        out.resize(knn(point, k, out.data()));
+    }
+    inline void knn(thread_pool &pool, const std::vector<vec<T>> &points, const size_t k, std::vector<std::pair<K, T>> &out) const
+    {
+        // Each point gets k entries, missing neighbors are marked with the max key
+        const size_t size = points.size();
+        out.assign(size * k, std::make_pair(std::numeric_limits<K>::max(), std::numeric_limits<T>::max()));
+
+        // Get the k nearest shapes of each point, each point writes its own slice
+        const auto nearest = [this, &points, k, &out](std::mt19937 &gen, const size_t i) {
+            this->knn(points[i], k, out.data() + i * k);
+        };
+        pool.run(std::cref(nearest), 0, size);
+    }
+    inline void radius_query(const vec<T> &point, const T radius, std::vector<K> &out) const
+    {
+        // Output vector
+        out.clear();
+
+        // Check if tree is not built yet
+        if (_root.get_children().size() == 0)
+        {
+            return;
+        }
+
+        // Get the shapes with centers inside the sphere
+        const auto f = [&out](const K key) {
+            out.push_back(key);
+        };
+        get_radius(point, radius, f);
+    }
+    inline void radius_query(thread_pool &pool, const std::vector<vec<T>> &points, const T radius, std::vector<K> &out, std::vector<size_t> &offsets) const
+    {
+        // The shapes of point i are out[offsets[i]] to out[offsets[i + 1]]
+        const size_t size = points.size();
+        offsets.assign(size + 1, 0);
+        out.clear();
+
+        // Check if tree is not built yet
+        if (_root.get_children().size() == 0 || size == 0)
+        {
+            return;
+        }
+
+        // Split the points into more blocks than threads to balance uneven queries
+        const size_t blocks = std::min(pool.get_thread_count() * 8, size);
+        if (_block_keys.size() < blocks)
+        {
+            _block_keys.resize(blocks);
+        }
+
+        // Get the shapes of each point and count them, each block has its own key buffer
+        const auto query = [this, &points, radius, &offsets, size, blocks](std::mt19937 &gen, const size_t b) {
+            const size_t begin = (b * size) / blocks;
+            const size_t end = ((b + 1) * size) / blocks;
+            std::vector<K> &keys = this->_block_keys[b];
+            keys.clear();
+            const auto f = [&keys](const K key) {
+                keys.push_back(key);
+            };
+            for (size_t i = begin; i < end; i++)
+            {
+                const size_t start = keys.size();
+                this->get_radius(points[i], radius, f);
+                offsets[i + 1] = keys.size() - start;
+            }
+        };
+        pool.run(std::cref(query), 0, blocks);
+
+        // Prefix sum the counts into offsets, blocks are in point order
+        for (size_t i = 0; i < size; i++)
+        {
+            offsets[i + 1] += offsets[i];
+        }
+        out.reserve(offsets[size]);
+        for (size_t b = 0; b < blocks; b++)
+        {
+            out.insert(out.end(), _block_keys[b].begin(), _block_keys[b].end());
+        }
+    }
+    inline bool refit(const std::vector<shape<T, vec>> &shapes)
+    {
+        // Rebuild if the number of shapes changed, returns true if the tree was refit
+        const size_t size = shapes.size();
+        if (size == 0 || size != _shapes.size() || _root.get_children().size() == 0)
+        {
+            insert(shapes);
+            return false;
+        }
+
+        // The cells are fixed, rebuild if the largest shape no longer fits the leaf cells of this depth
+        bool rebuild = get_fit_depth(shapes) != _depth;
+
+        // Rebuild if many shapes left the cell they were sorted by, the shape order lost its locality
+        if (!rebuild && _sorted)
+        {
+            size_t moved = 0;
+            for (size_t i = 0; i < size; i++)
+            {
+                moved += this->get_sorting_key(shapes[i].get_center()) != _key_cache[i];
+            }
+            rebuild = moved * 4 > size;
+        }
+
+        // Rebuild the tree with the same sort mode
+        if (rebuild)
+        {
+            if (_sorted)
+            {
+                insert(shapes);
+            }
+            else
+            {
+                insert_no_sort(shapes);
+            }
+
+            return false;
+        }
+
+        // Copy the new shapes into their slots, sorted slots map back to insertion order
+        for (size_t i = 0; i < size; i++)
+        {
+            _shapes[i] = shapes[_sorted ? _index_map[i] : i];
+        }
+
+        // Redistribute the keys into the existing cells
+        clear(_root, _depth);
+        std::vector<K> &root_keys = _root.get_keys();
+        root_keys.resize(size);
+        std::iota(root_keys.begin(), root_keys.end(), 0);
+        refit(_root, _depth);
+
+        return true;
+    }
+    inline void set_parallel_depth(const K depth)
+    {
+        // Levels split serially before the subtrees below them are built and walked as parallel tasks
+        _parallel_depth = depth;
+    }
+    inline void update(const std::vector<shape<T, vec>> &shapes, const std::vector<K> &moved)
+    {
+        // Keep the cells and sort order of the last build, rebuilds when they no longer fit the shapes
+        refit(shapes);
+    }
     inline const std::vector<K> &point_inside(const vec<T> &point) const
     {
         // Check if tree is not built yet
@@ -0,0 +1,148 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_ARENA_MGL_
+#define _MGL_ARENA_MGL_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace min
+{
+
+class arena
+{
+  private:
+    static constexpr size_t _min_block = 65536;
+    std::vector<std::unique_ptr<char[]>> _blocks;
+    std::vector<size_t> _sizes;
+    size_t _offset;
+    size_t _total;
+
+    inline void grow(const size_t size, const size_t align)
+    {
+        // Double the capacity and make room for the request plus alignment padding
+        const size_t double_size = (_total > _min_block) ? _total : _min_block;
+        const size_t bytes = std::max(double_size, size + align);
+        _blocks.emplace_back(new char[bytes]);
+        _sizes.push_back(bytes);
+        _offset = 0;
+        _total += bytes;
+    }
+
+  public:
+    arena() : _offset(0), _total(0) {}
+
+    inline void *allocate(const size_t size, const size_t align)
+    {
+        // Grow on first use
+        if (_blocks.size() == 0)
+        {
+            grow(size, align);
+        }
+
+        // Align the bump pointer in the current block
+        char *const base = _blocks.back().get();
+        const uintptr_t address = reinterpret_cast<uintptr_t>(base) + _offset;
+        size_t begin = _offset + ((align - (address % align)) % align);
+
+        // Grow if the request doesn't fit in the current block
+        if (begin + size > _sizes.back())
+        {
+            grow(size, align);
+            return allocate(size, align);
+        }
+
+        // Bump the pointer
+        _offset = begin + size;
+        return base + begin;
+    }
+    template <typename T>
+    inline T *allocate(const size_t n)
+    {
+        return static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+    }
+    inline size_t capacity() const
+    {
+        return _total;
+    }
+    inline void reset()
+    {
+        // Merge blocks into one so the next pass doesn't need to grow
+        if (_blocks.size() > 1)
+        {
+            const size_t total = _total;
+            _blocks.clear();
+            _sizes.clear();
+            _blocks.emplace_back(new char[total]);
+            _sizes.push_back(total);
+        }
+
+        // Rewind the bump pointer
+        _offset = 0;
+    }
+    inline size_t size() const
+    {
+        // Bytes used in the current block
+        return _offset;
+    }
+};
+
+template <typename T>
+class arena_allocator
+{
+  private:
+    arena *_arena;
+
+  public:
+    typedef T value_type;
+
+    arena_allocator(arena &a) : _arena(&a) {}
+    template <typename U>
+    arena_allocator(const arena_allocator<U> &other) : _arena(other.get_arena()) {}
+
+    inline T *allocate(const size_t n)
+    {
+        return _arena->allocate<T>(n);
+    }
+    inline void deallocate(T *, const size_t)
+    {
+        // Memory is released when the arena is reset
+    }
+    inline arena *get_arena() const
+    {
+        return _arena;
+    }
+};
+
+template <typename T, typename U>
+inline bool operator==(const arena_allocator<T> &a, const arena_allocator<U> &b)
+{
+    return a.get_arena() == b.get_arena();
+}
+template <typename T, typename U>
+inline bool operator!=(const arena_allocator<T> &a, const arena_allocator<U> &b)
+{
+    return a.get_arena() != b.get_arena();
+}
+
+template <typename T>
+using arena_vector = std::vector<T, arena_allocator<T>>;
+}
+
+#endif
@@ -0,0 +1,108 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_PARALLEL_SORT_MGL_
+#define _MGL_PARALLEL_SORT_MGL_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <min/sort.h>
+#include <min/thread_pool.h>
+#include <random>
+#include <vector>
+
+namespace min
+{
+// Parallel radix sort for unsigned integers, stable like the serial version
+template <typename T, typename F>
+inline void uint_sort(std::vector<T> &uints, std::vector<T> &copy, F &&key_function, thread_pool &pool)
+{
+    const size_t size = uints.size();
+    const size_t blocks = pool.get_thread_count();
+
+    // Divert to the serial sort if there is not enough work to split
+    if (size < 128 * blocks || blocks == 1)
+    {
+        return uint_sort<T>(uints, copy, key_function);
+    }
+
+    // Initialize copy vector
+    copy.resize(size, 0);
+    std::vector<T> *from = &uints;
+    std::vector<T> *to = &copy;
+    std::vector<T> *temp = nullptr;
+
+    // Counts are stored digit major, block minor, so an exclusive scan gives stable offsets
+    std::vector<size_t> counts(256 * blocks);
+    const int passes = sizeof(T) / sizeof(uint8_t);
+
+    for (int i = 0; i < passes; i++)
+    {
+        // Count frequency in each block
+        const auto count = [&from, &counts, &key_function, size, blocks, i](std::mt19937 &gen, const size_t b) {
+            // Zero counts for this block
+            for (size_t k = 0; k < 256; k++)
+            {
+                counts[k * blocks + b] = 0;
+            }
+
+            // Count the frequency of key in this block
+            const size_t begin = (b * size) / blocks;
+            const size_t end = ((b + 1) * size) / blocks;
+            for (size_t j = begin; j < end; j++)
+            {
+                const uint_fast8_t key = (key_function((*from)[j]) >> 8 * i) & (0xFF);
+                counts[key * blocks + b]++;
+            }
+        };
+        pool.run(std::cref(count), 0, blocks);
+
+        // Prefix sum
+        pool.parallel_exclusive_scan(counts, counts, static_cast<size_t>(0), [](const size_t a, const size_t b) {
+            return a + b;
+        });
+
+        // Sort each block into its offsets
+        const auto scatter = [&from, &to, &counts, &key_function, size, blocks, i](std::mt19937 &gen, const size_t b) {
+            const size_t begin = (b * size) / blocks;
+            const size_t end = ((b + 1) * size) / blocks;
+            for (size_t j = begin; j < end; j++)
+            {
+                // Extract the key
+                const T ui = (*from)[j];
+                const uint_fast8_t key = (key_function(ui) >> 8 * i) & (0xFF);
+
+                // Perform copy sort
+                (*to)[counts[key * blocks + b]++] = ui;
+            }
+        };
+        pool.run(std::cref(scatter), 0, blocks);
+
+        // Swap from/to for next pass
+        temp = from;
+        from = to;
+        to = temp;
+    }
+
+    // *from was the last *to
+    // Copy sorted array into output, if needed
+    if (from != &uints)
+    {
+        uints.swap(copy);
+    }
+}
+}
+
+#endif
@@ -0,0 +1,182 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_PHILOX_MGL_
+#define _MGL_PHILOX_MGL_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace min
+{
+
+// Counter based Philox4x32-10 generator, keyed by (seed, stream)
+// Any block of the sequence can be computed without the ones before it, so each task gets its own stream
+class philox
+{
+  public:
+    typedef uint32_t result_type;
+
+  private:
+    static constexpr uint32_t _m0 = 0xD2511F53;
+    static constexpr uint32_t _m1 = 0xCD9E8D57;
+    static constexpr uint32_t _w0 = 0x9E3779B9;
+    static constexpr uint32_t _w1 = 0xBB67AE85;
+    uint32_t _key[2];
+    uint32_t _stream[2];
+    uint64_t _block;
+    uint32_t _out[4];
+    unsigned _index;
+
+    static inline void mulhilo(const uint32_t a, const uint32_t b, uint32_t &hi, uint32_t &lo)
+    {
+        const uint64_t product = static_cast<uint64_t>(a) * b;
+        hi = static_cast<uint32_t>(product >> 32);
+        lo = static_cast<uint32_t>(product);
+    }
+    inline void refill()
+    {
+        // Compute the next block of four numbers
+        block(_block++, _out);
+        _index = 0;
+    }
+
+  public:
+    philox(const uint64_t seed, const uint64_t stream)
+        : _key{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)},
+          _stream{static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)},
+          _block(0), _out{0, 0, 0, 0}, _index(4) {}
+
+    static constexpr result_type min()
+    {
+        return 0;
+    }
+    static constexpr result_type max()
+    {
+        return 0xFFFFFFFF;
+    }
+    inline result_type operator()()
+    {
+        // Refill when the block is used up
+        if (_index == 4)
+        {
+            refill();
+        }
+
+        return _out[_index++];
+    }
+    inline void block(const uint64_t n, uint32_t *const out) const
+    {
+        // Counter is the block number and the stream
+        uint32_t c0 = static_cast<uint32_t>(n);
+        uint32_t c1 = static_cast<uint32_t>(n >> 32);
+        uint32_t c2 = _stream[0];
+        uint32_t c3 = _stream[1];
+        uint32_t k0 = _key[0];
+        uint32_t k1 = _key[1];
+
+        // Ten rounds of Philox
+        for (unsigned r = 0; r < 10; r++)
+        {
+            uint32_t hi0, lo0, hi1, lo1;
+            mulhilo(_m0, c0, hi0, lo0);
+            mulhilo(_m1, c2, hi1, lo1);
+            c0 = hi1 ^ c1 ^ k0;
+            c1 = lo1;
+            c2 = hi0 ^ c3 ^ k1;
+            c3 = lo0;
+
+            // Bump the key
+            k0 += _w0;
+            k1 += _w1;
+        }
+
+        out[0] = c0;
+        out[1] = c1;
+        out[2] = c2;
+        out[3] = c3;
+    }
+    inline void discard(const uint64_t n)
+    {
+        // Skip ahead without generating the skipped numbers
+        const uint64_t position = (_block * 4 - (4 - _index)) + n;
+        seek(position);
+    }
+    inline void generate(uint32_t *const out, const size_t n)
+    {
+        size_t i = 0;
+
+        // Drain the current block
+        while (_index < 4 && i < n)
+        {
+            out[i++] = _out[_index++];
+        }
+
+        // Whole blocks are independent so this loop has no carried state
+        const size_t blocks = (n - i) / 4;
+        for (size_t b = 0; b < blocks; b++)
+        {
+            block(_block + b, out + i + b * 4);
+        }
+        _block += blocks;
+        i += blocks * 4;
+
+        // Finish the tail from a fresh block
+        while (i < n)
+        {
+            out[i++] = (*this)();
+        }
+    }
+    inline void seek(const uint64_t position)
+    {
+        // Jump to the block holding this position
+        _block = position / 4;
+        _index = static_cast<unsigned>(position % 4);
+        if (_index > 0)
+        {
+            block(_block++, _out);
+        }
+        else
+        {
+            _index = 4;
+        }
+    }
+    template <typename T>
+    static inline T to_unit(const uint32_t x)
+    {
+        // Map to [0, 1) using as many bits as fit the mantissa exactly
+        return (sizeof(T) < sizeof(double))
+                   ? static_cast<T>(x >> 8) * static_cast<T>(1.0 / 16777216.0)
+                   : static_cast<T>(x) * static_cast<T>(1.0 / 4294967296.0);
+    }
+    template <typename T>
+    inline void uniform(T *const out, const size_t n, const T lower, const T upper)
+    {
+        // Generate raw bits in small batches and scale them to the range
+        const T range = upper - lower;
+        uint32_t bits[64];
+        for (size_t i = 0; i < n; i += 64)
+        {
+            const size_t count = (n - i < 64) ? n - i : 64;
+            generate(bits, count);
+            for (size_t j = 0; j < count; j++)
+            {
+                out[i + j] = lower + range * to_unit<T>(bits[j]);
+            }
+        }
+    }
+};
+}
+
+#endif
@@ -0,0 +1,307 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_TASK_GRAPH_MGL_
+#define _MGL_TASK_GRAPH_MGL_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <min/thread_pool.h>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace min
+{
+
+class task_graph
+{
+  private:
+    std::vector<std::function<void(std::mt19937 &gen)>> _tasks;
+    std::vector<std::vector<size_t>> _next;
+    std::vector<std::vector<size_t>> _prev;
+    std::vector<size_t> _order;
+    std::vector<size_t> _wait;
+    std::vector<size_t> _ready;
+    std::vector<double> _start;
+    std::vector<double> _time;
+    std::vector<double> _path;
+    std::mutex _ready_lock;
+    std::condition_variable _ready_cond;
+    size_t _remaining;
+    std::exception_ptr _error;
+    std::chrono::high_resolution_clock::time_point _epoch;
+    double _critical;
+    double _total;
+    bool _dirty;
+
+    inline void check_task(const size_t task) const
+    {
+        if (task >= _tasks.size())
+        {
+            throw std::runtime_error("task_graph: invalid task id " + std::to_string(task));
+        }
+    }
+    inline void execute(const size_t task, std::mt19937 &gen)
+    {
+        // Time the task relative to the start of this run
+        const auto start = std::chrono::high_resolution_clock::now();
+        try
+        {
+            _tasks[task](gen);
+        }
+        catch (...)
+        {
+            // Keep the first error and abort the run, it is rethrown by run()
+            std::lock_guard<std::mutex> lock(_ready_lock);
+            if (!_error)
+            {
+                _error = std::current_exception();
+            }
+
+            // Wake up all schedulers so they can leave
+            _ready_cond.notify_all();
+            return;
+        }
+        const auto stop = std::chrono::high_resolution_clock::now();
+
+        // Record the task timing, each task writes only its own slot
+        _start[task] = std::chrono::duration<double, std::milli>(start - _epoch).count();
+        _time[task] = std::chrono::duration<double, std::milli>(stop - start).count();
+
+        // Release all tasks waiting on this task
+        std::lock_guard<std::mutex> lock(_ready_lock);
+        for (const size_t next : _next[task])
+        {
+            // The last dependency to finish makes the task ready
+            if (--_wait[next] == 0)
+            {
+                _ready.push_back(next);
+                _ready_cond.notify_one();
+            }
+        }
+
+        // Wake up all schedulers when the graph is finished
+        if (--_remaining == 0)
+        {
+            _ready_cond.notify_all();
+        }
+    }
+    inline bool pop_ready(size_t &task)
+    {
+        // Sleep until a task is ready, the graph is finished or a task failed
+        std::unique_lock<std::mutex> lock(_ready_lock);
+        _ready_cond.wait(lock, [this]() { return _ready.size() > 0 || _remaining == 0 || _error; });
+
+        // Stop scheduling after an error, tasks still running finish on their own
+        if (_error || _ready.size() == 0)
+        {
+            return false;
+        }
+
+        task = _ready.back();
+        _ready.pop_back();
+        return true;
+    }
+    inline void sort()
+    {
+        // Calculate the topological order of the graph with Kahn's algorithm
+        const size_t size = _tasks.size();
+        std::vector<size_t> in(size);
+        _order.clear();
+        _order.reserve(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            in[i] = _prev[i].size();
+            if (in[i] == 0)
+            {
+                _order.push_back(i);
+            }
+        }
+
+        // Release successors as their dependencies are satisfied
+        for (size_t i = 0; i < _order.size(); i++)
+        {
+            for (const size_t next : _next[_order[i]])
+            {
+                if (--in[next] == 0)
+                {
+                    _order.push_back(next);
+                }
+            }
+        }
+
+        // All tasks must be ordered for the graph to be acyclic
+        if (_order.size() != size)
+        {
+            throw std::runtime_error("task_graph: dependency cycle detected");
+        }
+
+        // Allocate the per run buffers
+        _wait.resize(size);
+        _ready.reserve(size);
+        _start.resize(size);
+        _time.resize(size);
+        _path.resize(size);
+
+        // The graph is now clean
+        _dirty = false;
+    }
+    inline void critical_path()
+    {
+        // Longest chain of task times through the graph, in topological order
+        _critical = 0.0;
+        for (const size_t task : _order)
+        {
+            double longest = 0.0;
+            for (const size_t prev : _prev[task])
+            {
+                longest = std::max(longest, _path[prev]);
+            }
+
+            // Update the path ending at this task
+            _path[task] = longest + _time[task];
+            _critical = std::max(_critical, _path[task]);
+        }
+    }
+
+  public:
+    task_graph() : _remaining(0), _error(nullptr), _critical(0.0), _total(0.0), _dirty(false) {}
+
+    inline size_t add(const std::function<void(std::mt19937 &gen)> &f)
+    {
+        // Add the task to the graph
+        _tasks.push_back(f);
+        _next.emplace_back();
+        _prev.emplace_back();
+
+        // Graph must be sorted again
+        _dirty = true;
+
+        // Return the task id
+        return _tasks.size() - 1;
+    }
+    inline void clear()
+    {
+        _tasks.clear();
+        _next.clear();
+        _prev.clear();
+        _order.clear();
+        _critical = 0.0;
+        _total = 0.0;
+        _dirty = false;
+    }
+    inline void depend(const size_t task, const size_t on)
+    {
+        check_task(task);
+        check_task(on);
+
+        // Task can't start until 'on' has finished
+        _next[on].push_back(task);
+        _prev[task].push_back(on);
+
+        // Graph must be sorted again
+        _dirty = true;
+    }
+    inline double get_critical_path() const
+    {
+        // Milliseconds spent on the longest dependency chain of the last run
+        return _critical;
+    }
+    inline double get_start(const size_t task) const
+    {
+        // Milliseconds from start of the last run until this task started
+        return _start[task];
+    }
+    inline double get_task_time(const size_t task) const
+    {
+        // Milliseconds this task took in the last run
+        return _time[task];
+    }
+    inline double get_time() const
+    {
+        // Milliseconds the last run took
+        return _total;
+    }
+    inline void run(thread_pool &pool)
+    {
+        // Sort the graph if it changed since the last run
+        if (_dirty)
+        {
+            sort();
+        }
+
+        // Nothing to do
+        const size_t size = _tasks.size();
+        if (size == 0)
+        {
+            return;
+        }
+
+        // Reset the dependency counters and seed the ready list with root tasks
+        _ready.clear();
+        for (size_t i = 0; i < size; i++)
+        {
+            _wait[i] = _prev[i].size();
+            if (_prev[i].size() == 0)
+            {
+                _ready.push_back(i);
+            }
+        }
+
+        // Start the clock
+        _remaining = size;
+        _error = nullptr;
+        _epoch = std::chrono::high_resolution_clock::now();
+
+        // Every thread pulls ready tasks until the graph is finished or a task fails
+        const auto work = [this](std::mt19937 &gen, const size_t i) {
+            size_t task;
+            while (this->pop_ready(task))
+            {
+                this->execute(task, gen);
+            }
+        };
+
+        // Run one scheduler per thread, tasks must not call pool.run() themselves
+        pool.run(std::cref(work), 0, pool.get_thread_count());
+
+        // Rethrow the first task error after every scheduler has left
+        if (_error)
+        {
+            const std::exception_ptr error = _error;
+            _error = nullptr;
+            std::rethrow_exception(error);
+        }
+
+        // Stop the clock
+        const auto dtime = std::chrono::high_resolution_clock::now() - _epoch;
+        _total = std::chrono::duration<double, std::milli>(dtime).count();
+
+        // Calculate the critical path of this run
+        critical_path();
+    }
+    inline size_t size() const
+    {
+        return _tasks.size();
+    }
+};
+}
+
+#endif
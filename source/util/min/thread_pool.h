@@ -15,55 +15,496 @@ limitations under the License.
 #ifndef _MGL_THREAD_POOL_MGL_
 #define _MGL_THREAD_POOL_MGL_
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <condition_variable>
+#include <cstddef>
+#include <fstream>
 #include <functional>
+#include <memory>
+#include <min/arena.h>
+#include <min/philox.h>
 #include <mutex>
+#include <new>
 #include <random>
 #include <stdexcept>
+#include <string>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
+
+#if defined(_WIN32)
+#include <windows.h>
+
+// This pollutes the namespace
+#undef far
+#undef near
+#undef max
+#undef min
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace min
 {
 
+inline void cpu_pause()
+{
+    // Hint to the CPU that we are spinning on a shared variable
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    _mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+inline bool pin_thread(const unsigned core)
+{
+#if defined(_WIN32)
+    // Core masks are limited to the bits in a pointer
+    if (core >= sizeof(DWORD_PTR) * 8)
+    {
+        return false;
+    }
+
+    // Pin the calling thread to the core
+    const DWORD_PTR mask = static_cast<DWORD_PTR>(1) << core;
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+    // Core sets are limited to CPU_SETSIZE
+    if (core >= CPU_SETSIZE)
+    {
+        return false;
+    }
+
+    // Pin the calling thread to the core
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) == 0;
+#else
+    // Affinity is not supported, leave placement to the OS
+    return false;
+#endif
+}
+
 class work_item
 {
   private:
-    std::function<void(std::mt19937 &gen, const size_t)> _f;
+    const void *_f;
+    void (*_call)(const void *f, std::mt19937 &gen, arena &scratch, const size_t begin, const size_t end);
     size_t _begin;
     size_t _length;
 
+    template <typename F>
+    static inline auto invoke(const F &f, std::mt19937 &gen, arena &scratch, const size_t i, int)
+        -> decltype(f(gen, scratch, i), void())
+    {
+        // Callables taking a scratch arena
+        f(gen, scratch, i);
+    }
+    template <typename F>
+    static inline void invoke(const F &f, std::mt19937 &gen, arena &scratch, const size_t i, long)
+    {
+        // Callables without a scratch arena
+        f(gen, i);
+    }
+    template <typename F>
+    static void call(const void *f, std::mt19937 &gen, arena &scratch, const size_t begin, const size_t end)
+    {
+        // The callable is inlined into the item loop
+        const F &func = *static_cast<const F *>(f);
+        for (size_t i = begin; i < end; i++)
+        {
+            // Do the work for this item
+            invoke(func, gen, scratch, i, 0);
+        }
+    }
+
   public:
-    work_item(const std::function<void(std::mt19937 &gen, const size_t)> &f, const size_t begin, const size_t length)
-        : _f(f), _begin(begin), _length(length) {}
+    work_item() : _f(nullptr), _call(nullptr), _begin(0), _length(0) {}
+    template <typename F>
+    work_item(const F &f, const size_t begin, const size_t length)
+        : _f(&f), _call(&call<F>), _begin(begin), _length(length) {}
 
-    inline void work(std::mt19937 &gen) const
+    inline size_t size() const
+    {
+        return _length;
+    }
+    inline void work(std::mt19937 &gen, arena &scratch) const
     {
-        const size_t end = _begin + _length;
-        for (size_t i = _begin; i < end; i++)
+        _call(_f, gen, scratch, _begin, _begin + _length);
+    }
+    inline void work(std::mt19937 &gen, arena &scratch, const size_t begin, const size_t end) const
+    {
+        _call(_f, gen, scratch, begin, end);
+    }
+};
+
+class job
+{
+  private:
+    static constexpr size_t _size = 64;
+    typename std::aligned_storage<_size, alignof(std::max_align_t)>::type _storage;
+    void (*_call)(void *f, std::mt19937 &gen);
+    void (*_destroy)(void *f);
+    std::atomic<size_t> _generation;
+    std::atomic<int> _state;
+
+    template <typename F>
+    static void call(void *f, std::mt19937 &gen)
+    {
+        (*static_cast<F *>(f))(gen);
+    }
+    template <typename F>
+    static void destroy(void *f)
+    {
+        static_cast<F *>(f)->~F();
+    }
+
+  public:
+    // Slot states
+    static constexpr int free_slot = 0;
+    static constexpr int filling = 1;
+    static constexpr int ready = 2;
+    static constexpr int running = 3;
+
+    job() : _call(nullptr), _destroy(nullptr), _generation(0), _state(free_slot) {}
+
+    inline bool claim()
+    {
+        // Reserve a free slot for filling
+        int expect = free_slot;
+        return _state.compare_exchange_strong(expect, filling);
+    }
+    inline size_t generation() const
+    {
+        return _generation;
+    }
+    inline void publish()
+    {
+        // ATOMIC: Signal the job is ready to run
+        _state = ready;
+    }
+    inline bool take()
+    {
+        // Try to take the job, only one thread can run it
+        int expect = ready;
+        return _state.compare_exchange_strong(expect, running);
+    }
+    inline void execute(std::mt19937 &gen)
+    {
+        // Do the taken job and release the slot
+        _call(&_storage, gen);
+        _destroy(&_storage);
+
+        // ATOMIC: Signal finished, then free the slot
+        _generation++;
+        _state = free_slot;
+    }
+    template <typename F>
+    inline void set(F &&f)
+    {
+        typedef typename std::decay<F>::type type;
+        static_assert(sizeof(type) <= _size, "job: callable does not fit in the inline slot");
+        static_assert(alignof(type) <= alignof(std::max_align_t), "job: callable alignment is too large");
+
+        // Copy the callable into the inline slot, no memory allocation here
+        new (&_storage) type(std::forward<F>(f));
+        _call = &call<type>;
+        _destroy = &destroy<type>;
+    }
+    inline int state() const
+    {
+        return _state;
+    }
+};
+
+class thread_pool;
+
+class job_handle
+{
+  private:
+    thread_pool *_pool;
+    job *_job;
+    size_t _generation;
+
+  public:
+    job_handle() : _pool(nullptr), _job(nullptr), _generation(0) {}
+    job_handle(thread_pool *pool, job *j, const size_t generation)
+        : _pool(pool), _job(j), _generation(generation) {}
+
+    inline bool done() const
+    {
+        // The slot generation moves on when the job finishes
+        return !_job || _job->generation() != _generation;
+    }
+    inline void wait();
+};
+
+class work_queue
+{
+  private:
+    // Packed chunk range, head in the low 32 bits and tail in the high 32 bits
+    std::atomic<uint64_t> _range;
+
+    static inline uint64_t pack(const uint64_t head, const uint64_t tail)
+    {
+        return (tail << 32) | head;
+    }
+    static inline uint32_t head(const uint64_t range)
+    {
+        return static_cast<uint32_t>(range & 0xFFFFFFFF);
+    }
+    static inline uint32_t tail(const uint64_t range)
+    {
+        return static_cast<uint32_t>(range >> 32);
+    }
+
+  public:
+    work_queue() : _range(0) {}
+
+    inline bool pop(size_t &chunk)
+    {
+        // The owner takes chunks from the front of the queue
+        uint64_t range = _range.load();
+        while (head(range) < tail(range))
         {
-            // Do the work for this item
-            _f(gen, i);
+            // Try to claim the head chunk
+            const uint64_t next = pack(head(range) + 1, tail(range));
+            if (_range.compare_exchange_weak(range, next))
+            {
+                chunk = head(range);
+                return true;
+            }
+        }
+
+        // Queue is empty
+        return false;
+    }
+    inline void reset(const size_t begin, const size_t end)
+    {
+        _range = pack(begin, end);
+    }
+    inline size_t size() const
+    {
+        const uint64_t range = _range.load();
+        return tail(range) - head(range);
+    }
+    inline bool steal(size_t &chunk)
+    {
+        // Thieves take chunks from the back of the queue
+        uint64_t range = _range.load();
+        while (head(range) < tail(range))
+        {
+            // Try to claim the tail chunk
+            const uint64_t next = pack(head(range), tail(range) - 1);
+            if (_range.compare_exchange_weak(range, next))
+            {
+                chunk = tail(range) - 1;
+                return true;
+            }
+        }
+
+        // Queue is empty
+        return false;
+    }
+};
+
+#ifdef MGL_THREAD_STATS
+class thread_stats
+{
+  public:
+    typedef std::chrono::steady_clock clock;
+
+    class event
+    {
+      private:
+        const char *_name;
+        double _start;
+        double _duration;
+
+      public:
+        event(const char *name, const double start, const double duration)
+            : _name(name), _start(start), _duration(duration) {}
+
+        inline double get_duration() const
+        {
+            return _duration;
+        }
+        inline const char *get_name() const
+        {
+            return _name;
         }
+        inline double get_start() const
+        {
+            return _start;
+        }
+    };
+
+  private:
+    clock::time_point _origin;
+    double _busy;
+    double _idle;
+    double _last_busy;
+    double _wake;
+    double _max_wake;
+    size_t _wakes;
+    size_t _items;
+    size_t _steals;
+    std::vector<event> _events;
+
+    inline double to_us(const clock::time_point t) const
+    {
+        return std::chrono::duration<double, std::micro>(t - _origin).count();
+    }
+    static inline double to_ms(const clock::duration d)
+    {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+
+  public:
+    thread_stats() : _origin(clock::now()), _busy(0.0), _idle(0.0), _last_busy(0.0),
+                     _wake(0.0), _max_wake(0.0), _wakes(0), _items(0), _steals(0) {}
+
+    inline void add_busy(const char *name, const clock::time_point start, const clock::time_point stop)
+    {
+        // Accumulate busy time and record a trace event
+        const double ms = to_ms(stop - start);
+        _busy += ms;
+        _last_busy = ms;
+        _events.emplace_back(name, to_us(start), ms * 1000.0);
+    }
+    inline void add_idle(const clock::time_point start, const clock::time_point stop)
+    {
+        _idle += to_ms(stop - start);
+    }
+    inline void add_items(const size_t items)
+    {
+        _items += items;
+    }
+    inline void add_steal()
+    {
+        _steals++;
+    }
+    inline void add_wake(const clock::time_point dispatch, const clock::time_point wake)
+    {
+        // Time from dispatch until the worker saw the work
+        const double ms = to_ms(wake - dispatch);
+        _wake += ms;
+        _max_wake = std::max(_max_wake, ms);
+        _wakes++;
+    }
+    inline double get_busy_time() const
+    {
+        return _busy;
+    }
+    inline const std::vector<event> &get_events() const
+    {
+        return _events;
+    }
+    inline double get_idle_time() const
+    {
+        return _idle;
+    }
+    inline size_t get_items() const
+    {
+        return _items;
+    }
+    inline double get_last_busy_time() const
+    {
+        return _last_busy;
+    }
+    inline double get_max_wake_latency() const
+    {
+        return _max_wake;
+    }
+    inline size_t get_steals() const
+    {
+        return _steals;
+    }
+    inline double get_wake_latency() const
+    {
+        // Average wake latency
+        return (_wakes > 0) ? _wake / _wakes : 0.0;
+    }
+    inline size_t get_wakes() const
+    {
+        return _wakes;
+    }
+    inline void reset(const clock::time_point origin)
+    {
+        *this = thread_stats();
+        _origin = origin;
+    }
+};
+#endif
+
+class thread_data
+{
+  private:
+    work_item _work;
+    work_queue _queue;
+    std::mt19937 _gen;
+    arena _scratch;
+#ifdef MGL_THREAD_STATS
+    thread_stats _stats;
+#endif
+
+  public:
+    thread_data()
+        : _gen(static_cast<uint32_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count())) {}
+
+    inline work_queue &queue()
+    {
+        return _queue;
+    }
+    inline std::mt19937 &rand()
+    {
+        return _gen;
+    }
+    inline arena &scratch()
+    {
+        return _scratch;
+    }
+#ifdef MGL_THREAD_STATS
+    inline thread_stats &stats()
+    {
+        return _stats;
+    }
+#endif
+    inline work_item &work()
+    {
+        return _work;
     }
 };
 
 class thread
 {
   private:
-    std::vector<work_item> _work;
-    std::atomic<bool> _sleep;
+    std::unique_ptr<thread_data> _data;
     std::atomic<bool> _state;
     std::thread _thread;
-    std::mt19937 _gen;
 
   public:
-    thread()
-        : _sleep(true), _state(false),
-          _gen(static_cast<uint32_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count())) {}
+    thread() : _state(false) {}
 
+    inline void allocate()
+    {
+        // The allocating thread touches the memory first, placing it on that thread's NUMA node
+        _data.reset(new thread_data());
+    }
     inline std::thread &get_thread()
     {
         return _thread;
@@ -72,151 +513,411 @@ class thread
     {
         _thread.join();
     }
+    inline work_queue &queue()
+    {
+        return _data->queue();
+    }
     inline std::mt19937 &rand()
     {
-        return _gen;
+        return _data->rand();
+    }
+    inline arena &scratch()
+    {
+        return _data->scratch();
     }
     inline void seed(const size_t seed)
     {
-        _gen.seed(seed);
+        _data->rand().seed(seed);
     }
-    inline void set_sleep(const bool flag)
+#ifdef MGL_THREAD_STATS
+    inline thread_stats &stats()
     {
-        _sleep = flag;
+        return _data->stats();
     }
+#endif
     inline void set_state(const bool flag)
     {
         _state = flag;
     }
-    inline bool sleep() const
-    {
-        return _sleep;
-    }
     inline bool state() const
     {
         return _state;
     }
-    inline std::vector<work_item> &work()
+    inline work_item &work()
     {
-        return _work;
+        return _data->work();
+    }
+};
+
+class thread_pool_config
+{
+  private:
+    size_t _threads;
+    std::vector<unsigned> _affinity;
+    bool _numa_local;
+
+  public:
+    thread_pool_config() : _threads(0), _numa_local(true) {}
+
+    inline const std::vector<unsigned> &get_affinity() const
+    {
+        return _affinity;
+    }
+    inline bool get_numa_local() const
+    {
+        return _numa_local;
+    }
+    inline size_t get_threads() const
+    {
+        return _threads;
+    }
+    inline void set_affinity(const std::vector<unsigned> &cores)
+    {
+        // Workers are pinned round robin to these cores, empty leaves placement to the OS
+        _affinity = cores;
+    }
+    inline void set_numa_local(const bool flag)
+    {
+        // Workers allocate their own queue and generator after pinning, so first touch places them on the local node
+        _numa_local = flag;
+    }
+    inline void set_threads(const size_t threads)
+    {
+        // Total thread count including the calling thread, zero uses all hardware threads
+        _threads = threads;
     }
 };
 
 class thread_pool
 {
+    friend class job_handle;
+
   private:
+    static constexpr size_t _job_count = 64;
+    static constexpr size_t _scan_cutoff = 4096;
+    static constexpr size_t _spin_count = 4096;
+    thread_pool_config _config;
     unsigned _thread_count;
     std::vector<thread> _threads;
+    std::atomic<size_t> _booted;
     std::mutex _sleep_lock;
     std::condition_variable _more_data;
+    std::mutex _done_lock;
+    std::condition_variable _done;
+    std::atomic<size_t> _parked;
+    std::atomic<size_t> _pending;
     std::atomic<bool> _die;
     std::atomic<bool> _turbo;
     std::mt19937 _gen;
+    uint64_t _philox_seed;
+    arena _scratch;
+    work_queue _queue;
+    work_item _steal_item;
+    size_t _steal_start;
+    size_t _steal_stop;
+    size_t _steal_grain;
+    size_t _grain;
+    bool _steal;
+    bool _stealing;
+    job _jobs[_job_count];
+    std::atomic<size_t> _job_pending;
+    std::atomic<size_t> _job_cursor;
+#ifdef MGL_THREAD_STATS
+    thread_stats _stats;
+    thread_stats::clock::time_point _origin;
+    thread_stats::clock::time_point _dispatch_time;
+    double _imbalance;
+    double _max_imbalance;
+    size_t _runs;
+#endif
 
-    inline void notify()
+    inline work_queue &get_queue(const size_t index)
+    {
+        // The calling thread owns the last queue
+        return (index < _thread_count - 1) ? _threads[index].queue() : _queue;
+    }
+    inline void steal_chunk(const size_t index, const size_t chunk, std::mt19937 &gen, arena &scratch)
     {
-        // If we are sleeping, wait for all threads to sleep before killing queue
-        if (!_turbo)
+        // Calculate the item range of this chunk
+        const size_t begin = _steal_start + chunk * _steal_grain;
+        const size_t end = std::min(begin + _steal_grain, _steal_stop);
+
+        // Do the work for this chunk
+        _steal_item.work(gen, scratch, begin, end);
+
+#ifdef MGL_THREAD_STATS
+        stats(index).add_items(end - begin);
+#endif
+    }
+    inline void steal_work(const size_t index, std::mt19937 &gen, arena &scratch)
+    {
+        // Drain our own queue first
+        size_t chunk;
+        work_queue &queue = get_queue(index);
+        while (queue.pop(chunk))
         {
-            // Wake up idle threads
-            _more_data.notify_all();
+            steal_chunk(index, chunk, gen, scratch);
+        }
+
+        // Steal from the other queues, queues only shrink so one pass is enough
+        for (size_t i = 1; i < _thread_count; i++)
+        {
+            work_queue &victim = get_queue((index + i) % _thread_count);
+            while (victim.steal(chunk))
+            {
+                steal_chunk(index, chunk, gen, scratch);
+
+#ifdef MGL_THREAD_STATS
+                stats(index).add_steal();
+#endif
+            }
         }
     }
-    inline void wait_sleep()
+
+    inline static std::mt19937 &local_generator()
     {
-        // Wait for all workers to quit
-        while (!_turbo)
+        // Jobs run inline on a calling thread use that thread's generator, the pool generator belongs to run()
+        static thread_local std::mt19937 gen(static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())));
+        return gen;
+    }
+    inline bool run_job(job &j, std::mt19937 &gen)
+    {
+        // Peek before trying to take the job
+        if (j.state() == job::ready && j.take())
         {
-            // Count threads asleep
-            size_t count = 0;
-            for (size_t i = 0; i < _thread_count - 1; i++)
-            {
-                // Make sure all threads are asleep
-                std::unique_lock<std::mutex> lock(_sleep_lock);
+            // ATOMIC: Pending counts jobs not taken yet, idle workers park while taken jobs run
+            _job_pending--;
+            j.execute(gen);
+            return true;
+        }
+
+        return false;
+    }
+    inline size_t run_jobs(std::mt19937 &gen)
+    {
+        // Run all jobs that are ready
+        size_t count = 0;
+        for (size_t i = 0; i < _job_count; i++)
+        {
+            count += run_job(_jobs[i], gen);
+        }
+
+        return count;
+    }
+    inline void dispatch()
+    {
+        // Count the workers that must finish before this run is done
+        _pending = _thread_count - 1;
+
+#ifdef MGL_THREAD_STATS
+        // Workers measure wake latency from this point
+        _dispatch_time = thread_stats::clock::now();
+#endif
 
-                // See if worker is finished
-                if (_threads[i].sleep() == false)
+        // ATOMIC: Set state of all workers to 'run'
+        for (size_t i = 0; i < _thread_count - 1; i++)
+        {
+            // Signal that there is work to do
+            _threads[i].set_state(true);
+        }
+
+        // Notify threads
+        notify();
+    }
+    inline void finish()
+    {
+        // The last worker to finish wakes up the parked caller
+        if (--_pending == 0)
+        {
+            std::lock_guard<std::mutex> lock(_done_lock);
+            _done.notify_one();
+        }
+    }
+    inline void idle(const size_t index)
+    {
+        while (true)
+        {
+            // Spin for a short while, or forever in turbo mode
+            // Jobs already taken by another thread don't keep workers awake
+            for (size_t i = 0; _turbo || i < _spin_count; i++)
+            {
+                if (_threads[index].state() || _die || _job_pending > 0)
                 {
-                    count++;
+                    return;
                 }
+
+                cpu_pause();
             }
 
-            // If all workers are finished
-            if (count == _thread_count - 1)
+            // ATOMIC: Signal parking before checking the condition
+            _parked++;
             {
-                break;
+                // Acquire mutex to sleep on condition
+                std::unique_lock<std::mutex> lock(_sleep_lock);
+
+                // Wait on more data
+                _more_data.wait(lock, [this, index]() { return (_threads[index].state() || _die) || _turbo || _job_pending > 0; });
             }
+            _parked--;
         }
     }
-    inline void wait_done() const
+    inline void notify()
     {
-        // Wait for all workers to quit
-        while (true)
+        // Only pay for the lock if a worker is parked
+        if (_parked > 0)
         {
-            // Count threads asleep
-            size_t count = 0;
-            for (size_t i = 0; i < _thread_count - 1; i++)
+            // Serialize with parking workers so the wake up can't be lost
             {
-                // See if worker is finished
-                if (_threads[i].state() == false)
-                {
-                    count++;
-                }
+                std::lock_guard<std::mutex> lock(_sleep_lock);
             }
 
-            // If all workers are finished
-            if (count == _thread_count - 1)
+            // Wake up idle threads
+            _more_data.notify_all();
+        }
+    }
+    inline void wait_done()
+    {
+        // Spin for a short while, or forever in turbo mode
+        for (size_t i = 0; _turbo || i < _spin_count; i++)
+        {
+            if (_pending == 0)
             {
-                break;
+                return;
             }
+
+            cpu_pause();
+        }
+
+        // Park until the last worker finishes
+        std::unique_lock<std::mutex> lock(_done_lock);
+        _done.wait(lock, [this]() { return _pending == 0; });
+    }
+#ifdef MGL_THREAD_STATS
+    inline thread_stats &stats(const size_t index)
+    {
+        // The caller owns the last stats slot
+        return (index < _thread_count - 1) ? _threads[index].stats() : _stats;
+    }
+    inline void update_imbalance()
+    {
+        // Ratio of the slowest thread to the mean busy time in the last run
+        double total = 0.0;
+        double slowest = 0.0;
+        for (size_t i = 0; i < _thread_count; i++)
+        {
+            const double busy = stats(i).get_last_busy_time();
+            total += busy;
+            slowest = std::max(slowest, busy);
         }
+        const double mean = total / _thread_count;
+        _imbalance = (mean > 0.0) ? slowest / mean : 1.0;
+        _max_imbalance = std::max(_max_imbalance, _imbalance);
+        _runs++;
     }
-    inline void wait()
+#endif
+    inline void boot(const size_t index)
     {
-        if (!_turbo)
+        // Pin the worker to its core, failure leaves placement to the OS
+        const std::vector<unsigned> &affinity = _config.get_affinity();
+        if (affinity.size() > 0)
         {
-            wait_sleep();
+            pin_thread(affinity[index % affinity.size()]);
         }
-        else
+
+        // Allocate worker data after pinning so it lands on the local NUMA node
+        if (_config.get_numa_local())
         {
-            wait_done();
+            _threads[index].allocate();
         }
+
+#ifdef MGL_THREAD_STATS
+        // Time trace events from pool creation
+        _threads[index].stats().reset(_origin);
+#endif
+
+        // ATOMIC: Signal booted
+        _booted++;
+    }
+    static inline unsigned thread_count(const thread_pool_config &config)
+    {
+        // Use all hardware threads if no count was given
+        const size_t threads = (config.get_threads() > 0) ? config.get_threads() : std::thread::hardware_concurrency();
+
+        // Fall back to the calling thread only if the core count can't be determined
+        return static_cast<unsigned>(std::max(static_cast<size_t>(1), threads));
     }
     inline void work(const size_t index)
     {
+        // Pin and allocate worker data
+        boot(index);
+
         while (true)
         {
-            // Sleep on condition
-            if (!_turbo)
-            {
-                // Acquire mutex to sleep on condition
-                std::unique_lock<std::mutex> lock(_sleep_lock);
+#ifdef MGL_THREAD_STATS
+            const auto idle_start = thread_stats::clock::now();
+#endif
 
-                // ATOMIC: Signal Sleeping
-                _threads[index].set_sleep(false);
+            // Spin then park until there is work
+            idle(index);
 
-                // Wait on more data
-                _more_data.wait(lock, [this, index]() { return (_threads[index].state() || _die) || _turbo; });
+#ifdef MGL_THREAD_STATS
+            const auto start = thread_stats::clock::now();
+            thread_stats &st = _threads[index].stats();
+            st.add_idle(idle_start, start);
+            if (_threads[index].state())
+            {
+                st.add_wake(_dispatch_time, start);
             }
+#endif
 
             // Do work
-            if (_threads[index].state())
+            if (_threads[index].state() && _stealing)
             {
-                // Get access to work
-                std::vector<work_item> &items = _threads[index].work();
-                const size_t size = items.size();
+                // Steal chunks until all queues are empty
+                steal_work(index, _threads[index].rand(), _threads[index].scratch());
 
-                // Do all work in this queue
-                for (size_t i = 0; i < size; i++)
-                {
-                    items[i].work(_threads[index].rand());
-                }
+#ifdef MGL_THREAD_STATS
+                st.add_busy("steal", start, thread_stats::clock::now());
+#endif
+
+                // Release scratch memory for the next run
+                _threads[index].scratch().reset();
+
+                // ATOMIC: Signal Finished
+                _threads[index].set_state(false);
+                finish();
+            }
+            else if (_threads[index].state())
+            {
+                // Do all work in this slot
+                _threads[index].work().work(_threads[index].rand(), _threads[index].scratch());
 
-                // Clear the queue
-                items.clear();
+#ifdef MGL_THREAD_STATS
+                st.add_busy("run", start, thread_stats::clock::now());
+                st.add_items(_threads[index].work().size());
+#endif
+
+                // Release scratch memory for the next run
+                _threads[index].scratch().reset();
 
                 // ATOMIC: Signal Finished
                 _threads[index].set_state(false);
+                finish();
+            }
+            else if (_job_pending > 0)
+            {
+                // Do submitted jobs
+                const size_t jobs = run_jobs(_threads[index].rand());
+
+#ifdef MGL_THREAD_STATS
+                if (jobs > 0)
+                {
+                    st.add_busy("job", start, thread_stats::clock::now());
+                    st.add_items(jobs);
+                }
+#else
+                (void)jobs;
+#endif
             }
             else if (_die)
             {
@@ -227,14 +928,31 @@ class thread_pool
     }
 
   public:
-    thread_pool() : _thread_count(std::thread::hardware_concurrency()),
-                    _threads(_thread_count - 1), _die(false), _turbo(false),
-                    _gen(static_cast<uint32_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count()))
+    thread_pool() : thread_pool(thread_pool_config()) {}
+    thread_pool(const thread_pool_config &config)
+        : _config(config), _thread_count(thread_count(config)),
+          _threads(_thread_count - 1), _booted(0), _parked(0), _pending(0), _die(false), _turbo(false),
+          _gen(static_cast<uint32_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count())),
+          _philox_seed(static_cast<uint64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count())),
+          _steal_start(0), _steal_stop(0), _steal_grain(1), _grain(0), _steal(false), _stealing(false),
+          _job_pending(0), _job_cursor(0)
     {
-        // Error out if can't determine core count
-        if (_thread_count < 1)
+#ifdef MGL_THREAD_STATS
+        // Trace events are timed from pool creation
+        _origin = thread_stats::clock::now();
+        _stats.reset(_origin);
+        _imbalance = 1.0;
+        _max_imbalance = 1.0;
+        _runs = 0;
+#endif
+
+        // Allocate worker data on this thread if not NUMA local
+        if (!_config.get_numa_local())
         {
-            throw std::runtime_error("thread_pool: can't determine number of CPU cores");
+            for (size_t i = 0; i < _thread_count - 1; i++)
+            {
+                _threads[i].allocate();
+            }
         }
 
         // Boot all threads
@@ -243,6 +961,12 @@ class thread_pool
             // Boot the thread
             _threads[i].get_thread() = std::thread(&thread_pool::work, this, i);
         }
+
+        // Wait for all workers to allocate their data
+        while (_booted < _thread_count - 1)
+        {
+            std::this_thread::yield();
+        }
     }
     ~thread_pool()
     {
@@ -255,14 +979,95 @@ class thread_pool
             _threads[i].join();
         }
     }
+    inline const thread_pool_config &get_config() const
+    {
+        return _config;
+    }
+#ifdef MGL_THREAD_STATS
+    inline void dump_trace(const std::string &file)
+    {
+        // Wait for all workers to finish the last run
+        wait_done();
+
+        // Open the trace file
+        std::ofstream out(file, std::ios::out | std::ios::trunc);
+        if (!out.is_open())
+        {
+            throw std::runtime_error("thread_pool: could not open trace file '" + file + "'");
+        }
+
+        // Write events in the chrome://tracing format
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        for (size_t i = 0; i < _thread_count; i++)
+        {
+            // Name the thread
+            const std::string name = (i < _thread_count - 1) ? "worker " + std::to_string(i) : "caller";
+            out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i
+                << ",\"args\":{\"name\":\"" << name << "\"}}";
+            first = false;
+
+            // Write complete events for this thread
+            for (const auto &e : stats(i).get_events())
+            {
+                out << ",\n{\"name\":\"" << e.get_name() << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << i
+                    << ",\"ts\":" << e.get_start() << ",\"dur\":" << e.get_duration() << "}";
+            }
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+    inline double get_imbalance() const
+    {
+        // Slowest thread over the mean busy time in the last run, 1.0 is perfectly balanced
+        return _imbalance;
+    }
+    inline double get_max_imbalance() const
+    {
+        return _max_imbalance;
+    }
+    inline size_t get_runs() const
+    {
+        return _runs;
+    }
+    inline const thread_stats &get_stats(const size_t index)
+    {
+        // The calling thread is the last index
+        return stats(index);
+    }
+    inline void reset_stats()
+    {
+        // Wait for all workers to finish the last run
+        wait_done();
+
+        // Clear all counters and events
+        _origin = thread_stats::clock::now();
+        for (size_t i = 0; i < _thread_count; i++)
+        {
+            stats(i).reset(_origin);
+        }
+        _imbalance = 1.0;
+        _max_imbalance = 1.0;
+        _runs = 0;
+    }
+#endif
     inline std::mt19937 &get_generator()
     {
         return _gen;
     }
+    inline size_t get_parked_count() const
+    {
+        // Workers sleeping on the condition variable
+        return _parked;
+    }
+    inline size_t get_thread_count() const
+    {
+        // Includes the calling thread
+        return _thread_count;
+    }
     inline void kill()
     {
         // Wait for threads to finish work
-        wait();
+        wait_done();
 
         // Signal dead queue
         _die = true;
@@ -270,6 +1075,106 @@ class thread_pool
         // Notify threads
         notify();
     }
+    template <typename T, typename C>
+    inline T parallel_exclusive_scan(const std::vector<T> &in, std::vector<T> &out, const T init, const C &combine)
+    {
+        // Output can alias the input
+        const size_t size = in.size();
+        out.resize(size);
+
+        // Scan serially if the array is too small to split
+        if (size < _scan_cutoff || _thread_count == 1)
+        {
+            T total = init;
+            for (size_t i = 0; i < size; i++)
+            {
+                const T value = in[i];
+                out[i] = total;
+                total = combine(total, value);
+            }
+
+            return total;
+        }
+
+        // Split the array into one block per thread
+        const size_t blocks = _thread_count;
+        std::vector<T> sums(blocks);
+
+        // Reduce each block
+        const auto reduce = [&in, &sums, &combine, size, blocks](std::mt19937 &gen, const size_t b) {
+            const size_t begin = (b * size) / blocks;
+            const size_t end = ((b + 1) * size) / blocks;
+            T sum = in[begin];
+            for (size_t i = begin + 1; i < end; i++)
+            {
+                sum = combine(sum, in[i]);
+            }
+            sums[b] = sum;
+        };
+        run(std::cref(reduce), 0, blocks);
+
+        // Scan the block sums to get each block offset
+        T total = init;
+        for (size_t b = 0; b < blocks; b++)
+        {
+            const T sum = sums[b];
+            sums[b] = total;
+            total = combine(total, sum);
+        }
+
+        // Scan each block starting at its offset
+        const auto scan = [&in, &out, &sums, &combine, size, blocks](std::mt19937 &gen, const size_t b) {
+            const size_t begin = (b * size) / blocks;
+            const size_t end = ((b + 1) * size) / blocks;
+            T sum = sums[b];
+            for (size_t i = begin; i < end; i++)
+            {
+                const T value = in[i];
+                out[i] = sum;
+                sum = combine(sum, value);
+            }
+        };
+        run(std::cref(scan), 0, blocks);
+
+        // Return the reduction of the whole array
+        return total;
+    }
+    template <typename T, typename F, typename C>
+    inline T parallel_reduce(const F &f, const C &combine, const T init, const size_t start, const size_t stop)
+    {
+        // Nothing to reduce
+        if (stop <= start)
+        {
+            return init;
+        }
+
+        // Split the range into at most one block per thread
+        const size_t length = stop - start;
+        const size_t blocks = std::min(static_cast<size_t>(_thread_count), length);
+        std::vector<T> partials(blocks);
+
+        // Reduce each block in item order
+        const auto reduce = [&f, &combine, &partials, start, length, blocks](std::mt19937 &gen, const size_t b) {
+            const size_t begin = start + (b * length) / blocks;
+            const size_t end = start + ((b + 1) * length) / blocks;
+            T partial = f(gen, begin);
+            for (size_t i = begin + 1; i < end; i++)
+            {
+                partial = combine(partial, f(gen, i));
+            }
+            partials[b] = partial;
+        };
+        run(std::cref(reduce), 0, blocks);
+
+        // Combine the partials in block order so the result doesn't depend on scheduling
+        T out = init;
+        for (size_t b = 0; b < blocks; b++)
+        {
+            out = combine(out, partials[b]);
+        }
+
+        return out;
+    }
     inline void seed(const size_t seed)
     {
         for (size_t i = 0; i < _thread_count - 1; i++)
@@ -279,34 +1184,83 @@ class thread_pool
         }
 
         _gen.seed(seed);
+        _philox_seed = seed;
+    }
+    inline void set_grain(const size_t grain)
+    {
+        // Zero grain selects a grain size automatically on each run
+        _grain = grain;
+    }
+    inline void set_steal(const bool flag)
+    {
+        // Switches run() between static slices and work stealing
+        _steal = flag;
     }
     inline void sleep()
     {
-        // ATOMIC: Set state of all workers to 'sleep'
-        for (size_t i = 0; i < _thread_count - 1; i++)
-        {
-            // Signal finished
-            _threads[i].set_sleep(true);
-        }
-
-        // Put all threads to sleep
+        // Idle workers park after spinning for a short while
         _turbo = false;
     }
     inline void wake()
     {
-        // Wait for all workers to sleep
-        wait_sleep();
-
-        // Turn off sleeping
+        // Idle workers spin without parking for the lowest dispatch latency
         _turbo = true;
 
-        // Wake up idle threads
-        _more_data.notify_all();
+        // Wake up parked threads so they start spinning
+        notify();
     }
-    inline void run(const std::function<void(std::mt19937 &gen, const size_t)> &f, const size_t start, const size_t stop)
+    template <typename F>
+    inline job_handle submit(F &&f)
     {
-        // Wait for all workers to sleep
-        wait();
+        // Any thread may submit, slots are claimed atomically
+        // Run the job on this thread if there are no workers
+        if (_thread_count == 1)
+        {
+            f(local_generator());
+            return job_handle();
+        }
+
+        // Search the ring for a free slot
+        const size_t cursor = _job_cursor;
+        for (size_t i = 0; i < _job_count; i++)
+        {
+            const size_t index = (cursor + i) % _job_count;
+            job &j = _jobs[index];
+            if (j.claim())
+            {
+                // Copy the callable into the slot
+                j.set(std::forward<F>(f));
+                const size_t generation = j.generation();
+                _job_cursor = (index + 1) % _job_count;
+
+                // ATOMIC: Count the job before publishing it
+                _job_pending++;
+                j.publish();
+
+                // Wake up parked threads
+                notify();
+
+                return job_handle(this, &j, generation);
+            }
+        }
+
+        // All slots are busy, run the job on this thread
+        f(local_generator());
+        return job_handle();
+    }
+    template <typename F>
+    inline void run(const F &f, const size_t start, const size_t stop)
+    {
+        // Callables take (gen, i) or (gen, scratch, i), scratch arenas are reset after each run
+
+        // Divert to the work stealing scheduler
+        if (_steal)
+        {
+            return run_steal(f, start, stop);
+        }
+
+        // Wait for all workers to finish the last run
+        wait_done();
 
         // Load queue with work
         const size_t length = (stop - start) / _thread_count;
@@ -314,33 +1268,136 @@ class thread_pool
         size_t begin = start;
         for (size_t i = 0; i < _thread_count - 1; i++)
         {
-            // Create work for thread
-            _threads[i].work().emplace_back(f, begin, length);
+            // Create work for thread, no memory allocation here
+            _threads[i].work() = work_item(f, begin, length);
 
             // Increment next work item
             begin += length;
         }
 
-        // ATOMIC: Set state of all workers to 'run'
-        for (size_t i = 0; i < _thread_count - 1; i++)
-        {
-            // Signal that there is work to do
-            _threads[i].set_sleep(true);
-            _threads[i].set_state(true);
-        }
-
-        // Notify threads
-        notify();
+        // Wake up the workers
+        dispatch();
 
         // Boot the residual work on this thread
         const size_t remain = stop - begin;
         work_item item(f, begin, remain);
-        item.work(_gen);
+#ifdef MGL_THREAD_STATS
+        const auto busy_start = thread_stats::clock::now();
+#endif
+        item.work(_gen, _scratch);
+#ifdef MGL_THREAD_STATS
+        const auto busy_stop = thread_stats::clock::now();
+        _stats.add_busy("run", busy_start, busy_stop);
+        _stats.add_items(remain);
+#endif
+
+        // Release scratch memory for the next run
+        _scratch.reset();
+
+        // Wait for all workers to finish work
+        wait_done();
+
+#ifdef MGL_THREAD_STATS
+        _stats.add_idle(busy_stop, thread_stats::clock::now());
+        update_imbalance();
+#endif
+    }
+    template <typename F>
+    inline void run_philox(const F &f, const size_t start, const size_t stop)
+    {
+        // Each item gets its own counter based stream keyed by (seed, item), so results don't depend on scheduling
+        const uint64_t seed = _philox_seed;
+        const auto stream = [&f, seed](std::mt19937 &, const size_t i) {
+            philox gen(seed, i);
+            f(gen, i);
+        };
+
+        run(stream, start, stop);
+    }
+    template <typename F>
+    inline void run_steal(const F &f, const size_t start, const size_t stop)
+    {
+        // Wait for all workers to finish the last run
+        wait_done();
+
+        // Nothing to do
+        if (stop <= start)
+        {
+            return;
+        }
+
+        // Use eight chunks per thread if no grain size was specified
+        const size_t length = stop - start;
+        size_t grain = (_grain > 0) ? _grain : std::max(static_cast<size_t>(1), length / (_thread_count * 8));
+
+        // Chunk indices must fit in the packed queue range
+        const size_t max_chunks = 0xFFFFFFFF;
+        grain = std::max(grain, (length + max_chunks - 1) / max_chunks);
+        const size_t chunks = (length + grain - 1) / grain;
+
+        // Deal out contiguous chunks to each queue
+        for (size_t i = 0; i < _thread_count; i++)
+        {
+            get_queue(i).reset((i * chunks) / _thread_count, ((i + 1) * chunks) / _thread_count);
+        }
+
+        // Publish the stolen work
+        _steal_item = work_item(f, start, length);
+        _stealing = true;
+        _steal_start = start;
+        _steal_stop = stop;
+        _steal_grain = grain;
+
+        // Wake up the workers
+        dispatch();
+
+        // Work on this thread until all queues are empty
+#ifdef MGL_THREAD_STATS
+        const auto busy_start = thread_stats::clock::now();
+#endif
+        steal_work(_thread_count - 1, _gen, _scratch);
+#ifdef MGL_THREAD_STATS
+        const auto busy_stop = thread_stats::clock::now();
+        _stats.add_busy("steal", busy_start, busy_stop);
+#endif
+
+        // Release scratch memory for the next run
+        _scratch.reset();
 
         // Wait for all workers to finish work
         wait_done();
+
+#ifdef MGL_THREAD_STATS
+        _stats.add_idle(busy_stop, thread_stats::clock::now());
+        update_imbalance();
+#endif
+
+        // Retire the stolen work
+        _stealing = false;
     }
 };
+
+inline void job_handle::wait()
+{
+    // Run the job on this thread if no worker has taken it yet
+    if (!done())
+    {
+        _pool->run_job(*_job, thread_pool::local_generator());
+    }
+
+    // Spin then yield until the job finishes
+    for (size_t i = 0; !done(); i++)
+    {
+        if (i < thread_pool::_spin_count)
+        {
+            cpu_pause();
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
 }
 
 #endif
@@ -18,8 +18,10 @@ limitations under the License.
 #include <min/taabboxinter.h>
 #include <min/taabbresolve.h>
 #include <min/taabbtree.h>
+#include <min/tarena.h>
 #include <min/tbit_flag.h>
 #include <min/tbmp.h>
+#include <min/tbvh.h>
 #include <min/tcamera.h>
 #include <min/tcubic.h>
 #include <min/tdds.h>
@@ -27,7 +29,9 @@ limitations under the License.
 #include <min/tevolution_neat.h>
 #include <min/tfrustinter.h>
 #include <min/tfrustum.h>
+#include <min/thash_grid.h>
 #include <min/theight_map.h>
+#include <min/tlinear_tree.h>
 #include <min/tmat.h>
 #include <min/tmat2.h>
 #include <min/tmat3.h>
@@ -38,11 +42,13 @@ limitations under the License.
 #include <min/tmem_chunk.h>
 #include <min/tmodel.h>
 #include <min/tmult.h>
+#include <min/tmulti_grid.h>
 #include <min/tneat.h>
 #include <min/tnnet.h>
 #include <min/toobbox.h>
 #include <min/toobboxinter.h>
 #include <min/toobbresolve.h>
+#include <min/tphilox.h>
 #include <min/tphysics.h>
 #include <min/tphysics_nt.h>
 #include <min/tplane.h>
@@ -61,7 +67,9 @@ limitations under the License.
 #include <min/tsphtree.h>
 #include <min/tstack_vector.h>
 #include <min/tstatic_vector.h>
+#include <min/tsweep_prune.h>
 #include <min/tsystem.h>
+#include <min/ttask_graph.h>
 #include <min/tthread_pool.h>
 #include <min/tvec.h>
 #include <min/tvec2.h>
@@ -104,6 +112,11 @@ int main()
         // Geom tests
         out = out && test_aabbox();
         out = out && test_aabb_grid();
+        out = out && test_hash_grid();
+        out = out && test_multi_grid();
+        out = out && test_linear_tree();
+        out = out && test_bvh();
+        out = out && test_sweep_prune();
         out = out && test_aabbox_intersect();
         out = out && test_aabb_resolve();
         out = out && test_aabb_tree();
@@ -142,6 +155,9 @@ int main()
 
         // Util tests
         out = out && test_thread_pool();
+        out = out && test_task_graph();
+        out = out && test_arena();
+        out = out && test_philox();
         out = out && test_height_map();
         out = out && test_stack_vector();
         out = out && test_static_vector();
@@ -16,8 +16,11 @@ limitations under the License.
 #define _MGL_TESTSORT_MGL_
 
 #include <cstdint>
+#include <min/parallel_sort.h>
 #include <min/sort.h>
 #include <min/test.h>
+#include <min/thread_pool.h>
+#include <random>
 #include <stdexcept>
 
 bool test_uint_sort()
@@ -152,6 +155,41 @@ bool test_uint_sort()
         }
     }
 
+    // Test parallel sort against the serial sort
+    {
+        min::thread_pool pool;
+
+        // Create random keys with duplicates
+        std::mt19937 gen(1337);
+        std::uniform_int_distribution<size_t> dist(0, 5000);
+        std::vector<size_t> keys(100000);
+        for (auto &k : keys)
+        {
+            k = dist(gen);
+        }
+
+        // Sort indices by key, equal keys must keep their relative order
+        std::vector<size_t> serial(keys.size());
+        std::vector<size_t> parallel(keys.size());
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            serial[i] = i;
+            parallel[i] = i;
+        }
+        const auto key = [&keys](const size_t a) {
+            return keys[a];
+        };
+        min::uint_sort<size_t>(serial, sort_copy, key);
+        min::uint_sort<size_t>(parallel, sort_copy, key, pool);
+
+        // Verify both sorts are identical
+        out = out && (serial == parallel);
+        if (!out)
+        {
+            throw std::runtime_error("Failed uint radix sort parallel");
+        }
+    }
+
     return out;
 }
 
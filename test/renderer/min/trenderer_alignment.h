@@ -54,7 +54,7 @@ bool test_renderer_align()
 
 #ifdef MGL_TEST_ALIGN
     std::cout << "trenderer_alignment.h: Testing emitter_buffer alignment" << std::endl;
-    out = out && test(sizeof(void *) * 25, sizeof(emitter_buffer), "Failed emitter_buffer sizeof");
+    out = out && test(sizeof(void *) * 28, sizeof(emitter_buffer), "Failed emitter_buffer sizeof");
     out = out && test(sizeof(void *), alignof(emitter_buffer), "Failed emitter_buffer alignof");
 #endif
 
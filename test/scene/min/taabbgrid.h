@@ -15,10 +15,13 @@ limitations under the License.
 #ifndef _MGL_TESTAABBGRID_MGL_
 #define _MGL_TESTAABBGRID_MGL_
 
+#include <algorithm>
 #include <min/aabbox.h>
 #include <min/grid.h>
 #include <min/test.h>
+#include <min/thread_pool.h>
 #include <min/vec3.h>
+#include <random>
 #include <stdexcept>
 
 bool test_aabb_grid()
@@ -536,6 +539,351 @@ bool test_aabb_grid()
             throw std::runtime_error("Failed aabb grid vec4 get overlap 3");
         }
     }
+
+    // Multithreaded grid
+    {
+        // Local variables
+        const min::vec3<double> minW(-100.0, -100.0, -100.0);
+        const min::vec3<double> maxW(100.0, 100.0, 100.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<double, min::vec3>> items;
+        min::grid<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> serial(world);
+        min::grid<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> parallel(world);
+
+        // Create random boxes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-95.0, 95.0);
+        std::uniform_real_distribution<double> size(0.5, 5.0);
+        for (size_t i = 0; i < 2000; i++)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::aabbox<double, min::vec3>(center - extent, center + extent));
+        }
+
+        // Build and collide with and without the thread pool
+        serial.insert(items);
+        const auto expected = serial.get_collisions();
+        out = out && compare(true, expected.size() > 0);
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb grid parallel collisions found");
+        }
+
+        // Output must be identical for any thread count
+        for (const size_t threads : {1, 2, 3, 4})
+        {
+            min::thread_pool_config config;
+            config.set_threads(threads);
+            min::thread_pool pool(config);
+
+            // Insert twice, should reset and rebuild
+            parallel.insert(pool, items);
+            parallel.insert(pool, items);
+            out = out && compare(true, expected == parallel.get_collisions(pool));
+            out = out && compare(true, expected == parallel.get_collisions());
+            out = out && compare(true, serial.get_index_map() == parallel.get_index_map());
+            if (!out)
+            {
+                throw std::runtime_error("Failed aabb grid parallel collisions");
+            }
+        }
+    }
+
+    // Incremental grid update
+    {
+        // Local variables
+        const min::vec3<double> minW(-100.0, -100.0, -100.0);
+        const min::vec3<double> maxW(100.0, 100.0, 100.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<double, min::vec3>> items;
+        std::vector<uint_fast16_t> moved;
+        min::grid<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> g(world);
+        min::grid<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> fresh(world);
+
+        // Collision pairs in insertion order ids
+        const auto pairs = [](const min::grid<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> &grid) {
+            const std::vector<uint_fast16_t> &map = grid.get_index_map();
+            std::vector<std::pair<uint_fast16_t, uint_fast16_t>> out;
+            for (const auto &c : grid.get_collisions())
+            {
+                const uint_fast16_t a = map[c.first];
+                const uint_fast16_t b = map[c.second];
+                out.emplace_back(std::min(a, b), std::max(a, b));
+            }
+            std::sort(out.begin(), out.end());
+            return out;
+        };
+
+        // Create random boxes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-95.0, 95.0);
+        std::uniform_real_distribution<double> size(0.5, 5.0);
+        for (size_t i = 0; i < 2000; i++)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::aabbox<double, min::vec3>(center - extent, center + extent));
+        }
+        g.insert(items);
+        const int scale = g.get_scale();
+
+        // Move a few boxes across cells
+        for (uint_fast16_t i = 0; i < 100; i += 5)
+        {
+            items[i].set_position(min::vec3<double>(pos(rng), pos(rng), pos(rng)));
+            moved.push_back(i);
+        }
+        g.update(items, moved);
+        fresh.insert(items);
+        out = out && compare(scale, g.get_scale());
+        out = out && compare(true, pairs(fresh) == pairs(g));
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb grid update move");
+        }
+
+        // Pile boxes into one spot to overflow the cell slack
+        moved.clear();
+        for (uint_fast16_t i = 0; i < 200; i++)
+        {
+            items[i].set_position(min::vec3<double>(10.0, 10.0, 10.0));
+            moved.push_back(i);
+        }
+        g.update(items, moved);
+        fresh.insert(items);
+        out = out && compare(true, pairs(fresh) == pairs(g));
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb grid update overflow");
+        }
+
+        // Grow a box past the cell size, should rebuild with a new scale
+        moved.clear();
+        items[1000] = min::aabbox<double, min::vec3>(min::vec3<double>(-90.0, -90.0, -90.0), min::vec3<double>(90.0, 90.0, 90.0));
+        moved.push_back(1000);
+        g.update(items, moved);
+        fresh.insert(items);
+        out = out && compare(fresh.get_scale(), g.get_scale());
+        out = out && compare(true, pairs(fresh) == pairs(g));
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb grid update rebuild");
+        }
+    }
+
+    // Grid visitors
+    {
+        // Local variables
+        const min::vec3<double> minW(-100.0, -100.0, -100.0);
+        const min::vec3<double> maxW(100.0, 100.0, 100.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<double, min::vec3>> items;
+        min::grid<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> g(world);
+
+        // Create random boxes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-95.0, 95.0);
+        std::uniform_real_distribution<double> size(0.5, 5.0);
+        for (size_t i = 0; i < 2000; i++)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::aabbox<double, min::vec3>(center - extent, center + extent));
+        }
+        g.insert(items);
+
+        // Visit the collisions, should match the collision list in order
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> visited;
+        g.for_each_collision([&visited](const uint_fast16_t a, const uint_fast16_t b) {
+            visited.emplace_back(a, b);
+        });
+        const auto collisions = g.get_collisions();
+        out = out && compare(true, collisions.size() > 0);
+        out = out && compare(true, collisions == visited);
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb grid for_each_collision");
+        }
+
+        // Visit the overlap, should match the overlap list in order
+        const min::aabbox<double, min::vec3> overlap(min::vec3<double>(-30.0, -20.0, -10.0), min::vec3<double>(10.0, 20.0, 30.0));
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> keys;
+        g.for_each_overlap(overlap, [&keys](const uint_fast16_t key) {
+            keys.emplace_back(key, 0);
+        });
+        const auto overlaps = g.get_overlap(overlap);
+        out = out && compare(true, overlaps.size() > 0);
+        out = out && compare(true, overlaps == keys);
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb grid for_each_overlap");
+        }
+    }
+
+    // Grid radius and nearest neighbor queries
+    {
+        // Local variables
+        const min::vec3<double> minW(-100.0, -100.0, -100.0);
+        const min::vec3<double> maxW(100.0, 100.0, 100.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<double, min::vec3>> items;
+        min::grid<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> g(world);
+
+        // Create random boxes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-95.0, 95.0);
+        std::uniform_real_distribution<double> size(0.5, 5.0);
+        for (size_t i = 0; i < 2000; i++)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::aabbox<double, min::vec3>(center - extent, center + extent));
+        }
+        g.insert(items);
+        const std::vector<min::aabbox<double, min::vec3>> &shapes = g.get_shapes();
+
+        // Create random query points
+        std::vector<min::vec3<double>> points;
+        for (size_t i = 0; i < 50; i++)
+        {
+            points.emplace_back(pos(rng), pos(rng), pos(rng));
+        }
+
+        // Compare against sorting all shapes by distance
+        const double radius = 15.0;
+        const size_t k = 8;
+        std::vector<uint_fast16_t> keys;
+        std::vector<std::pair<uint_fast16_t, double>> nearest;
+        for (const auto &p : points)
+        {
+            std::vector<std::pair<double, uint_fast16_t>> all;
+            for (size_t i = 0; i < shapes.size(); i++)
+            {
+                const min::vec3<double> d = shapes[i].get_center() - p;
+                all.emplace_back(d.dot(d), i);
+            }
+            std::sort(all.begin(), all.end());
+
+            // Test radius query
+            g.radius_query(p, radius, keys);
+            std::sort(keys.begin(), keys.end());
+            std::vector<uint_fast16_t> inside;
+            for (const auto &a : all)
+            {
+                if (a.first <= radius * radius)
+                {
+                    inside.push_back(a.second);
+                }
+            }
+            std::sort(inside.begin(), inside.end());
+            out = out && compare(true, inside == keys);
+
+            // Test k nearest neighbors
+            g.knn(p, k, nearest);
+            out = out && compare(k, nearest.size());
+            for (size_t i = 0; i < k; i++)
+            {
+                out = out && compare(all[i].second, nearest[i].first);
+                out = out && compare(all[i].first, nearest[i].second, 1E-9);
+            }
+            if (!out)
+            {
+                throw std::runtime_error("Failed aabb grid radius_query and knn");
+            }
+        }
+
+        // Ask for more neighbors than shapes
+        g.knn(points[0], 3000, nearest);
+        out = out && compare(2000, nearest.size());
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb grid knn all shapes");
+        }
+
+        // The batched queries must match single queries for any thread count
+        for (const size_t threads : {1, 2, 3, 4})
+        {
+            min::thread_pool_config config;
+            config.set_threads(threads);
+            min::thread_pool pool(config);
+            std::vector<uint_fast16_t> batch_keys;
+            std::vector<size_t> offsets;
+            std::vector<std::pair<uint_fast16_t, double>> batch_nearest;
+            g.radius_query(pool, points, radius, batch_keys, offsets);
+            g.knn(pool, points, k, batch_nearest);
+            out = out && compare(points.size() + 1, offsets.size());
+            out = out && compare(points.size() * k, batch_nearest.size());
+            for (size_t i = 0; i < points.size(); i++)
+            {
+                g.radius_query(points[i], radius, keys);
+                out = out && compare(true, std::equal(keys.begin(), keys.end(), batch_keys.begin() + offsets[i], batch_keys.begin() + offsets[i + 1]));
+                g.knn(points[i], k, nearest);
+                out = out && compare(true, std::equal(nearest.begin(), nearest.end(), batch_nearest.begin() + i * k));
+            }
+            if (!out)
+            {
+                throw std::runtime_error("Failed aabb grid batched radius_query and knn");
+            }
+        }
+    }
+
+    // Grid collisions against brute force, dense cells test the tile several shapes at a time
+    {
+        // Local variables
+        const min::vec3<float> minW(-20.0, -20.0, -20.0);
+        const min::vec3<float> maxW(20.0, 20.0, 20.0);
+        const min::aabbox<float, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<float, min::vec3>> items;
+        min::grid<float, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> g(world);
+
+        // Create random boxes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<float> pos(-18.0, 18.0);
+        std::uniform_real_distribution<float> size(0.25, 2.0);
+        for (size_t i = 0; i < 1000; i++)
+        {
+            const min::vec3<float> center(pos(rng), pos(rng), pos(rng));
+            const float extent = size(rng);
+            items.push_back(min::aabbox<float, min::vec3>(center - extent, center + extent));
+        }
+        g.insert(items);
+        const std::vector<min::aabbox<float, min::vec3>> &shapes = g.get_shapes();
+
+        // Test every pair
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> brute;
+        for (uint_fast16_t i = 0; i < shapes.size(); i++)
+        {
+            for (uint_fast16_t j = i + 1; j < shapes.size(); j++)
+            {
+                if (min::intersect(shapes[i], shapes[j]))
+                {
+                    brute.emplace_back(i, j);
+                }
+            }
+        }
+
+        // Grid collisions must find the same pairs
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> collisions = g.get_collisions();
+        std::sort(collisions.begin(), collisions.end());
+        out = out && compare(true, brute.size() > 0);
+        out = out && compare(true, brute == collisions);
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb grid float collisions brute force");
+        }
+
+        // Parallel grid collisions must find the same pairs
+        min::thread_pool pool;
+        collisions = g.get_collisions(pool);
+        std::sort(collisions.begin(), collisions.end());
+        out = out && compare(true, brute == collisions);
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb grid float parallel collisions brute force");
+        }
+    }
+
     return out;
 }
 
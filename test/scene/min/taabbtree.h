@@ -15,10 +15,14 @@ limitations under the License.
 #ifndef _MGL_TESTAABBTREE_MGL_
 #define _MGL_TESTAABBTREE_MGL_
 
+#include <algorithm>
 #include <min/aabbox.h>
 #include <min/test.h>
+#include <min/thread_pool.h>
 #include <min/tree.h>
 #include <min/vec3.h>
+#include <numeric>
+#include <random>
 #include <stdexcept>
 
 bool test_aabb_tree()
@@ -536,6 +540,331 @@ bool test_aabb_tree()
             throw std::runtime_error("Failed aabb tree vec4 get overlap 3");
         }
     }
+
+    // Tree visitors
+    {
+        // Local variables
+        const min::vec3<double> minW(-100.0, -100.0, -100.0);
+        const min::vec3<double> maxW(100.0, 100.0, 100.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<double, min::vec3>> items;
+        min::tree<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> g(world);
+
+        // Create random boxes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-95.0, 95.0);
+        std::uniform_real_distribution<double> size(0.5, 5.0);
+        for (size_t i = 0; i < 2000; i++)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::aabbox<double, min::vec3>(center - extent, center + extent));
+        }
+        g.insert(items);
+
+        // Visit the collisions, should match the collision list in order
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> visited;
+        g.for_each_collision([&visited](const uint_fast16_t a, const uint_fast16_t b) {
+            visited.emplace_back(a, b);
+        });
+        const auto collisions = g.get_collisions();
+        out = out && compare(true, collisions.size() > 0);
+        out = out && compare(true, collisions == visited);
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb tree for_each_collision");
+        }
+
+        // Visit the overlap, should match the overlap list in order
+        const min::aabbox<double, min::vec3> overlap(min::vec3<double>(-30.0, -20.0, -10.0), min::vec3<double>(10.0, 20.0, 30.0));
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> keys;
+        g.for_each_overlap(overlap, [&keys](const uint_fast16_t key) {
+            keys.emplace_back(key, 0);
+        });
+        const auto overlaps = g.get_overlap(overlap);
+        out = out && compare(true, overlaps.size() > 0);
+        out = out && compare(true, overlaps == keys);
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb tree for_each_overlap");
+        }
+    }
+
+    // Tree radius and nearest neighbor queries
+    {
+        // Local variables
+        const min::vec3<double> minW(-100.0, -100.0, -100.0);
+        const min::vec3<double> maxW(100.0, 100.0, 100.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<double, min::vec3>> items;
+        min::tree<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> g(world);
+
+        // Create random boxes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-95.0, 95.0);
+        std::uniform_real_distribution<double> size(0.5, 5.0);
+        for (size_t i = 0; i < 2000; i++)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::aabbox<double, min::vec3>(center - extent, center + extent));
+        }
+        g.insert(items);
+        const std::vector<min::aabbox<double, min::vec3>> &shapes = g.get_shapes();
+
+        // Create random query points
+        std::vector<min::vec3<double>> points;
+        for (size_t i = 0; i < 50; i++)
+        {
+            points.emplace_back(pos(rng), pos(rng), pos(rng));
+        }
+
+        // Compare against sorting all shapes by distance
+        const double radius = 15.0;
+        const size_t k = 8;
+        std::vector<uint_fast16_t> keys;
+        std::vector<std::pair<uint_fast16_t, double>> nearest;
+        for (const auto &p : points)
+        {
+            std::vector<std::pair<double, uint_fast16_t>> all;
+            for (size_t i = 0; i < shapes.size(); i++)
+            {
+                const min::vec3<double> d = shapes[i].get_center() - p;
+                all.emplace_back(d.dot(d), i);
+            }
+            std::sort(all.begin(), all.end());
+
+            // Test radius query
+            g.radius_query(p, radius, keys);
+            std::sort(keys.begin(), keys.end());
+            std::vector<uint_fast16_t> inside;
+            for (const auto &a : all)
+            {
+                if (a.first <= radius * radius)
+                {
+                    inside.push_back(a.second);
+                }
+            }
+            std::sort(inside.begin(), inside.end());
+            out = out && compare(true, inside == keys);
+
+            // Test k nearest neighbors
+            g.knn(p, k, nearest);
+            out = out && compare(k, nearest.size());
+            for (size_t i = 0; i < k; i++)
+            {
+                out = out && compare(all[i].second, nearest[i].first);
+                out = out && compare(all[i].first, nearest[i].second, 1E-9);
+            }
+            if (!out)
+            {
+                throw std::runtime_error("Failed aabb tree radius_query and knn");
+            }
+        }
+
+        // Ask for more neighbors than shapes
+        g.knn(points[0], 3000, nearest);
+        out = out && compare(2000, nearest.size());
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb tree knn all shapes");
+        }
+
+        // The batched queries must match single queries for any thread count
+        for (const size_t threads : {1, 2, 3, 4})
+        {
+            min::thread_pool_config config;
+            config.set_threads(threads);
+            min::thread_pool pool(config);
+            std::vector<uint_fast16_t> batch_keys;
+            std::vector<size_t> offsets;
+            std::vector<std::pair<uint_fast16_t, double>> batch_nearest;
+            g.radius_query(pool, points, radius, batch_keys, offsets);
+            g.knn(pool, points, k, batch_nearest);
+            out = out && compare(points.size() + 1, offsets.size());
+            out = out && compare(points.size() * k, batch_nearest.size());
+            for (size_t i = 0; i < points.size(); i++)
+            {
+                g.radius_query(points[i], radius, keys);
+                out = out && compare(true, std::equal(keys.begin(), keys.end(), batch_keys.begin() + offsets[i], batch_keys.begin() + offsets[i + 1]));
+                g.knn(points[i], k, nearest);
+                out = out && compare(true, std::equal(nearest.begin(), nearest.end(), batch_nearest.begin() + i * k));
+            }
+            if (!out)
+            {
+                throw std::runtime_error("Failed aabb tree batched radius_query and knn");
+            }
+        }
+    }
+
+    // Multithreaded tree
+    {
+        // Local variables
+        const min::vec3<double> minW(-100.0, -100.0, -100.0);
+        const min::vec3<double> maxW(100.0, 100.0, 100.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<double, min::vec3>> items;
+        min::tree<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> serial(world);
+        min::tree<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> parallel(world);
+
+        // Create random boxes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-95.0, 95.0);
+        std::uniform_real_distribution<double> size(0.5, 5.0);
+        for (size_t i = 0; i < 2000; i++)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::aabbox<double, min::vec3>(center - extent, center + extent));
+        }
+
+        // Build and collide with and without the thread pool
+        serial.insert(items);
+        const auto expected = serial.get_collisions();
+        out = out && compare(true, expected.size() > 0);
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb tree parallel collisions found");
+        }
+
+        // Output must be identical for any thread count and parallel depth
+        for (const size_t threads : {1, 2, 3, 4})
+        {
+            min::thread_pool_config config;
+            config.set_threads(threads);
+            min::thread_pool pool(config);
+            for (const uint_fast16_t depth : {0, 1, 2, 3, 8})
+            {
+                // Insert twice, should reset and rebuild
+                parallel.set_parallel_depth(depth);
+                parallel.insert(pool, items);
+                parallel.insert(pool, items);
+                out = out && compare(serial.get_depth(), parallel.get_depth());
+                out = out && compare(true, expected == parallel.get_collisions(pool));
+                out = out && compare(true, expected == parallel.get_collisions());
+                out = out && compare(true, serial.get_index_map() == parallel.get_index_map());
+                for (size_t i = 0; i < 20; i++)
+                {
+                    const min::vec3<double> p = items[i].get_center();
+                    out = out && compare(true, serial.point_inside(p) == parallel.point_inside(p));
+                }
+                if (!out)
+                {
+                    throw std::runtime_error("Failed aabb tree parallel collisions");
+                }
+            }
+        }
+    }
+
+    // Tree refit
+    {
+        // Local variables
+        const min::vec3<double> minW(-100.0, -100.0, -100.0);
+        const min::vec3<double> maxW(100.0, 100.0, 100.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<double, min::vec3>> items;
+        min::tree<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> g(world);
+        min::tree<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> unsorted(world);
+        typedef std::vector<std::pair<uint_fast16_t, uint_fast16_t>> pairs;
+
+        // Brute force collision pairs in insertion order
+        const auto brute = [&items]() {
+            pairs out;
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                for (size_t j = i + 1; j < items.size(); j++)
+                {
+                    if (min::intersect(items[i], items[j]))
+                    {
+                        out.emplace_back(i, j);
+                    }
+                }
+            }
+            return out;
+        };
+
+        // Sort pairs into insertion order ids
+        const auto sorted = [](const std::vector<uint_fast16_t> &map, const pairs &p) {
+            pairs out;
+            for (const auto &c : p)
+            {
+                out.emplace_back(std::min(map[c.first], map[c.second]), std::max(map[c.first], map[c.second]));
+            }
+            std::sort(out.begin(), out.end());
+            return out;
+        };
+
+        // Create random boxes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-90.0, 90.0);
+        std::uniform_real_distribution<double> size(0.5, 3.0);
+        std::uniform_real_distribution<double> step(-0.2, 0.2);
+        for (size_t i = 0; i < 2000; i++)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::aabbox<double, min::vec3>(center - extent, center + extent));
+        }
+        g.insert(items);
+        unsorted.insert_no_sort(items);
+        const uint_fast16_t depth = g.get_depth();
+        std::vector<uint_fast16_t> identity(items.size());
+        std::iota(identity.begin(), identity.end(), 0);
+
+        // Jitter the boxes, the tree keeps its cells and finds the new pairs
+        for (size_t t = 0; t < 5; t++)
+        {
+            for (auto &item : items)
+            {
+                const min::vec3<double> offset(step(rng), step(rng), step(rng));
+                item = min::aabbox<double, min::vec3>(item.get_min() + offset, item.get_max() + offset);
+            }
+            out = out && compare(true, g.refit(items));
+            out = out && compare(true, unsorted.refit(items));
+            out = out && compare(depth, g.get_depth());
+
+            // Test collisions and point inside against brute force
+            const pairs expect = brute();
+            out = out && compare(true, expect.size() > 0);
+            out = out && compare(true, expect == sorted(g.get_index_map(), g.get_collisions()));
+            out = out && compare(true, expect == sorted(identity, unsorted.get_collisions()));
+            const min::vec3<double> p = items[t].get_center();
+            const std::vector<uint_fast16_t> &inside = g.point_inside(p);
+            out = out && compare(true, std::find_if(inside.begin(), inside.end(), [&g, t](const uint_fast16_t k) { return g.get_index_map()[k] == t; }) != inside.end());
+            if (!out)
+            {
+                throw std::runtime_error("Failed aabb tree refit jitter");
+            }
+        }
+
+        // Growing boxes no longer fit the leaf cells and rebuild the tree
+        for (auto &item : items)
+        {
+            const min::vec3<double> c = item.get_center();
+            item = min::aabbox<double, min::vec3>(c - 8.0, c + 8.0);
+        }
+        out = out && compare(false, g.refit(items));
+        out = out && compare(true, depth > g.get_depth());
+        out = out && compare(true, brute() == sorted(g.get_index_map(), g.get_collisions()));
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb tree refit growth");
+        }
+
+        // Scattering the boxes loses the sort order and rebuilds the tree
+        for (auto &item : items)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            item = min::aabbox<double, min::vec3>(center - 8.0, center + 8.0);
+        }
+        out = out && compare(false, g.refit(items));
+        out = out && compare(true, brute() == sorted(g.get_index_map(), g.get_collisions()));
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabb tree refit scatter");
+        }
+    }
+
     return out;
 }
 
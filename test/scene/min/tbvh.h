@@ -0,0 +1,435 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_TESTBVH_MGL_
+#define _MGL_TESTBVH_MGL_
+
+#include <algorithm>
+#include <min/aabbox.h>
+#include <min/bvh.h>
+#include <min/grid.h>
+#include <min/ray.h>
+#include <min/test.h>
+#include <min/tspatial_physics.h>
+#include <min/vec2.h>
+#include <min/vec3.h>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+bool test_bvh()
+{
+    bool out = true;
+
+    // vec3 mixed size aabb bvh
+    {
+        // Local variables
+        const min::vec3<double> minW(-1000.0, -1000.0, -1000.0);
+        const min::vec3<double> maxW(1000.0, 1000.0, 1000.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<double, min::vec3>> items;
+        min::bvh<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> t(world);
+
+        // Sort pairs into insertion order ids
+        const auto sorted = [](const std::vector<uint_fast16_t> &map, const std::vector<std::pair<uint_fast16_t, uint_fast16_t>> &pairs) {
+            std::vector<std::pair<uint_fast16_t, uint_fast16_t>> out;
+            for (const auto &c : pairs)
+            {
+                const uint_fast16_t a = map[c.first];
+                const uint_fast16_t b = map[c.second];
+                out.emplace_back(std::min(a, b), std::max(a, b));
+            }
+            std::sort(out.begin(), out.end());
+            return out;
+        };
+
+        // Create many small boxes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-950.0, 950.0);
+        std::uniform_real_distribution<double> size(1.0, 20.0);
+        for (size_t i = 0; i < 3000; i++)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::aabbox<double, min::vec3>(center - extent, center + extent));
+        }
+
+        // Add a few large boxes and boxes on the world center planes
+        items.push_back(min::aabbox<double, min::vec3>(min::vec3<double>(-900.0, -900.0, -900.0), min::vec3<double>(-100.0, -100.0, -100.0)));
+        items.push_back(min::aabbox<double, min::vec3>(min::vec3<double>(-200.0, -50.0, -50.0), min::vec3<double>(200.0, 50.0, 50.0)));
+        items.push_back(min::aabbox<double, min::vec3>(min::vec3<double>(0.0, 0.0, 0.0), min::vec3<double>(999.0, 999.0, 999.0)));
+        items.push_back(min::aabbox<double, min::vec3>(min::vec3<double>(-5.0, 300.0, 300.0), min::vec3<double>(0.0, 310.0, 310.0)));
+        t.insert(items);
+
+        // Brute force collision pairs
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> brute;
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            for (size_t j = i + 1; j < items.size(); j++)
+            {
+                if (min::intersect(items[i], items[j]))
+                {
+                    brute.emplace_back(i, j);
+                }
+            }
+        }
+
+        // Test collisions against brute force, each pair is reported once
+        const std::vector<std::pair<uint_fast16_t, uint_fast16_t>> pairs = sorted(t.get_index_map(), t.get_collisions());
+        out = out && compare(true, brute.size() > 0);
+        out = out && compare(true, brute == pairs);
+        if (!out)
+        {
+            throw std::runtime_error("Failed bvh vec3 collisions");
+        }
+
+        // Test collisions match when the shapes are not sorted
+        min::bvh<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> unsorted(world);
+        unsorted.insert_no_sort(items);
+        std::vector<uint_fast16_t> identity(items.size());
+        std::iota(identity.begin(), identity.end(), 0);
+        out = out && compare(true, sorted(identity, unsorted.get_collisions()) == pairs);
+        if (!out)
+        {
+            throw std::runtime_error("Failed bvh vec3 collisions no sort");
+        }
+
+        // Test overlap reports every shape with overlapping bounds once
+        const min::aabbox<double, min::vec3> region(min::vec3<double>(-300.0, -300.0, -300.0), min::vec3<double>(-150.0, 300.0, 10.0));
+        std::vector<uint_fast16_t> expect;
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            if (min::intersect(items[i], region))
+            {
+                expect.push_back(i);
+            }
+        }
+        std::vector<uint_fast16_t> overlap;
+        for (const auto &o : t.get_overlap(region))
+        {
+            overlap.push_back(t.get_index_map()[o.first]);
+        }
+        std::sort(overlap.begin(), overlap.end());
+        out = out && compare(true, expect.size() > 0);
+        out = out && compare(true, expect == overlap);
+        if (!out)
+        {
+            throw std::runtime_error("Failed bvh vec3 overlap");
+        }
+
+        // Test point inside finds every box holding the point
+        const min::vec3<double> point(-150.0, -25.0, -25.0);
+        std::vector<uint_fast16_t> inside;
+        for (const auto k : t.point_inside(point))
+        {
+            inside.push_back(t.get_index_map()[k]);
+        }
+        std::sort(inside.begin(), inside.end());
+        expect.clear();
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            if (items[i].get_min() <= point && items[i].get_max() >= point)
+            {
+                expect.push_back(i);
+            }
+        }
+        out = out && compare(true, std::find(inside.begin(), inside.end(), 3001) != inside.end());
+        out = out && compare(true, expect == inside);
+        if (!out)
+        {
+            throw std::runtime_error("Failed bvh vec3 point_inside");
+        }
+
+        // Test every shape is in one leaf and leaves are small
+        std::vector<bool> seen(items.size(), false);
+        const auto &nodes = t.get_nodes();
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            if (nodes[i].get_skip() == i + 1)
+            {
+                out = out && compare(true, nodes[i].get_end() - nodes[i].get_begin() <= t.get_scale());
+                for (size_t j = nodes[i].get_begin(); j < nodes[i].get_end(); j++)
+                {
+                    out = out && compare(false, static_cast<bool>(seen[j]));
+                    seen[j] = true;
+                }
+            }
+        }
+        out = out && compare(true, std::find(seen.begin(), seen.end(), false) == seen.end());
+        if (!out)
+        {
+            throw std::runtime_error("Failed bvh vec3 leaves");
+        }
+
+        // Test radius query against brute force
+        std::vector<uint_fast16_t> keys;
+        const min::vec3<double> center(100.0, -200.0, 300.0);
+        t.radius_query(center, 150.0, keys);
+        for (auto &k : keys)
+        {
+            k = t.get_index_map()[k];
+        }
+        std::sort(keys.begin(), keys.end());
+        expect.clear();
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            const min::vec3<double> d = items[i].get_center() - center;
+            if (d.dot(d) <= 150.0 * 150.0)
+            {
+                expect.push_back(i);
+            }
+        }
+        out = out && compare(true, expect.size() > 0);
+        out = out && compare(true, expect == keys);
+        if (!out)
+        {
+            throw std::runtime_error("Failed bvh vec3 radius_query");
+        }
+
+        // Test closest hit against brute force
+        for (size_t i = 0; i < 50; i++)
+        {
+            const min::vec3<double> from(pos(rng), pos(rng), -999.0);
+            const min::vec3<double> to(pos(rng), pos(rng), 999.0);
+            const min::ray<double, min::vec3> r(from, to);
+
+            // Find the nearest shape
+            bool expect_hit = false;
+            double best = 1E10;
+            min::vec3<double> p;
+            for (size_t j = 0; j < items.size(); j++)
+            {
+                if (min::intersect(items[j], r, p))
+                {
+                    const double d = (p - r.get_origin()).dot(r.get_direction());
+                    best = std::min(best, d);
+                    expect_hit = true;
+                }
+            }
+
+            // The bvh must find a shape at the same distance
+            uint_fast16_t key;
+            min::vec3<double> point;
+            const bool hit = t.get_closest_hit(r, 1E10, key, point);
+            out = out && compare(expect_hit, hit);
+            if (hit)
+            {
+                out = out && compare(best, (point - r.get_origin()).dot(r.get_direction()), 1E-6);
+            }
+
+            // Every shape the ray intersects is reported
+            size_t count = 0;
+            for (size_t j = 0; j < items.size(); j++)
+            {
+                count += min::intersect(items[j], r, p);
+            }
+            out = out && compare(count, t.get_collisions(r).size());
+            if (!out)
+            {
+                throw std::runtime_error("Failed bvh vec3 ray");
+            }
+        }
+    }
+
+    // vec2 clustered bvh matches the grid
+    {
+        // Local variables
+        const min::vec2<float> minW(-1000.0, -1000.0);
+        const min::vec2<float> maxW(1000.0, 1000.0);
+        const min::aabbox<float, min::vec2> world(minW, maxW);
+        std::vector<min::aabbox<float, min::vec2>> items;
+        min::bvh<float, uint_fast16_t, uint_fast32_t, min::vec2, min::aabbox, min::aabbox> t(world);
+        min::grid<float, uint_fast16_t, uint_fast32_t, min::vec2, min::aabbox, min::aabbox> expect(world);
+
+        // Create tight clusters of boxes far apart with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<float> pos(-950.0, 950.0);
+        std::uniform_real_distribution<float> offset(-10.0, 10.0);
+        std::uniform_real_distribution<float> size(0.1, 1.0);
+        for (size_t c = 0; c < 8; c++)
+        {
+            const min::vec2<float> origin(pos(rng), pos(rng));
+            for (size_t i = 0; i < 250; i++)
+            {
+                const min::vec2<float> center = origin + min::vec2<float>(offset(rng), offset(rng));
+                const float extent = size(rng);
+                items.push_back(min::aabbox<float, min::vec2>(center - extent, center + extent));
+            }
+        }
+
+        // Add boxes on the same center to force splits without a surface area split
+        for (size_t i = 0; i < 20; i++)
+        {
+            items.push_back(min::aabbox<float, min::vec2>(min::vec2<float>(1.0, 1.0), min::vec2<float>(2.0, 2.0)));
+        }
+        t.insert(items);
+        expect.insert(items);
+
+        // Both structures find the same pairs
+        const auto sorted = [](const std::vector<uint_fast16_t> &map, const std::vector<std::pair<uint_fast16_t, uint_fast16_t>> &pairs) {
+            std::vector<std::pair<uint_fast16_t, uint_fast16_t>> out;
+            for (const auto &c : pairs)
+            {
+                out.emplace_back(std::min(map[c.first], map[c.second]), std::max(map[c.first], map[c.second]));
+            }
+            std::sort(out.begin(), out.end());
+            return out;
+        };
+        const std::vector<std::pair<uint_fast16_t, uint_fast16_t>> pairs = sorted(t.get_index_map(), t.get_collisions());
+        out = out && compare(true, pairs.size() >= 190);
+        out = out && compare(true, sorted(expect.get_index_map(), expect.get_collisions()) == pairs);
+        if (!out)
+        {
+            throw std::runtime_error("Failed bvh vec2 collisions");
+        }
+    }
+
+    // vec3 bvh refit
+    {
+        // Local variables
+        const min::vec3<double> minW(-100.0, -100.0, -100.0);
+        const min::vec3<double> maxW(100.0, 100.0, 100.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<double, min::vec3>> items;
+        min::bvh<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> t(world);
+        min::bvh<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> unsorted(world);
+        typedef std::vector<std::pair<uint_fast16_t, uint_fast16_t>> pairs;
+
+        // Brute force collision pairs in insertion order
+        const auto brute = [&items]() {
+            pairs out;
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                for (size_t j = i + 1; j < items.size(); j++)
+                {
+                    if (min::intersect(items[i], items[j]))
+                    {
+                        out.emplace_back(i, j);
+                    }
+                }
+            }
+            return out;
+        };
+
+        // Sort pairs into insertion order ids
+        const auto sorted = [](const std::vector<uint_fast16_t> &map, const pairs &p) {
+            pairs out;
+            for (const auto &c : p)
+            {
+                out.emplace_back(std::min(map[c.first], map[c.second]), std::max(map[c.first], map[c.second]));
+            }
+            std::sort(out.begin(), out.end());
+            return out;
+        };
+
+        // Create random boxes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-90.0, 90.0);
+        std::uniform_real_distribution<double> size(0.5, 3.0);
+        std::uniform_real_distribution<double> step(-0.2, 0.2);
+        for (size_t i = 0; i < 2000; i++)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::aabbox<double, min::vec3>(center - extent, center + extent));
+        }
+        t.insert(items);
+        unsorted.insert_no_sort(items);
+        const size_t nodes = t.get_nodes().size();
+        std::vector<uint_fast16_t> identity(items.size());
+        std::iota(identity.begin(), identity.end(), 0);
+
+        // Jitter the boxes, the hierarchy keeps its nodes and finds the new pairs
+        for (size_t s = 0; s < 5; s++)
+        {
+            for (auto &item : items)
+            {
+                const min::vec3<double> offset(step(rng), step(rng), step(rng));
+                item = min::aabbox<double, min::vec3>(item.get_min() + offset, item.get_max() + offset);
+            }
+            out = out && compare(true, t.refit(items));
+            out = out && compare(true, unsorted.refit(items));
+            out = out && compare(nodes, t.get_nodes().size());
+
+            // Every node holds the bounds of its shapes
+            const auto &shapes = t.get_shapes();
+            for (const auto &node : t.get_nodes())
+            {
+                for (uint_fast16_t i = node.get_begin(); i < node.get_end(); i++)
+                {
+                    out = out && compare(true, node.get_min() <= shapes[i].get_min() && node.get_max() >= shapes[i].get_max());
+                }
+            }
+
+            // Test collisions and overlap against brute force
+            const pairs expect = brute();
+            out = out && compare(true, expect.size() > 0);
+            out = out && compare(true, expect == sorted(t.get_index_map(), t.get_collisions()));
+            out = out && compare(true, expect == sorted(identity, unsorted.get_collisions()));
+            const min::aabbox<double, min::vec3> region(min::vec3<double>(-40.0, -20.0, -50.0), min::vec3<double>(10.0, 40.0, 0.0));
+            std::vector<uint_fast16_t> expect_keys;
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                if (min::intersect(items[i], region))
+                {
+                    expect_keys.push_back(i);
+                }
+            }
+            std::vector<uint_fast16_t> keys;
+            for (const auto &o : t.get_overlap(region))
+            {
+                keys.push_back(t.get_index_map()[o.first]);
+            }
+            std::sort(keys.begin(), keys.end());
+            out = out && compare(true, expect_keys.size() > 0);
+            out = out && compare(true, expect_keys == keys);
+            if (!out)
+            {
+                throw std::runtime_error("Failed bvh vec3 refit jitter");
+            }
+        }
+
+        // Scattering the boxes grows the refit nodes past the limit and rebuilds the hierarchy
+        for (auto &item : items)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            item = min::aabbox<double, min::vec3>(center - extent, center + extent);
+        }
+        out = out && compare(false, t.refit(items));
+        out = out && compare(false, unsorted.refit(items));
+        const pairs expect = brute();
+        out = out && compare(true, expect == sorted(t.get_index_map(), t.get_collisions()));
+        out = out && compare(true, expect == sorted(identity, unsorted.get_collisions()));
+        out = out && compare(true, t.refit(items));
+        if (!out)
+        {
+            throw std::runtime_error("Failed bvh vec3 refit scatter");
+        }
+    }
+
+    // vec2 physics simulation
+    {
+        // Drop boxes on a floor and match the grid
+        out = out && test_drop_physics<min::bvh>();
+        if (!out)
+        {
+            throw std::runtime_error("Failed bvh physics collision");
+        }
+    }
+
+    return out;
+}
+
+#endif
@@ -0,0 +1,266 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_TESTHASHGRID_MGL_
+#define _MGL_TESTHASHGRID_MGL_
+
+#include <algorithm>
+#include <min/aabbox.h>
+#include <min/grid.h>
+#include <min/hash_grid.h>
+#include <min/physics.h>
+#include <min/sphere.h>
+#include <min/test.h>
+#include <min/thread_pool.h>
+#include <min/vec2.h>
+#include <min/vec3.h>
+#include <random>
+#include <stdexcept>
+
+bool test_hash_grid()
+{
+    bool out = true;
+
+    // vec3 sparse aabb grid
+    {
+        // Local variables
+        const min::vec3<double> minW(-100000.0, -100000.0, -100000.0);
+        const min::vec3<double> maxW(100000.0, 100000.0, 100000.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<double, min::vec3>> items;
+        min::hash_grid<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> g(world);
+        min::grid<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> dense(world);
+
+        // Sort pairs into insertion order ids
+        const auto sorted = [](const std::vector<uint_fast16_t> &map, const std::vector<std::pair<uint_fast16_t, uint_fast16_t>> &pairs) {
+            std::vector<std::pair<uint_fast16_t, uint_fast16_t>> out;
+            for (const auto &c : pairs)
+            {
+                const uint_fast16_t a = map[c.first];
+                const uint_fast16_t b = map[c.second];
+                out.emplace_back(std::min(a, b), std::max(a, b));
+            }
+            std::sort(out.begin(), out.end());
+            return out;
+        };
+
+        // Create clusters of small boxes far apart in a huge world
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> cluster(-90000.0, 90000.0);
+        std::uniform_real_distribution<double> pos(-50.0, 50.0);
+        std::uniform_real_distribution<double> size(0.5, 2.0);
+        for (size_t c = 0; c < 8; c++)
+        {
+            const min::vec3<double> origin(cluster(rng), cluster(rng), cluster(rng));
+            for (size_t i = 0; i < 250; i++)
+            {
+                const min::vec3<double> center = origin + min::vec3<double>(pos(rng), pos(rng), pos(rng));
+                const double extent = size(rng);
+                items.push_back(min::aabbox<double, min::vec3>(center - extent, center + extent));
+            }
+        }
+
+        // Add a box straddling the world center
+        items.push_back(min::aabbox<double, min::vec3>(min::vec3<double>(-1.0, -1.0, -1.0), min::vec3<double>(1.0, 1.0, 1.0)));
+        g.insert(items);
+        dense.insert(items);
+
+        // Cells are the size of the largest box, only occupied cells are allocated
+        out = out && compare(true, g.get_scale() > dense.get_scale());
+        out = out && compare(true, g.get_cell_count() <= 8 * items.size());
+        if (!out)
+        {
+            throw std::runtime_error("Failed hash grid vec3 sparse scale");
+        }
+
+        // Brute force collision pairs
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> brute;
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            for (size_t j = i + 1; j < items.size(); j++)
+            {
+                if (min::intersect(items[i], items[j]))
+                {
+                    brute.emplace_back(i, j);
+                }
+            }
+        }
+
+        // Test collisions against brute force and the dense grid
+        const auto pairs = sorted(g.get_index_map(), g.get_collisions());
+        out = out && compare(true, brute.size() > 0);
+        out = out && compare(true, brute == pairs);
+        out = out && compare(true, sorted(dense.get_index_map(), dense.get_collisions()) == pairs);
+        if (!out)
+        {
+            throw std::runtime_error("Failed hash grid vec3 collisions");
+        }
+
+        // Test parallel collisions match the serial collisions
+        for (const size_t threads : {1, 2, 3, 4})
+        {
+            min::thread_pool_config config;
+            config.set_threads(threads);
+            min::thread_pool pool(config);
+            out = out && compare(true, sorted(g.get_index_map(), g.get_collisions(pool)) == pairs);
+            if (!out)
+            {
+                throw std::runtime_error("Failed hash grid vec3 parallel collisions");
+            }
+        }
+
+        // Test overlap with a small region and a region larger than the occupied cells
+        const std::vector<min::aabbox<double, min::vec3>> regions = {
+            min::aabbox<double, min::vec3>(items[10].get_center() - 20.0, items[10].get_center() + 20.0),
+            min::aabbox<double, min::vec3>(minW * 0.5, maxW * 0.5),
+            world};
+        for (const auto &region : regions)
+        {
+            std::vector<uint_fast16_t> expect;
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                if (min::intersect(items[i], region))
+                {
+                    expect.push_back(i);
+                }
+            }
+            std::vector<uint_fast16_t> overlap;
+            for (const auto &o : g.get_overlap(region))
+            {
+                overlap.push_back(g.get_index_map()[o.first]);
+            }
+            std::sort(overlap.begin(), overlap.end());
+
+            // Overlap reports each shape in the overlapping cells once
+            out = out && compare(true, expect.size() > 0);
+            out = out && compare(true, std::adjacent_find(overlap.begin(), overlap.end()) == overlap.end());
+            out = out && compare(true, std::includes(overlap.begin(), overlap.end(), expect.begin(), expect.end()));
+            if (!out)
+            {
+                throw std::runtime_error("Failed hash grid vec3 overlap");
+            }
+        }
+
+        // Test point inside an occupied and an empty cell
+        const std::vector<uint_fast16_t> &inside = g.point_inside(min::vec3<double>(0.0, 0.0, 0.0));
+        out = out && compare(1, inside.size());
+        out = out && compare(items.size() - 1, g.get_index_map()[inside[0]]);
+        out = out && compare(0, g.point_inside(min::vec3<double>(99000.0, 99000.0, 99000.0)).size());
+        if (!out)
+        {
+            throw std::runtime_error("Failed hash grid vec3 point_inside");
+        }
+
+        // Test ray marching across empty space hits the box at the world center
+        const min::ray<double, min::vec3> r(min::vec3<double>(-99000.0, 0.5, 0.5), min::vec3<double>(99000.0, 0.5, 0.5));
+        const auto &ray_hits = g.get_collisions(r);
+        out = out && compare(1, ray_hits.size());
+        out = out && compare(-1.0, ray_hits[0].second.x(), 1E-4);
+        if (!out)
+        {
+            throw std::runtime_error("Failed hash grid vec3 ray");
+        }
+    }
+
+    // vec2 sphere grid
+    {
+        // Local variables
+        const min::vec2<double> minW(-10000.0, -10000.0);
+        const min::vec2<double> maxW(10000.0, 10000.0);
+        const min::sphere<double, min::vec2> world(minW, maxW);
+        std::vector<min::sphere<double, min::vec2>> items;
+        min::hash_grid<double, uint_fast16_t, uint_fast32_t, min::vec2, min::sphere, min::sphere> g(world);
+        min::grid<double, uint_fast16_t, uint_fast32_t, min::vec2, min::sphere, min::sphere> dense(world);
+
+        // Create random spheres with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-200.0, 200.0);
+        std::uniform_real_distribution<double> size(0.5, 3.0);
+        for (size_t i = 0; i < 1000; i++)
+        {
+            const min::vec2<double> center(pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::sphere<double, min::vec2>(center - extent, center + extent));
+        }
+        // Use the same cells as the dense grid, spheres are binned by their inner box
+        g.insert(items, 8);
+        dense.insert(items, 8);
+        out = out && compare(dense.get_scale(), g.get_scale());
+        out = out && compare(true, dense.get_index_map() == g.get_index_map());
+        if (!out)
+        {
+            throw std::runtime_error("Failed hash grid vec2 sphere scale");
+        }
+
+        // Test each pair is reported exactly once and matches the dense grid
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> pairs = g.get_collisions();
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> expect = dense.get_collisions();
+        std::sort(pairs.begin(), pairs.end());
+        std::sort(expect.begin(), expect.end());
+        out = out && compare(true, expect.size() > 0);
+        out = out && compare(true, expect == pairs);
+        if (!out)
+        {
+            throw std::runtime_error("Failed hash grid vec2 sphere collisions");
+        }
+    }
+
+    // vec2 physics simulation
+    {
+        // Local variables
+        const min::vec2<double> minW(-10.0, -10.0);
+        const min::vec2<double> maxW(10.0, 10.0);
+        const min::aabbox<double, min::vec2> world(minW, maxW);
+        const min::vec2<double> gravity(0.0, -10.0);
+        min::physics<double, uint_fast16_t, uint_fast32_t, min::vec2, min::aabbox, min::aabbox, min::hash_grid> simulation(world, gravity);
+
+        // Add rigid bodies to the simulation
+        const min::aabbox<double, min::vec2> box1(min::vec2<double>(1.0, 1.0), min::vec2<double>(2.0, 2.0));
+        const min::aabbox<double, min::vec2> box2(min::vec2<double>(1.0, 3.0), min::vec2<double>(2.0, 4.0));
+        const size_t body1_id = simulation.add_body(box1, 100.0);
+        const size_t body2_id = simulation.add_body(box2, 100.0);
+
+        // Body1 should counter gravity and body2 should fall on body1
+        const min::vec2<double> up_force(0.0, 1000.0);
+        min::body<double, min::vec2> &body1 = simulation.get_body(body1_id);
+        min::body<double, min::vec2> &body2 = simulation.get_body(body2_id);
+
+        // Solve the simulation for intersection at t = 0.3162s; 0.41s
+        body1.add_force(up_force);
+        simulation.solve(0.1, 0.01);
+        body1.add_force(up_force);
+        simulation.solve(0.1, 0.01);
+        body1.add_force(up_force);
+        simulation.solve(0.1, 0.01);
+        body1.add_force(up_force);
+        simulation.solve(0.11, 0.01);
+
+        // The two boxes are touching after this time, so we don't need a force to prop up body1
+        simulation.solve(0.001, 0.01);
+        const min::vec2<double> &v1 = body1.get_linear_velocity();
+        const min::vec2<double> &v2 = body2.get_linear_velocity();
+        out = out && compare(0.0, v1.x(), 1E-4);
+        out = out && compare(-4.1100, v1.y(), 1E-4);
+        out = out && compare(0.0, v2.x(), 1E-4);
+        out = out && compare(-0.0100, v2.y(), 1E-4);
+        if (!out)
+        {
+            throw std::runtime_error("Failed hash grid physics collision");
+        }
+    }
+
+    return out;
+}
+
+#endif
@@ -0,0 +1,182 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_TESTMULTIGRID_MGL_
+#define _MGL_TESTMULTIGRID_MGL_
+
+#include <algorithm>
+#include <min/aabbox.h>
+#include <min/multi_grid.h>
+#include <min/test.h>
+#include <min/thread_pool.h>
+#include <min/tspatial_physics.h>
+#include <min/vec3.h>
+#include <random>
+#include <stdexcept>
+
+bool test_multi_grid()
+{
+    bool out = true;
+
+    // vec3 mixed size aabb grid
+    {
+        // Local variables
+        const min::vec3<double> minW(-1000.0, -1000.0, -1000.0);
+        const min::vec3<double> maxW(1000.0, 1000.0, 1000.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<double, min::vec3>> items;
+        min::multi_grid<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> g(world);
+
+        // Sort pairs into insertion order ids
+        const auto sorted = [](const std::vector<uint_fast16_t> &map, const std::vector<std::pair<uint_fast16_t, uint_fast16_t>> &pairs) {
+            std::vector<std::pair<uint_fast16_t, uint_fast16_t>> out;
+            for (const auto &c : pairs)
+            {
+                const uint_fast16_t a = map[c.first];
+                const uint_fast16_t b = map[c.second];
+                out.emplace_back(std::min(a, b), std::max(a, b));
+            }
+            std::sort(out.begin(), out.end());
+            return out;
+        };
+
+        // Create many small boxes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-950.0, 950.0);
+        std::uniform_real_distribution<double> size(1.0, 20.0);
+        for (size_t i = 0; i < 3000; i++)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::aabbox<double, min::vec3>(center - extent, center + extent));
+        }
+
+        // Add a few large boxes
+        items.push_back(min::aabbox<double, min::vec3>(min::vec3<double>(-900.0, -900.0, -900.0), min::vec3<double>(-100.0, -100.0, -100.0)));
+        items.push_back(min::aabbox<double, min::vec3>(min::vec3<double>(-200.0, -50.0, -50.0), min::vec3<double>(200.0, 50.0, 50.0)));
+        items.push_back(min::aabbox<double, min::vec3>(min::vec3<double>(0.0, 0.0, 0.0), min::vec3<double>(999.0, 999.0, 999.0)));
+        g.insert(items);
+
+        // Small and large boxes must be on different levels
+        out = out && compare(true, g.get_levels() > 1);
+        out = out && compare(16, g.get_scale());
+        if (!out)
+        {
+            throw std::runtime_error("Failed multi grid vec3 levels");
+        }
+
+        // Brute force collision pairs
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> brute;
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            for (size_t j = i + 1; j < items.size(); j++)
+            {
+                if (min::intersect(items[i], items[j]))
+                {
+                    brute.emplace_back(i, j);
+                }
+            }
+        }
+
+        // Test collisions against brute force, each pair is reported once
+        const std::vector<std::pair<uint_fast16_t, uint_fast16_t>> pairs = sorted(g.get_index_map(), g.get_collisions());
+        out = out && compare(true, brute.size() > 0);
+        out = out && compare(true, brute == pairs);
+        if (!out)
+        {
+            throw std::runtime_error("Failed multi grid vec3 collisions");
+        }
+
+        // Test parallel collisions match the serial collisions
+        for (const size_t threads : {1, 2, 3, 4})
+        {
+            min::thread_pool_config config;
+            config.set_threads(threads);
+            min::thread_pool pool(config);
+            out = out && compare(true, sorted(g.get_index_map(), g.get_collisions(pool)) == pairs);
+            if (!out)
+            {
+                throw std::runtime_error("Failed multi grid vec3 parallel collisions");
+            }
+        }
+
+        // Test overlap reports each shape in the overlapping cells once
+        const min::aabbox<double, min::vec3> region(min::vec3<double>(-300.0, -300.0, -300.0), min::vec3<double>(-150.0, 300.0, 10.0));
+        std::vector<uint_fast16_t> expect;
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            if (min::intersect(items[i], region))
+            {
+                expect.push_back(i);
+            }
+        }
+        std::vector<uint_fast16_t> overlap;
+        for (const auto &o : g.get_overlap(region))
+        {
+            overlap.push_back(g.get_index_map()[o.first]);
+        }
+        std::sort(overlap.begin(), overlap.end());
+        out = out && compare(true, expect.size() > 0);
+        out = out && compare(true, std::adjacent_find(overlap.begin(), overlap.end()) == overlap.end());
+        out = out && compare(true, std::includes(overlap.begin(), overlap.end(), expect.begin(), expect.end()));
+        if (!out)
+        {
+            throw std::runtime_error("Failed multi grid vec3 overlap");
+        }
+
+        // Test point inside finds the large boxes on their own levels
+        std::vector<uint_fast16_t> inside;
+        for (const auto k : g.point_inside(min::vec3<double>(-150.0, -75.0, -75.0)))
+        {
+            inside.push_back(g.get_index_map()[k]);
+        }
+        out = out && compare(true, std::find(inside.begin(), inside.end(), 3000) != inside.end());
+        out = out && compare(true, std::find(inside.begin(), inside.end(), 3002) == inside.end());
+        if (!out)
+        {
+            throw std::runtime_error("Failed multi grid vec3 point_inside");
+        }
+
+        // Test a ray along an empty axis hits the large box
+        const min::ray<double, min::vec3> r(min::vec3<double>(990.0, 990.0, -990.0), min::vec3<double>(990.0, 990.0, 990.0));
+        const auto &ray_hits = g.get_collisions(r);
+        bool hit = false;
+        for (const auto &h : ray_hits)
+        {
+            if (g.get_index_map()[h.first] == 3002)
+            {
+                hit = compare(0.0, h.second.z(), 1E-4);
+            }
+        }
+        out = out && compare(true, hit);
+        if (!out)
+        {
+            throw std::runtime_error("Failed multi grid vec3 ray");
+        }
+    }
+
+    // vec2 physics simulation
+    {
+        // Drop boxes on a floor and match the grid
+        out = out && test_drop_physics<min::multi_grid>();
+        if (!out)
+        {
+            throw std::runtime_error("Failed multi grid physics collision");
+        }
+    }
+
+    return out;
+}
+
+#endif
@@ -18,6 +18,8 @@ limitations under the License.
 #include <min/grid.h>
 #include <min/physics.h>
 #include <min/test.h>
+#include <min/thread_pool.h>
+#include <min/tspatial_physics.h>
 #include <min/vec2.h>
 #include <stdexcept>
 
@@ -328,6 +330,122 @@ bool test_physics_aabb_grid()
         {
             throw std::runtime_error("Failed physics vec4 velocity collision2");
         }
+
+        // Test parallel total energy matches the serial total energy
+        min::thread_pool pool;
+        const double energy = simulation.get_total_energy();
+        out = out && compare(energy, simulation.get_total_energy(pool), 1E-6);
+        if (!out)
+        {
+            throw std::runtime_error("Failed physics vec4 parallel total energy");
+        }
+    }
+
+    // Parallel solve matches the serial solve
+    {
+        // Local variables
+        const min::vec3<double> minW(-10.0, -10.0, -10.0);
+        const min::vec3<double> maxW(10.0, 10.0, 10.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        const min::vec3<double> gravity(0.0, -10.0, 0.0);
+        min::physics<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox, min::grid> serial(world, gravity);
+        min::physics<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox, min::grid> parallel(world, gravity);
+
+        // Stack columns of touching boxes in both simulations
+        for (size_t i = 0; i < 64; i++)
+        {
+            const double x = -8.0 + 2.0 * (i % 8);
+            const double y = -8.0 + 1.0 * (i / 8);
+            const min::aabbox<double, min::vec3> box(min::vec3<double>(x, y, 0.0), min::vec3<double>(x + 1.0, y + 1.0, 1.0));
+            serial.add_body(box, 10.0);
+            parallel.add_body(box, 10.0);
+        }
+
+        // Solve both simulations for a few steps
+        min::thread_pool_config config;
+        config.set_threads(4);
+        min::thread_pool pool(config);
+        for (size_t i = 0; i < 10; i++)
+        {
+            serial.solve(0.01, 0.01);
+            parallel.solve(pool, 0.01, 0.01);
+        }
+
+        // Bodies must end up in exactly the same place
+        for (size_t i = 0; i < 64; i++)
+        {
+            const min::vec3<double> &p1 = serial.get_body(i).get_position();
+            const min::vec3<double> &p2 = parallel.get_body(i).get_position();
+            out = out && compare(p1.x(), p2.x());
+            out = out && compare(p1.y(), p2.y());
+            out = out && compare(p1.z(), p2.z());
+        }
+        if (!out)
+        {
+            throw std::runtime_error("Failed physics parallel solve");
+        }
+    }
+
+    // Incremental spatial updates when few bodies move
+    {
+        // Local variables
+        const min::vec3<double> minW(-10.0, -10.0, -10.0);
+        const min::vec3<double> maxW(10.0, 10.0, 10.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        const min::vec3<double> gravity(0.0, 0.0, 0.0);
+        min::physics<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox, min::grid> update(world, gravity);
+        min::physics<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox, min::grid> rebuild(world, gravity);
+
+        // Resting boxes spread over the world
+        for (size_t i = 0; i < 64; i++)
+        {
+            const double x = -8.0 + 2.0 * (i % 8);
+            const double z = -8.0 + 2.0 * (i / 8);
+            const min::aabbox<double, min::vec3> box(min::vec3<double>(x, 0.0, z), min::vec3<double>(x + 1.0, 1.0, z + 1.0));
+            update.add_body(box, 10.0);
+            rebuild.add_body(box, 10.0);
+        }
+
+        // Throw the first box at its neighbor
+        const min::vec3<double> velocity(10.0, 0.0, 0.0);
+        update.get_body(0).set_linear_velocity(velocity);
+        rebuild.get_body(0).set_linear_velocity(velocity);
+
+        // Solve with incremental updates and with full rebuilds
+        for (size_t i = 0; i < 20; i++)
+        {
+            update.solve(0.01, 0.0);
+            rebuild.solve_no_sort(0.01, 0.0);
+        }
+
+        // The thrown box must have hit its neighbor in both simulations
+        out = out && compare(true, update.get_body(1).get_linear_velocity().x() > 1.0);
+        for (size_t i = 0; i < 64; i++)
+        {
+            const min::vec3<double> &p1 = update.get_body(i).get_position();
+            const min::vec3<double> &p2 = rebuild.get_body(i).get_position();
+            out = out && compare(p1.x(), p2.x(), 1E-9);
+            out = out && compare(p1.y(), p2.y(), 1E-9);
+            out = out && compare(p1.z(), p2.z(), 1E-9);
+        }
+        if (!out)
+        {
+            throw std::runtime_error("Failed physics incremental update");
+        }
+    }
+
+    // Rotating bodies update the shapes in the grid
+    {
+        // The spinning bar must push the box away with incremental updates and with full rebuilds
+        const min::vec2<double> p = spin_physics<min::grid>(false);
+        const min::vec2<double> expect = spin_physics<min::grid>(true);
+        out = out && compare(true, expect.y() > 1.0);
+        out = out && compare(expect.x(), p.x(), 1E-9);
+        out = out && compare(expect.y(), p.y(), 1E-9);
+        if (!out)
+        {
+            throw std::runtime_error("Failed physics rotating body update");
+        }
     }
 
     return out;
@@ -24,10 +24,8 @@ namespace test_nt
 #undef _MGL_VECTOR3_MGL_
 #undef _MGL_VECTOR4_MGL_
 #undef _MGL_GRID_MGL_
-#undef _MGL_BIT_FLAG_MGL_
 #undef _MGL_RAY_MGL_
 #undef _MGL_AABBOX_MGL_
-#undef _MGL_STATIC_VECTOR_MGL_
 #undef _MGL_STACK_VECTOR_MGL_
 #undef _MGL_UTILITY_MGL_
 #undef _MGL_UINT_SORT_MGL_
@@ -15,12 +15,15 @@ limitations under the License.
 #ifndef _MGL_TESTRAYTREE_MGL_
 #define _MGL_TESTRAYTREE_MGL_
 
+#include <algorithm>
 #include <min/aabbox.h>
 #include <min/ray.h>
 #include <min/sphere.h>
 #include <min/test.h>
+#include <min/thread_pool.h>
 #include <min/tree.h>
 #include <min/vec3.h>
+#include <random>
 #include <stdexcept>
 
 bool test_ray_tree()
@@ -762,6 +765,147 @@ bool test_ray_tree()
         }
     }
 
+    // vec3 aabb tree closest hit
+    {
+        // Local variables
+        const min::vec3<double> minW(-100.0, -100.0, -100.0);
+        const min::vec3<double> maxW(100.0, 100.0, 100.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<double, min::vec3>> items;
+        min::tree<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> g(world);
+
+        // Create overlapping boxes of mixed sizes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-90.0, 90.0);
+        std::uniform_real_distribution<double> size(0.5, 8.0);
+        for (size_t i = 0; i < 500; i++)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::aabbox<double, min::vec3>(center - extent, center + extent));
+        }
+        g.insert(items);
+
+        // Shoot rays from inside and outside the world
+        std::uniform_real_distribution<double> from(-150.0, 150.0);
+        size_t hits = 0;
+        for (size_t i = 0; i < 500; i++)
+        {
+            const min::vec3<double> a(from(rng), from(rng), from(rng));
+            const min::vec3<double> b(pos(rng), pos(rng), pos(rng));
+            const min::ray<double, min::vec3> r(a, b);
+
+            // Find the nearest hit by brute force
+            double best = 1E6;
+            min::vec3<double> p;
+            for (const auto &item : items)
+            {
+                if (min::intersect(item, r, p))
+                {
+                    best = std::min(best, (p - a).dot(r.get_direction()));
+                }
+            }
+
+            // Test the nearest hit matches
+            uint_fast16_t key;
+            min::vec3<double> point;
+            const bool hit = g.get_closest_hit(r, 1E6, key, point);
+            out = out && compare(best < 1E6, hit);
+            if (hit)
+            {
+                hits++;
+                const double t = (point - a).dot(r.get_direction());
+                out = out && compare(best, t, 1E-9);
+                out = out && compare(true, min::intersect(items[g.get_index_map()[key]], r, p));
+
+                // Test a ray shorter than the nearest hit
+                out = out && compare(false, g.get_closest_hit(r, best * 0.5, key, point));
+            }
+            if (!out)
+            {
+                throw std::runtime_error("Failed aabbox tree vec3 closest hit");
+            }
+        }
+
+        // Most rays should hit something
+        out = out && compare(true, hits > 400);
+        if (!out)
+        {
+            throw std::runtime_error("Failed aabbox tree vec3 closest hit count");
+        }
+    }
+
+    // vec3 aabb tree batched closest hits
+    {
+        // Local variables
+        const min::vec3<double> minW(-100.0, -100.0, -100.0);
+        const min::vec3<double> maxW(100.0, 100.0, 100.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<double, min::vec3>> items;
+        min::tree<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> g(world);
+
+        // Create overlapping boxes of mixed sizes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-90.0, 90.0);
+        std::uniform_real_distribution<double> size(0.5, 8.0);
+        for (size_t i = 0; i < 500; i++)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::aabbox<double, min::vec3>(center - extent, center + extent));
+        }
+        g.insert(items);
+
+        // Shoot fans of coherent rays from a few eyes and random rays from inside and outside the world
+        std::uniform_real_distribution<double> from(-150.0, 150.0);
+        std::uniform_real_distribution<double> spread(-5.0, 5.0);
+        std::vector<min::ray<double, min::vec3>> rays;
+        for (size_t i = 0; i < 10; i++)
+        {
+            const min::vec3<double> eye(from(rng), from(rng), from(rng));
+            const min::vec3<double> target(pos(rng), pos(rng), pos(rng));
+            for (size_t j = 0; j < 50; j++)
+            {
+                rays.emplace_back(eye, target + min::vec3<double>(spread(rng), spread(rng), spread(rng)));
+            }
+        }
+        for (size_t i = 0; i < 500; i++)
+        {
+            rays.emplace_back(min::vec3<double>(from(rng), from(rng), from(rng)), min::vec3<double>(pos(rng), pos(rng), pos(rng)));
+        }
+
+        // Test the batch matches the closest hit of each ray for any thread count
+        const uint_fast16_t miss = std::numeric_limits<uint_fast16_t>::max();
+        for (const size_t threads : {1, 2, 3, 4})
+        {
+            min::thread_pool_config config;
+            config.set_threads(threads);
+            min::thread_pool pool(config);
+            const auto &batch = g.get_closest_hits(pool, rays, 1E6);
+            out = out && compare(rays.size(), batch.size());
+            size_t hits = 0;
+            for (size_t i = 0; i < rays.size(); i++)
+            {
+                uint_fast16_t key;
+                min::vec3<double> point;
+                const bool hit = g.get_closest_hit(rays[i], 1E6, key, point);
+                out = out && compare(hit, batch[i].first != miss);
+                if (hit)
+                {
+                    hits++;
+                    const min::vec3<double> &a = rays[i].get_origin();
+                    const min::vec3<double> &dir = rays[i].get_direction();
+                    out = out && compare((point - a).dot(dir), (batch[i].second - a).dot(dir), 1E-9);
+                }
+            }
+            out = out && compare(true, hits > 600);
+            if (!out)
+            {
+                throw std::runtime_error("Failed aabbox tree vec3 batched closest hits");
+            }
+        }
+    }
+
     return out;
 }
 
@@ -0,0 +1,114 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_TESTSPATIALPHYSICS_MGL_
+#define _MGL_TESTSPATIALPHYSICS_MGL_
+
+#include <min/aabbox.h>
+#include <min/grid.h>
+#include <min/oobbox.h>
+#include <min/physics.h>
+#include <min/test.h>
+#include <min/vec2.h>
+#include <vector>
+
+// Shared physics scenes for testing every spatial structure in the physics broadphase
+
+template <template <typename, typename, typename, template <typename> class, template <typename, template <typename> class> class, template <typename, template <typename> class> class> class spatial>
+std::vector<min::vec2<double>> drop_physics()
+{
+    // Local variables
+    const min::vec2<double> minW(-10.0, -10.0);
+    const min::vec2<double> maxW(10.0, 10.0);
+    const min::aabbox<double, min::vec2> world(minW, maxW);
+    const min::vec2<double> gravity(0.0, -10.0);
+    min::physics<double, uint_fast16_t, uint_fast32_t, min::vec2, min::aabbox, min::aabbox, spatial> simulation(world, gravity);
+
+    // Add a large body that counters gravity
+    const min::aabbox<double, min::vec2> floor(min::vec2<double>(-9.0, -9.0), min::vec2<double>(9.0, -7.0));
+    const size_t floor_id = simulation.add_body(floor, 100.0);
+
+    // Drop small boxes on the floor box
+    for (size_t i = 0; i < 8; i++)
+    {
+        const double x = -8.0 + 2.0 * i;
+        simulation.add_body(min::aabbox<double, min::vec2>(min::vec2<double>(x, -6.0 + 0.5 * i), min::vec2<double>(x + 1.0, -5.0 + 0.5 * i)), 10.0);
+    }
+
+    // Solve the simulation until the boxes land
+    const min::vec2<double> up_force(0.0, 1000.0);
+    for (size_t i = 0; i < 100; i++)
+    {
+        simulation.get_body(floor_id).add_force(up_force);
+        simulation.solve(0.01, 0.01);
+    }
+
+    // Return body positions
+    std::vector<min::vec2<double>> out;
+    for (size_t i = 0; i < 9; i++)
+    {
+        out.push_back(simulation.get_body(i).get_position());
+    }
+    return out;
+}
+
+template <template <typename, typename, typename, template <typename> class, template <typename, template <typename> class> class, template <typename, template <typename> class> class> class spatial>
+bool test_drop_physics()
+{
+    // Test the boxes land and the simulation matches the grid
+    const std::vector<min::vec2<double>> expect = drop_physics<min::grid>();
+    const std::vector<min::vec2<double>> p = drop_physics<spatial>();
+    bool out = compare(true, expect[1].y() > -7.0);
+    for (size_t i = 0; i < 9; i++)
+    {
+        out = out && compare(expect[i].x(), p[i].x(), 1E-6);
+        out = out && compare(expect[i].y(), p[i].y(), 1E-6);
+    }
+
+    return out;
+}
+
+template <template <typename, typename, typename, template <typename> class, template <typename, template <typename> class> class, template <typename, template <typename> class> class> class spatial>
+min::vec2<double> spin_physics(const bool rebuild)
+{
+    // Local variables
+    const min::vec2<double> minW(-10.0, -10.0);
+    const min::vec2<double> maxW(10.0, 10.0);
+    const min::aabbox<double, min::vec2> world(minW, maxW);
+    const min::vec2<double> gravity(0.0, 0.0);
+    min::physics<double, uint_fast16_t, uint_fast32_t, min::vec2, min::aabbox, min::oobbox, spatial> simulation(world, gravity);
+
+    // A long bar spinning in place next to a small box, the bar bounds do not change as it spins
+    const size_t bar_id = simulation.add_body(min::oobbox<double, min::vec2>(min::vec2<double>(-1.5, -0.1), min::vec2<double>(1.5, 0.1)), 10.0);
+    const size_t box_id = simulation.add_body(min::oobbox<double, min::vec2>(min::vec2<double>(0.8, 0.8), min::vec2<double>(1.0, 1.0)), 1.0);
+
+    // Spin the bar at 450 degrees per second until it sweeps through the box
+    for (size_t i = 0; i < 30; i++)
+    {
+        simulation.get_body(bar_id).set_angular_velocity(450.0);
+        if (rebuild)
+        {
+            simulation.solve_no_sort(0.01, 0.0);
+        }
+        else
+        {
+            simulation.solve(0.01, 0.0);
+        }
+    }
+
+    // Return the box position
+    return simulation.get_body(box_id).get_position();
+}
+
+#endif
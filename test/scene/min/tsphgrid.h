@@ -15,10 +15,15 @@ limitations under the License.
 #ifndef _MGL_TESTSPHEREGRID_MGL_
 #define _MGL_TESTSPHEREGRID_MGL_
 
+#include <algorithm>
+#include <min/aabbox.h>
 #include <min/grid.h>
+#include <min/intersect.h>
 #include <min/sphere.h>
 #include <min/test.h>
+#include <min/thread_pool.h>
 #include <min/vec3.h>
+#include <random>
 #include <stdexcept>
 
 bool test_sphere_grid()
@@ -563,6 +568,71 @@ bool test_sphere_grid()
             throw std::runtime_error("Failed sphere grid vec4 get overlap 3");
         }
     }
+
+    // Grid collisions against brute force, dense cells test the tile several shapes at a time
+    {
+        // Local variables
+        const min::vec3<double> minW(-20.0, -20.0, -20.0);
+        const min::vec3<double> maxW(20.0, 20.0, 20.0);
+        const min::aabbox<double, min::vec3> world(minW, maxW);
+        std::vector<min::sphere<double, min::vec3>> items;
+        min::grid<double, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::sphere> g(world);
+
+        // Create random spheres with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<double> pos(-18.0, 18.0);
+        std::uniform_real_distribution<double> size(0.25, 2.0);
+        for (size_t i = 0; i < 1000; i++)
+        {
+            const min::vec3<double> center(pos(rng), pos(rng), pos(rng));
+            const double extent = size(rng);
+            items.push_back(min::sphere<double, min::vec3>(center, extent));
+        }
+        g.insert(items);
+        const std::vector<min::sphere<double, min::vec3>> &shapes = g.get_shapes();
+
+        // Test every pair, the grid bins spheres by get_min and get_max so only pairs sharing those bounds must be found
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> brute;
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> binned;
+        for (uint_fast16_t i = 0; i < shapes.size(); i++)
+        {
+            const min::aabbox<double, min::vec3> a(shapes[i].get_min(), shapes[i].get_max());
+            for (uint_fast16_t j = i + 1; j < shapes.size(); j++)
+            {
+                if (min::intersect(shapes[i], shapes[j]))
+                {
+                    brute.emplace_back(i, j);
+                    const min::aabbox<double, min::vec3> b(shapes[j].get_min(), shapes[j].get_max());
+                    if (min::intersect(a, b))
+                    {
+                        binned.emplace_back(i, j);
+                    }
+                }
+            }
+        }
+
+        // Grid collisions must find the binned pairs and only intersecting pairs
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> collisions = g.get_collisions();
+        std::sort(collisions.begin(), collisions.end());
+        out = out && compare(true, binned.size() > 0);
+        out = out && compare(true, std::includes(collisions.begin(), collisions.end(), binned.begin(), binned.end()));
+        out = out && compare(true, std::includes(brute.begin(), brute.end(), collisions.begin(), collisions.end()));
+        if (!out)
+        {
+            throw std::runtime_error("Failed sphere grid collisions brute force");
+        }
+
+        // Parallel grid collisions must find the same pairs
+        std::vector<std::pair<uint_fast16_t, uint_fast16_t>> serial = collisions;
+        min::thread_pool pool;
+        collisions = g.get_collisions(pool);
+        std::sort(collisions.begin(), collisions.end());
+        out = out && compare(true, serial == collisions);
+        if (!out)
+        {
+            throw std::runtime_error("Failed sphere grid parallel collisions brute force");
+        }
+    }
     return out;
 }
 
@@ -0,0 +1,203 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_TESTSWEEPPRUNE_MGL_
+#define _MGL_TESTSWEEPPRUNE_MGL_
+
+#include <algorithm>
+#include <iterator>
+#include <min/aabbox.h>
+#include <min/grid.h>
+#include <min/sweep_prune.h>
+#include <min/test.h>
+#include <min/tspatial_physics.h>
+#include <min/vec2.h>
+#include <min/vec3.h>
+#include <random>
+#include <stdexcept>
+
+bool test_sweep_prune()
+{
+    bool out = true;
+
+    // vec3 moving aabb sweep
+    {
+        // Local variables
+        const min::vec3<float> minW(-100.0, -100.0, -100.0);
+        const min::vec3<float> maxW(100.0, 100.0, 100.0);
+        const min::aabbox<float, min::vec3> world(minW, maxW);
+        std::vector<min::aabbox<float, min::vec3>> items;
+        min::sweep_prune<float, uint_fast16_t, uint_fast32_t, min::vec3, min::aabbox, min::aabbox> s(world);
+        typedef std::vector<std::pair<uint_fast16_t, uint_fast16_t>> pairs;
+
+        // Brute force collision pairs
+        const auto brute = [&items]() {
+            pairs out;
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                for (size_t j = i + 1; j < items.size(); j++)
+                {
+                    if (min::intersect(items[i], items[j]))
+                    {
+                        out.emplace_back(i, j);
+                    }
+                }
+            }
+            return out;
+        };
+        const auto sorted = [](pairs p) {
+            std::sort(p.begin(), p.end());
+            return p;
+        };
+
+        // Create random boxes with a fixed seed
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<float> pos(-90.0, 90.0);
+        std::uniform_real_distribution<float> size(0.5, 4.0);
+        std::uniform_real_distribution<float> step(-1.0, 1.0);
+        for (size_t i = 0; i < 1500; i++)
+        {
+            const min::vec3<float> center(pos(rng), pos(rng), pos(rng));
+            const float extent = size(rng);
+            items.push_back(min::aabbox<float, min::vec3>(center - extent, center + extent));
+        }
+        s.insert(items);
+
+        // Test the first insert finds every pair and adds them
+        pairs expect = brute();
+        out = out && compare(true, expect.size() > 0);
+        out = out && compare(true, expect == sorted(s.get_collisions()));
+        out = out && compare(true, expect == sorted(s.get_added_pairs()));
+        out = out && compare(true, s.get_removed_pairs().empty());
+        if (!out)
+        {
+            throw std::runtime_error("Failed sweep prune vec3 insert");
+        }
+
+        // Move some boxes every step, the pair changes must match brute force
+        size_t changes = 0;
+        for (size_t t = 0; t < 20; t++)
+        {
+            // Move every other box on even steps and all but the first box on odd steps
+            std::vector<uint_fast16_t> moved;
+            for (size_t i = t % 2; i < items.size(); i += 2 - (t % 2))
+            {
+                const min::vec3<float> offset(step(rng), step(rng), step(rng));
+                items[i] = min::aabbox<float, min::vec3>(items[i].get_min() + offset, items[i].get_max() + offset);
+                moved.push_back(i);
+            }
+
+            // Update with the moved boxes, or insert again
+            if (t % 3 == 0)
+            {
+                s.insert(items);
+            }
+            else
+            {
+                s.update(items, moved);
+            }
+
+            // Get the pairs added and removed
+            const pairs next = brute();
+            pairs added;
+            pairs removed;
+            std::set_difference(next.begin(), next.end(), expect.begin(), expect.end(), std::back_inserter(added));
+            std::set_difference(expect.begin(), expect.end(), next.begin(), next.end(), std::back_inserter(removed));
+            changes += added.size() + removed.size();
+            expect = next;
+
+            // Test the pairs and changes
+            out = out && compare(true, expect == sorted(s.get_collisions()));
+            out = out && compare(true, expect == sorted(s.get_pairs()));
+            out = out && compare(true, added == sorted(s.get_added_pairs()));
+            out = out && compare(true, removed == sorted(s.get_removed_pairs()));
+            if (!out)
+            {
+                throw std::runtime_error("Failed sweep prune vec3 update");
+            }
+        }
+        out = out && compare(true, changes > 0);
+        if (!out)
+        {
+            throw std::runtime_error("Failed sweep prune vec3 changes");
+        }
+
+        // Test overlap against brute force
+        const min::aabbox<float, min::vec3> region(min::vec3<float>(-30.0, -20.0, -50.0), min::vec3<float>(10.0, 40.0, 0.0));
+        std::vector<uint_fast16_t> expect_keys;
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            if (min::intersect(items[i], region))
+            {
+                expect_keys.push_back(i);
+            }
+        }
+        std::vector<uint_fast16_t> keys;
+        for (const auto &o : s.get_overlap(region))
+        {
+            keys.push_back(o.first);
+        }
+        std::sort(keys.begin(), keys.end());
+        out = out && compare(true, expect_keys.size() > 0);
+        out = out && compare(true, expect_keys == keys);
+        if (!out)
+        {
+            throw std::runtime_error("Failed sweep prune vec3 overlap");
+        }
+
+        // Test a different number of shapes rebuilds and removes every old pair
+        const pairs old = expect;
+        items.pop_back();
+        s.insert(items);
+        expect = brute();
+        out = out && compare(true, expect == sorted(s.get_collisions()));
+        out = out && compare(true, expect == sorted(s.get_added_pairs()));
+        out = out && compare(true, old == sorted(s.get_removed_pairs()));
+        if (!out)
+        {
+            throw std::runtime_error("Failed sweep prune vec3 rebuild");
+        }
+    }
+
+    // vec2 physics simulation
+    {
+        // Drop boxes on a floor and match the grid
+        out = out && test_drop_physics<min::sweep_prune>();
+        if (!out)
+        {
+            throw std::runtime_error("Failed sweep prune physics collision");
+        }
+    }
+
+    // vec2 rotating oobbox physics simulation
+    {
+        // The spinning bar must push the box away with incremental updates and match the grid
+        const min::vec2<double> expect = spin_physics<min::grid>(true);
+        out = out && compare(true, expect.y() > 1.0);
+        for (const bool rebuild : {false, true})
+        {
+            const min::vec2<double> p = spin_physics<min::sweep_prune>(rebuild);
+            out = out && compare(expect.x(), p.x(), 1E-9);
+            out = out && compare(expect.y(), p.y(), 1E-9);
+        }
+        if (!out)
+        {
+            throw std::runtime_error("Failed sweep prune rotating physics collision");
+        }
+    }
+
+    return out;
+}
+
+#endif
@@ -0,0 +1,81 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_TEST_ARENA_MGL_
+#define _MGL_TEST_ARENA_MGL_
+
+#include <cstdint>
+#include <min/arena.h>
+#include <min/test.h>
+#include <stdexcept>
+
+bool test_arena()
+{
+    bool out = true;
+
+    // Print size and alignment of class
+    std::cout << "arena_size: " << sizeof(min::arena) << std::endl;
+    std::cout << "arena_align: " << alignof(min::arena) << std::endl;
+
+    // Test alignment of allocations
+    min::arena a;
+    char *c = a.allocate<char>(3);
+    double *d = a.allocate<double>(4);
+    out = out && test(true, c != nullptr, "Failed arena char allocate");
+    out = out && test(0, reinterpret_cast<uintptr_t>(d) % alignof(double), "Failed arena double alignment");
+    out = out && test(true, reinterpret_cast<char *>(d) >= c + 3, "Failed arena overlap");
+    const size_t capacity = a.capacity();
+    out = out && test(true, capacity >= a.size(), "Failed arena capacity");
+
+    // Test growth past the first block
+    for (size_t i = 0; i < 100; i++)
+    {
+        const uint64_t *p = a.allocate<uint64_t>(1000);
+        out = out && test(0, reinterpret_cast<uintptr_t>(p) % alignof(uint64_t), "Failed arena grow alignment");
+    }
+    out = out && test(true, a.capacity() >= 800000, "Failed arena grow capacity");
+
+    // Test reset keeps the capacity and rewinds the pointer
+    const size_t grown = a.capacity();
+    a.reset();
+    out = out && test(0, a.size(), "Failed arena reset size");
+    out = out && test(grown, a.capacity(), "Failed arena reset capacity");
+
+    // Test a full pass fits after reset without growing
+    for (size_t i = 0; i < 100; i++)
+    {
+        a.allocate<uint64_t>(1000);
+    }
+    out = out && test(grown, a.capacity(), "Failed arena reuse capacity");
+
+    // Test arena backed vector
+    a.reset();
+    min::arena_vector<int32_t> v{min::arena_allocator<int32_t>(a)};
+    int32_t sum = 0;
+    for (int32_t i = 0; i < 1000; i++)
+    {
+        v.push_back(i);
+        sum += i;
+    }
+    int32_t check = 0;
+    for (const auto i : v)
+    {
+        check += i;
+    }
+    out = out && test(sum, check, "Failed arena vector");
+
+    return out;
+}
+
+#endif
@@ -0,0 +1,134 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_TEST_PHILOX_MGL_
+#define _MGL_TEST_PHILOX_MGL_
+
+#include <cstdint>
+#include <min/philox.h>
+#include <min/test.h>
+#include <min/thread_pool.h>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+bool test_philox()
+{
+    bool out = true;
+
+    // Print size and alignment of class
+    std::cout << "philox_size: " << sizeof(min::philox) << std::endl;
+    std::cout << "philox_align: " << alignof(min::philox) << std::endl;
+
+    // Test known answers for Philox4x32-10
+    {
+        uint32_t block[4];
+        min::philox zero(0, 0);
+        zero.block(0, block);
+        out = out && test(0x6627e8d5u, block[0], "Failed philox zero known answer 0");
+        out = out && test(0xe169c58du, block[1], "Failed philox zero known answer 1");
+        out = out && test(0xbc57ac4cu, block[2], "Failed philox zero known answer 2");
+        out = out && test(0x9b00dbd8u, block[3], "Failed philox zero known answer 3");
+
+        min::philox pi(0x299f31d0a4093822ull, 0x0370734413198a2eull);
+        pi.block(0x85a308d3243f6a88ull, block);
+        out = out && test(0xd16cfe09u, block[0], "Failed philox pi known answer 0");
+        out = out && test(0x94fdccebu, block[1], "Failed philox pi known answer 1");
+        out = out && test(0x5001e420u, block[2], "Failed philox pi known answer 2");
+        out = out && test(0x24126ea1u, block[3], "Failed philox pi known answer 3");
+    }
+
+    // Test batch generation matches the scalar sequence
+    {
+        min::philox scalar(42, 7);
+        min::philox batch(42, 7);
+        std::vector<uint32_t> bits(103);
+        batch();
+        batch.generate(bits.data(), bits.size());
+        scalar();
+        for (size_t i = 0; i < bits.size(); i++)
+        {
+            out = out && compare(scalar(), bits[i]);
+        }
+        out = out && compare(scalar(), batch());
+        if (!out)
+        {
+            throw std::runtime_error("Failed philox batch generate");
+        }
+
+        // Test seeking to any position
+        min::philox seek(42, 7);
+        seek.seek(50);
+        out = out && compare(bits[49], seek());
+        seek.discard(10);
+        out = out && compare(bits[60], seek());
+        if (!out)
+        {
+            throw std::runtime_error("Failed philox seek");
+        }
+    }
+
+    // Test uniform batches stay in range and work with standard distributions
+    {
+        min::philox gen(3, 0);
+        std::vector<float> values(1000);
+        gen.uniform(values.data(), values.size(), -1.0f, 1.0f);
+        for (const auto v : values)
+        {
+            out = out && v >= -1.0f && v < 1.0f;
+        }
+
+        std::uniform_real_distribution<double> dist(2.0, 3.0);
+        const double d = dist(gen);
+        out = out && d >= 2.0 && d < 3.0;
+        if (!out)
+        {
+            throw std::runtime_error("Failed philox uniform range");
+        }
+    }
+
+    // Test streams are independent of the thread count
+    {
+        min::thread_pool_config config;
+        config.set_threads(1);
+        min::thread_pool serial(config);
+        min::thread_pool parallel;
+        serial.seed(1234);
+        parallel.seed(1234);
+
+        std::vector<uint32_t> one(1000);
+        std::vector<uint32_t> two(1000);
+        const auto draw_one = [&one](min::philox &gen, const size_t i) {
+            one[i] = gen() ^ gen();
+        };
+        const auto draw_two = [&two](min::philox &gen, const size_t i) {
+            two[i] = gen() ^ gen();
+        };
+        serial.run_philox(draw_one, 0, one.size());
+        parallel.run_philox(draw_two, 0, two.size());
+        for (size_t i = 0; i < one.size(); i++)
+        {
+            out = out && compare(one[i], two[i]);
+        }
+        out = out && one[0] != one[1];
+        if (!out)
+        {
+            throw std::runtime_error("Failed philox thread pool streams");
+        }
+    }
+
+    return out;
+}
+
+#endif
@@ -0,0 +1,173 @@
+/* Copyright [2013-2018] [Aaron Springstroh, Minimal Graphics Library]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _MGL_TEST_TASK_GRAPH_MGL_
+#define _MGL_TEST_TASK_GRAPH_MGL_
+
+#include <atomic>
+#include <chrono>
+#include <min/task_graph.h>
+#include <min/test.h>
+#include <min/thread_pool.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+bool test_task_graph()
+{
+    bool out = true;
+
+    // Create a threadpool for doing work in parallel
+    min::thread_pool pool;
+
+    // Create a diamond graph, insert -> (pairs, integrate) -> upload
+    min::task_graph graph;
+    std::atomic<int> clock(0);
+    int insert = -1;
+    int pairs = -1;
+    int integrate = -1;
+    int upload = -1;
+
+    // Each task records when it ran
+    const size_t a = graph.add([&clock, &insert](std::mt19937 &gen) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        insert = clock++;
+    });
+    const size_t b = graph.add([&clock, &pairs](std::mt19937 &gen) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        pairs = clock++;
+    });
+    const size_t c = graph.add([&clock, &integrate](std::mt19937 &gen) {
+        integrate = clock++;
+    });
+    const size_t d = graph.add([&clock, &upload](std::mt19937 &gen) {
+        upload = clock++;
+    });
+
+    // Declare the dependencies once
+    graph.depend(b, a);
+    graph.depend(c, a);
+    graph.depend(d, b);
+    graph.depend(d, c);
+
+    // Test graph size
+    out = out && compare(4, graph.size());
+    if (!out)
+    {
+        throw std::runtime_error("Failed task graph size");
+    }
+
+    // Run the graph every frame
+    for (int i = 0; i < 3; i++)
+    {
+        clock = 0;
+        graph.run(pool);
+
+        // Test the dependency order
+        out = out && compare(0, insert);
+        out = out && (pairs > insert && integrate > insert);
+        out = out && compare(3, upload);
+        if (!out)
+        {
+            throw std::runtime_error("Failed task graph dependency order");
+        }
+
+        // Critical path must cover both sleeping tasks and fit in the run time
+        const double critical = graph.get_critical_path();
+        out = out && (critical >= 4.0);
+        out = out && (critical <= graph.get_time());
+        if (!out)
+        {
+            throw std::runtime_error("Failed task graph critical path");
+        }
+
+        // Upload can't start before pairs has finished
+        out = out && (graph.get_start(d) + 1E-6 >= graph.get_start(b) + graph.get_task_time(b));
+        if (!out)
+        {
+            throw std::runtime_error("Failed task graph task timing");
+        }
+    }
+
+    // Test cycle detection
+    graph.depend(a, d);
+    bool cycle = false;
+    try
+    {
+        graph.run(pool);
+    }
+    catch (std::exception &ex)
+    {
+        cycle = true;
+    }
+    out = out && cycle;
+    if (!out)
+    {
+        throw std::runtime_error("Failed task graph cycle detection");
+    }
+
+    // Test a task error aborts the run and is rethrown
+    {
+        min::thread_pool_config config;
+        config.set_threads(4);
+        min::thread_pool errors(config);
+        min::task_graph failing;
+        bool fail = true;
+        bool ran = false;
+        const size_t e = failing.add([&fail](std::mt19937 &gen) {
+            if (fail)
+            {
+                throw std::runtime_error("task error");
+            }
+        });
+        const size_t f = failing.add([&ran](std::mt19937 &gen) {
+            ran = true;
+        });
+        failing.add([](std::mt19937 &gen) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        });
+        failing.depend(f, e);
+
+        // Error must reach the caller and skip the dependent task
+        std::string error;
+        try
+        {
+            failing.run(errors);
+        }
+        catch (std::exception &ex)
+        {
+            error = ex.what();
+        }
+        out = out && compare("task error", error);
+        out = out && !ran;
+        if (!out)
+        {
+            throw std::runtime_error("Failed task graph task error");
+        }
+
+        // The graph runs again after an error
+        fail = false;
+        failing.run(errors);
+        out = out && ran;
+        if (!out)
+        {
+            throw std::runtime_error("Failed task graph run after error");
+        }
+    }
+
+    // return status
+    return out;
+}
+
+#endif
@@ -16,8 +16,16 @@ limitations under the License.
 #define _MGL_TEST_THREAD_POOL_MGL_
 
 #include <min/test.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iterator>
 #include <min/thread_pool.h>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 bool test_thread_pool()
 {
@@ -73,6 +81,419 @@ bool test_thread_pool()
         throw std::runtime_error("Failed thread pool test");
     }
 
+    // Test turbo mode
+    {
+        // Create a threadpool that spins between runs
+        min::thread_pool turbo;
+        turbo.wake();
+
+        // Work items
+        std::vector<int> values(64, 0);
+        const auto inc = [&values](std::mt19937 &gen, const size_t i) {
+            values[i]++;
+        };
+
+        // Run the job spinning and then parked
+        turbo.run(std::cref(inc), 0, 64);
+        turbo.sleep();
+        turbo.run(std::cref(inc), 0, 64);
+
+        // Every item must be processed twice
+        for (size_t i = 0; i < 64; i++)
+        {
+            out = out && compare(2, values[i]);
+        }
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool turbo mode");
+        }
+    }
+
+    // Test parallel reduce
+    {
+        min::thread_pool reduce;
+
+        // Sum of squares in item order
+        const auto square = [](std::mt19937 &gen, const size_t i) -> size_t {
+            return i * i;
+        };
+        const auto add = [](const size_t a, const size_t b) {
+            return a + b;
+        };
+        const size_t sum = reduce.parallel_reduce(square, add, static_cast<size_t>(5), 0, 1000);
+        out = out && compare(332833505, sum);
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool parallel reduce");
+        }
+
+        // Reduce fewer items than threads and an empty range
+        out = out && compare(14, reduce.parallel_reduce(square, add, static_cast<size_t>(0), 1, 4));
+        out = out && compare(7, reduce.parallel_reduce(square, add, static_cast<size_t>(7), 4, 4));
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool parallel reduce small");
+        }
+
+        // Combine order must be deterministic for non commutative operations
+        const auto digit = [](std::mt19937 &gen, const size_t i) -> std::string {
+            return std::to_string(i % 10);
+        };
+        const auto concat = [](const std::string &a, const std::string &b) {
+            return a + b;
+        };
+        std::string serial;
+        for (size_t i = 0; i < 100; i++)
+        {
+            serial += std::to_string(i % 10);
+        }
+        out = out && compare(serial, reduce.parallel_reduce(digit, concat, std::string(), 0, 100));
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool parallel reduce order");
+        }
+    }
+
+    // Test parallel exclusive scan
+    {
+        min::thread_pool scan;
+
+        // Scan large and small arrays in place
+        for (const size_t size : {10000, 10})
+        {
+            std::vector<size_t> values(size);
+            for (size_t i = 0; i < size; i++)
+            {
+                values[i] = i;
+            }
+
+            const size_t total = scan.parallel_exclusive_scan(values, values, static_cast<size_t>(3), [](const size_t a, const size_t b) {
+                return a + b;
+            });
+
+            // Exclusive prefix sum of i is i*(i-1)/2
+            for (size_t i = 0; i < size; i++)
+            {
+                out = out && compare(3 + (i * (i - 1)) / 2, values[i]);
+            }
+            out = out && compare(3 + (size * (size - 1)) / 2, total);
+            if (!out)
+            {
+                throw std::runtime_error("Failed thread pool parallel exclusive scan");
+            }
+        }
+    }
+
+    // Test work stealing
+    {
+        // Create a threadpool that steals work
+        min::thread_pool steal;
+        steal.set_steal(true);
+
+        // Uneven work items
+        std::vector<std::atomic<int>> counts(1001);
+        for (auto &c : counts)
+        {
+            c = 0;
+        }
+
+        // Create uneven working function
+        const auto uneven = [&counts](std::mt19937 &gen, const size_t i) {
+            // Make the first items much slower than the rest
+            if (i < 16)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            counts[i]++;
+        };
+
+        // Run with automatic grain size
+        steal.run(std::cref(uneven), 0, 1001);
+
+        // Run with a grain of one
+        steal.set_grain(1);
+        steal.run(std::cref(uneven), 0, 1001);
+
+        // Run with a grain larger than the range
+        steal.set_grain(5000);
+        steal.run(std::cref(uneven), 0, 1001);
+
+        // Run with an offset range
+        steal.set_grain(7);
+        steal.run(std::cref(uneven), 500, 1001);
+
+        // Run an empty range
+        steal.run(std::cref(uneven), 10, 10);
+
+        // Every item must be processed exactly once per run
+        for (size_t i = 0; i < 1001; i++)
+        {
+            const int expected = (i < 500) ? 3 : 4;
+            out = out && compare(expected, counts[i].load());
+        }
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool work stealing");
+        }
+    }
+
+    // Test pool configuration
+    {
+        // Cap the worker count and pin all workers to the first core
+        min::thread_pool_config config;
+        config.set_threads(3);
+        config.set_affinity({0});
+        min::thread_pool capped(config);
+        out = out && compare(3, capped.get_thread_count());
+        out = out && compare(1, capped.get_config().get_affinity().size());
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool config thread count");
+        }
+
+        // Allocate worker data on the calling thread with a core that doesn't exist
+        config.set_threads(2);
+        config.set_affinity({100000});
+        config.set_numa_local(false);
+        min::thread_pool fallback(config);
+        out = out && compare(2, fallback.get_thread_count());
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool config fallback");
+        }
+
+        // Both pools must still do all the work
+        std::vector<std::atomic<int>> counts(100);
+        const auto count = [&counts](std::mt19937 &gen, const size_t i) {
+            counts[i]++;
+        };
+        capped.run(std::cref(count), 0, counts.size());
+        fallback.run(std::cref(count), 0, counts.size());
+        for (size_t i = 0; i < counts.size(); i++)
+        {
+            out = out && compare(2, counts[i].load());
+        }
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool config run");
+        }
+    }
+
+    // Test scratch arenas
+    {
+        min::thread_pool arenas;
+        std::vector<size_t> sums(1000, 0);
+        const auto scratch = [&sums](std::mt19937 &gen, min::arena &a, const size_t i) {
+            // Build a temporary list in the worker arena
+            min::arena_vector<size_t> temp{min::arena_allocator<size_t>(a)};
+            for (size_t j = 0; j <= i % 100; j++)
+            {
+                temp.push_back(j);
+            }
+
+            // Store the sum
+            size_t sum = 0;
+            for (const auto v : temp)
+            {
+                sum += v;
+            }
+            sums[i] = sum;
+        };
+
+        // Run with static slices and work stealing
+        arenas.run(std::cref(scratch), 0, sums.size());
+        arenas.set_steal(true);
+        arenas.run(scratch, 0, sums.size());
+        arenas.set_steal(false);
+        for (size_t i = 0; i < sums.size(); i++)
+        {
+            const size_t n = i % 100;
+            out = out && compare((n * (n + 1)) / 2, sums[i]);
+        }
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool scratch arena");
+        }
+    }
+
+#ifdef MGL_THREAD_STATS
+    // Test instrumentation
+    {
+        min::thread_pool stats;
+        std::vector<std::atomic<int>> counts(1000);
+        const auto count = [&counts](std::mt19937 &gen, const size_t i) {
+            counts[i]++;
+        };
+
+        // Every item is counted on exactly one thread
+        stats.run(std::cref(count), 0, counts.size());
+        stats.set_steal(true);
+        stats.run(std::cref(count), 0, counts.size());
+        size_t items = 0;
+        for (size_t i = 0; i < stats.get_thread_count(); i++)
+        {
+            const min::thread_stats &st = stats.get_stats(i);
+            items += st.get_items();
+            out = out && st.get_busy_time() >= 0.0;
+            out = out && st.get_idle_time() >= 0.0;
+            out = out && st.get_wake_latency() <= st.get_max_wake_latency();
+            out = out && st.get_events().size() >= 1;
+        }
+        out = out && compare(2 * counts.size(), items);
+        out = out && compare(2, stats.get_runs());
+        out = out && stats.get_imbalance() >= 1.0;
+        out = out && stats.get_max_imbalance() >= stats.get_imbalance();
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool stats");
+        }
+
+        // Dump a trace and check it is chrome trace json
+        stats.dump_trace("bin/thread_pool_trace.json");
+        std::ifstream trace("bin/thread_pool_trace.json");
+        const std::string text((std::istreambuf_iterator<char>(trace)), std::istreambuf_iterator<char>());
+        out = out && text.find("\"traceEvents\"") != std::string::npos;
+        out = out && text.find("\"ph\":\"X\"") != std::string::npos;
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool trace dump");
+        }
+
+        // Reset clears all counters
+        stats.reset_stats();
+        out = out && compare(0, stats.get_runs());
+        out = out && compare(0, stats.get_stats(0).get_items());
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool stats reset");
+        }
+    }
+#endif
+
+    // Test submitting jobs
+    {
+        min::thread_pool jobs;
+        // Submit more jobs than there are slots
+        std::vector<size_t> results(200, 0);
+        std::vector<min::job_handle> handles;
+        handles.reserve(results.size());
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            size_t *result = &results[i];
+            handles.push_back(jobs.submit([result, i](std::mt19937 &gen) {
+                *result = i * i;
+            }));
+        }
+
+        // Wait for all jobs to finish
+        for (auto &h : handles)
+        {
+            h.wait();
+            out = out && h.done();
+        }
+
+        // Every job must have run once
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            out = out && compare(i * i, results[i]);
+        }
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool submit");
+        }
+
+        // Submit a callable that is too large for the small buffer in std::function
+        const std::array<size_t, 6> values = {1, 2, 3, 4, 5, 6};
+        size_t sum = 0;
+        size_t *ptr = &sum;
+        min::job_handle h = jobs.submit([values, ptr](std::mt19937 &gen) {
+            for (const auto v : values)
+            {
+                *ptr += v;
+            }
+        });
+        h.wait();
+        out = out && compare(21, sum);
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool submit large callable");
+        }
+
+        // Workers park while a taken job is still running
+        {
+            min::thread_pool_config config;
+            config.set_threads(4);
+            min::thread_pool parks(config);
+            std::atomic<bool> started(false);
+            std::atomic<bool> release(false);
+            min::job_handle block = parks.submit([&started, &release](std::mt19937 &gen) {
+                started = true;
+                while (!release)
+                {
+                    std::this_thread::yield();
+                }
+            });
+            while (!started)
+            {
+                std::this_thread::yield();
+            }
+
+            // Let the woken workers run out their spin before counting
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            const auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while (parks.get_parked_count() + 2 < parks.get_thread_count() && std::chrono::steady_clock::now() < timeout)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            out = out && compare(parks.get_thread_count() - 2, parks.get_parked_count());
+            release = true;
+            block.wait();
+            if (!out)
+            {
+                throw std::runtime_error("Failed thread pool park while job is running");
+            }
+        }
+
+        // Submit jobs from many threads at once
+        std::atomic<size_t> count(0);
+        std::vector<std::thread> submitters;
+        for (size_t t = 0; t < 4; t++)
+        {
+            submitters.emplace_back([&jobs, &count]() {
+                std::vector<min::job_handle> local;
+                for (size_t i = 0; i < 100; i++)
+                {
+                    local.push_back(jobs.submit([&count](std::mt19937 &gen) {
+                        gen();
+                        count++;
+                    }));
+                }
+                for (auto &l : local)
+                {
+                    l.wait();
+                }
+            });
+        }
+        for (auto &t : submitters)
+        {
+            t.join();
+        }
+        out = out && compare(400, count.load());
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool concurrent submit");
+        }
+
+        // A default handle is always done
+        min::job_handle empty;
+        empty.wait();
+        out = out && empty.done();
+        if (!out)
+        {
+            throw std::runtime_error("Failed thread pool empty job handle");
+        }
+    }
+
     // return status
     return out;
 }